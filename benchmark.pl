@@ -0,0 +1,353 @@
+#!/usr/bin/perl -w
+#
+# generates a synthetic project and times ferret on it:
+#   --init, full build, no-op build, single .cpp touch, core header touch
+# results go to stdout and, machine readable, to a JSON file
+#
+# perl benchmark.pl --libs 20 --exes 2 --files 50 -p 8 --out bench.json
+#
+# by default a stub compiler that only creates its output file is used, so
+# what is measured is mostly ferret itself. --real compiles with g++.
+
+use Getopt::Long;
+use Time::HiRes qw(time);
+use Cwd qw(abs_path);
+use FindBin;
+use POSIX qw(strftime);
+
+my $dir     = "/tmp/ferret_bench";
+my $bin     = "$FindBin::Bin/build/bin";   # where ferret and ferret_inc are
+my $libs    = 10;                   # library nodes, each uses the previous one
+my $exes    = 2;                    # executable nodes, each uses all libraries
+my $files   = 20;                   # .cpp files per node
+my $headers = 10;                   # headers per node
+my $fanout  = 4;                    # includes of node headers per .cpp file
+my $depth   = 3;                    # length of include chains between headers of a node
+my $ext     = 0;                    # nodes with a generated source (extension "gen")
+my $par     = 4;
+my $out     = "bench_results.json";
+my $real    = 0;
+my $help    = 0;
+
+my $usage = "usage: benchmark.pl [--dir d] [--bin dir] [--libs n] [--exes n] [--files n] [--headers n] " .
+            "[--fanout n] [--depth n] [--ext n] [-p n] [--out file] [--real]\n";
+
+GetOptions( "dir=s" => \$dir, "bin=s" => \$bin, "libs=i" => \$libs, "exes=i" => \$exes,
+            "files=i" => \$files, "headers=i" => \$headers, "fanout=i" => \$fanout,
+            "depth=i" => \$depth, "ext=i" => \$ext, "p=i" => \$par, "out=s" => \$out,
+            "real" => \$real, "help" => \$help )
+    or die( $usage );
+
+if( $help )
+{
+    print $usage;
+    exit 0;
+}
+
+$headers = 1 if( $headers < 1 );
+$fanout = $headers if( $fanout > $headers );
+
+my $srcroot = $FindBin::Bin;        # ferret's tree, for ferret_dep.sh and the script templates
+$bin = abs_path( $bin );
+$out = abs_path( $out ) if( $out !~ /^\// );
+
+die( "ferret not found in $bin\n" ) unless( -x "$bin/ferret" && -x "$bin/ferret_inc" );
+
+if( !defined $ENV{HOSTNAME} || $ENV{HOSTNAME} eq "" )
+{
+    $ENV{HOSTNAME} = `hostname`;
+    chomp $ENV{HOSTNAME};
+}
+my $host = $ENV{HOSTNAME};
+
+my $n_cpp = 0;
+my $n_hdr = 0;
+my @nodes;
+
+generate();
+
+chdir $dir or die( "could not change to $dir" );
+
+my @results;
+run( "init",           [ "--init", "." ] );
+run( "full build",     [ "-p", $par, "." ] );
+run( "no-op build",    [ "-p", $par, "." ] );
+touch_file( "$nodes[-1]/src/f_0.cpp" );
+run( "cpp touch",      [ "-p", $par, "." ] );
+touch_file( "$nodes[0]/src/core.h" );
+run( "core header touch", [ "-p", $par, "." ] );
+
+chdir $srcroot;
+write_results();
+exit 0;
+
+
+sub write_file_text
+{
+    my $fn = shift;
+    my $text = shift;
+
+    open( my $fh, '>', $fn ) or die( "could not write $fn" );
+    print $fh $text;
+    close $fh;
+}
+
+
+sub touch_file
+{
+    my $fn = shift;
+
+    sleep 1;                          # do not depend on time stamp resolution
+    my $t = time;
+    utime( $t, $t, $fn ) or die( "could not touch $fn" );
+}
+
+
+sub node_name
+{
+    my $i = shift;
+
+    return sprintf( "lib_%03d", $i ) if( $i < $libs );
+    return sprintf( "exe_%03d", $i - $libs );
+}
+
+
+sub generate
+{
+    system( "rm -rf $dir" );
+    !system( "mkdir -p $dir/build/bin $dir/build/script_templ" ) or die( "could not create $dir" );
+
+    !system( "cp $bin/ferret $bin/ferret_inc $dir/build/bin/" ) or die( "could not copy ferret" );
+    !system( "cp $srcroot/build/ferret_dep.sh $dir/build/" ) or die( "could not copy ferret_dep.sh" );
+    !system( "cp $srcroot/build/script_templ/*.templ $dir/build/script_templ/" ) or die( "could not copy script templates" );
+
+    my $compiler = "/usr/bin/g++";
+    if( !$real )
+    {
+        $compiler = "$dir/build/stub_cc.sh";
+        write_file_text( $compiler, "#!/bin/sh\n# stands in for compiler and linker, creates what is given with -o\n" .
+                         "out=\"\"\nwhile [ \$# -gt 0 ]; do\n  if [ \"\$1\" = \"-o\" ]; then shift; out=\"\$1\"; fi\n  shift\ndone\n" .
+                         "[ -n \"\$out\" ] && : > \"\$out\"\nexit 0\n" );
+        chmod 0755, $compiler;
+
+        foreach my $t ( "ferret_l.sh.templ", "ferret_x.sh.templ" )  # link scripts call g++ directly
+        {
+            my $fn = "$dir/build/script_templ/$t";
+            open( my $fh, '<', $fn ) or die( "could not read $fn" );
+            my $data = join( "", <$fh> );
+            close $fh;
+            $data =~ s/^g\+\+ /$compiler /m;
+            write_file_text( $fn, $data );
+        }
+    }
+
+    write_file_text( "$dir/build/script_templ/ferret_gen.sh.templ",
+                     "#!/bin/sh\n\ntrap \"exit 1\" SIGINT\n\necho \"gen \$GEN_IN -> \$GEN_OUT\"\ncp \$GEN_IN \$GEN_OUT\n\nexit 0\n" );
+
+    write_file_text( "$dir/build/platform_$host.xml", <<"EOF" );
+<?xml version="1.0" encoding="ISO-8859-1"?>
+<platform>
+    <compiler_version value="GCC"/>
+    <compiler value="$compiler"/>
+    <cppflags value=" -Wall" />
+    <compilerc value="/usr/bin/gcc"/>
+    <cflags value=" -Wall" />
+    <compile_mode value="DEBUG">
+        <cppflags value=" -g "/>
+        <cflags value=" -g "/>
+    </compile_mode>
+    <compile_trait type="library" >
+      <cppflags value="-fPIC"/>
+    </compile_trait>
+    <soext value=".so"/>
+    <staticext value=".a"/>
+    <lflags value=" -shared "/>
+    <eflags value=" "/>
+
+    <extension name="gen" >
+      <selector param="name" fileext=".gen">
+        <assign part="full" to="SOURCE" />
+        <assign part="bn_wo_ext" to="SOURCE_WO_EXTENSION" />
+      </selector>
+      <file_node name="input">
+        <file_name value="\${SOURCE}" />
+        <assign_file_name to="GEN_INPUT" />
+        <block extent="full" />
+      </file_node>
+      <extension_node name="output">
+        <file_name value="\${OBJ_DIR}/gen_\${SOURCE_WO_EXTENSION}" append=".cpp" />
+        <assign_file_name to="GEN_OUTPUT" />
+        <block extent="include" />
+      </extension_node>
+      <dependency from_node="output" to_node="input" />
+      <script_name value="ferret_gen.sh.templ" />
+      <script_stencil value="ferret_gen__#.sh" />
+      <replace name="GEN_IN"  value="\${GEN_INPUT}" />
+      <replace name="GEN_OUT" value="\${GEN_OUTPUT}" />
+    </extension>
+</platform>
+EOF
+
+    write_file_text( "$dir/build/build_$host.properties",
+                     "OBJDIR=obj/\$compile_mode\$/\$proj_dir\$\nBINDIR=bin/\$compile_mode\$\nLIBDIR=lib/\$compile_mode\$\nFERRET_P=$par\n" );
+
+    my $subs = "";
+    for( my $i = 0; $i < $libs + $exes; $i++ )
+    {
+        my $name = node_name( $i );
+        push @nodes, $name;
+        $subs .= "  <sub name=\"$name\" />\n";
+        generate_node( $i, $name );
+    }
+
+    write_file_text( "$dir/build/project.xml",
+                     "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<project module=\"bench\" name=\"bench\">\n$subs</project>\n" );
+}
+
+
+sub generate_node
+{
+    my $i = shift;
+    my $name = shift;
+    my $is_lib = $i < $libs;
+    my $src = "$dir/$name/src";
+
+    !system( "mkdir -p $src" ) or die( "could not create $src" );
+
+    my $subs = "";
+    if( $is_lib )
+    {
+        $subs = "  <sub name=\"" . node_name( $i - 1 ) . "\" />\n" if( $i > 0 );
+    }
+    else
+    {
+        for( my $l = 0; $l < $libs; $l++ )
+        {
+            $subs .= "  <sub name=\"" . node_name( $l ) . "\" />\n";
+        }
+    }
+
+    my $ext_use = "";
+    if( $i < $ext )
+    {
+        $ext_use = "  <gen name=\"table.gen\" />\n";
+        write_file_text( "$src/table.gen", "#include \"${name}_h0.h\"\nint ${name}_table() { return 42; }\n" );
+    }
+
+    my $type = $is_lib ? "library" : "executable";
+    write_file_text( "$dir/$name/project.xml",
+                     "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<project module=\"bench\" name=\"$name\" target=\"$name\" type=\"$type\">\n$subs$ext_use</project>\n" );
+
+    if( $i == 0 )
+    {
+        write_file_text( "$src/core.h", "#ifndef BENCH_CORE_H\n#define BENCH_CORE_H\n\nstruct Core { int v; };\n\n#endif\n" );
+        $n_hdr++;
+    }
+
+    # headers form chains of length $depth, the head of each chain includes the core header
+    # and the first header of the node below
+    for( my $h = 0; $h < $headers; $h++ )
+    {
+        my $g = "BENCH_" . uc( $name ) . "_H$h";
+        my $inc = "";
+        if( ($h % $depth) == 0 )
+        {
+            $inc .= "#include \"core.h\"\n";
+            my $below = $is_lib ? $i - 1 : $libs - 1;
+            $inc .= "#include \"" . node_name( $below ) . "_h0.h\"\n" if( $below >= 0 );
+        }
+        else
+        {
+            $inc .= "#include \"${name}_h" . ($h - 1) . ".h\"\n";
+        }
+
+        write_file_text( "$src/${name}_h$h.h", "#ifndef $g\n#define $g\n\n$inc\nint ${name}_f$h( int a );\n\n#endif\n" );
+        $n_hdr++;
+    }
+
+    for( my $f = 0; $f < $files; $f++ )
+    {
+        my $inc = "#include \"core.h\"\n";
+        for( my $k = 0; $k < $fanout; $k++ )
+        {
+            $inc .= "#include \"${name}_h" . (($f + $k) % $headers) . ".h\"\n";
+        }
+
+        my $body = "int ${name}_file$f( int a )\n{\n    Core c;\n    c.v = a;\n    return c.v + $f;\n}\n";
+        $body .= "\nint main()\n{\n    return 0;\n}\n" if( !$is_lib && $f == 0 );
+
+        write_file_text( "$src/f_$f.cpp", "$inc\n$body" );
+        $n_cpp++;
+    }
+}
+
+
+sub run
+{
+    my $name = shift;
+    my $args = shift;
+
+    my $cmd = "build/bin/ferret --times " . join( " ", @$args ) . " 2>&1";
+    my $start = time;
+    my @output = `$cmd`;
+    my $wall = time - $start;
+    my $rc = $? >> 8;
+
+    my %phases;
+    my @order;
+    my $targets = 0;
+    foreach my $l ( @output )
+    {
+        if( $l =~ /^\s*(.+) took ([0-9.]+)s$/ )
+        {
+            push @order, $1 unless( exists $phases{$1} );
+            $phases{$1} += $2;
+        }
+        $targets = $1 if( $l =~ /^(\d+) final target\(s\)/ );
+    }
+
+    printf( "%-20s %8.3fs  rc %d\n", $name, $wall, $rc );
+    if( $rc != 0 )
+    {
+        print "   ", join( "   ", @output[ ($#output > 10 ? $#output - 10 : 0) .. $#output ] );
+    }
+
+    push @results, { name => $name, wall => $wall, rc => $rc, targets => $targets, phases => \%phases, order => \@order };
+}
+
+
+sub json_str
+{
+    my $s = shift;
+    $s =~ s/\\/\\\\/g;
+    $s =~ s/"/\\"/g;
+    return "\"$s\"";
+}
+
+
+sub write_results
+{
+    open( my $fh, '>', $out ) or die( "could not write $out" );
+
+    print $fh "{\n";
+    print $fh "  \"date\": ", json_str( strftime( "%Y-%m-%dT%H:%M:%S", localtime ) ), ",\n";
+    print $fh "  \"host\": ", json_str( $host ), ",\n";
+    print $fh "  \"config\": { \"libs\": $libs, \"exes\": $exes, \"files\": $files, \"headers\": $headers, ",
+              "\"fanout\": $fanout, \"depth\": $depth, \"ext\": $ext, \"p\": $par, \"real\": ", ($real ? "true" : "false"), " },\n";
+    print $fh "  \"sources\": { \"cpp\": $n_cpp, \"headers\": $n_hdr },\n";
+    print $fh "  \"scenarios\": [\n";
+
+    for( my $i = 0; $i <= $#results; $i++ )
+    {
+        my $r = $results[$i];
+        my @ph = map { json_str( $_ ) . ": " . sprintf( "%.3f", $r->{phases}{$_} ) } @{ $r->{order} };
+
+        printf $fh "    { \"name\": %s, \"wall_s\": %.3f, \"rc\": %d, \"final_targets\": %d,\n      \"phases_s\": { %s } }%s\n",
+            json_str( $r->{name} ), $r->{wall}, $r->{rc}, $r->{targets}, join( ", ", @ph ), ($i < $#results ? "," : "");
+    }
+
+    print $fh "  ]\n}\n";
+    close $fh;
+
+    print "results written to $out\n";
+}
@@ -22,7 +22,7 @@ fi
 
 if [ ! -x build/bin/ferret ]
 then
-    g++ -o build/bin/ferret mcp/src/*.cpp -lrt
+    g++ -o build/bin/ferret -Imcp/src mcp/src/*.cpp ferret/src/*.cpp -lrt -lpthread
     [ ! -x build/bin/ferret ] && exit 1
 fi
 
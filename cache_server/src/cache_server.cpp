@@ -0,0 +1,263 @@
+// reference server for ferret's remote cache (FERRET_REMOTE_CACHE), keeps everything in a directory
+// ferret_cache_server -d <dir> [-p <port>] [-b <bind address>]
+// GET, HEAD and PUT on [/prefix]/ac/<sha256> and [/prefix]/cas/<sha256>. PUTs to /cas are checked against
+// their digest. one request per connection, one connection at a time
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <string>
+#include <iostream>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "sha256.h"
+
+using namespace std;
+
+static string dir;
+static long long maxBody = 1024LL * 1024 * 1024;
+
+
+static bool isDigest( const string &s )
+{
+    if( s.length() != 64 )
+        return false;
+    
+    for( size_t i = 0; i < s.length(); i++)
+        if( !((s[i] >= '0' && s[i] <= '9') || (s[i] >= 'a' && s[i] <= 'f')) )
+            return false;
+    return true;
+}
+
+
+// "[/prefix]/ac/<digest>" -> "<dir>/ac/<2 chars>/<digest>"
+static bool mapPath( const string &path, string &kind, string &fn)
+{
+    size_t slash = path.rfind( '/' );
+    if( slash == string::npos || slash == 0 )
+        return false;
+    
+    string digest = path.substr( slash + 1 );
+    size_t kslash = path.rfind( '/', slash - 1);
+    kind = path.substr( kslash + 1, slash - kslash - 1);
+    
+    if( (kind != "ac" && kind != "cas") || !isDigest( digest ) )
+        return false;
+    
+    fn = dir + "/" + kind + "/" + digest.substr( 0, 2) + "/" + digest;
+    return true;
+}
+
+
+static void sendAll( int fd, const string &data )
+{
+    size_t sent = 0;
+    while( sent < data.length() )
+    {
+        ssize_t n = send( fd, data.data() + sent, data.length() - sent, MSG_NOSIGNAL);
+        if( n <= 0 )
+            return;
+        sent += n;
+    }
+}
+
+
+static void respond( int fd, int status, const char *reason, const string &body, bool withBody = true)
+{
+    char head[ 256 ];
+    snprintf( head, sizeof(head), "HTTP/1.1 %d %s\r\nContent-Length: %lu\r\nConnection: close\r\n\r\n",
+              status, reason, (unsigned long)body.length());
+    sendAll( fd, withBody ? head + body : string( head ));
+}
+
+
+static bool readFile( const string &fn, string &content)
+{
+    FILE *fp = fopen( fn.c_str(), "r");
+    if( !fp )
+        return false;
+    
+    char buf[ 65536 ];
+    size_t n;
+    while( (n = fread( buf, 1, sizeof(buf), fp)) > 0 )
+        content.append( buf, n);
+    
+    bool ok = !ferror( fp );
+    fclose( fp );
+    return ok;
+}
+
+
+static bool writeFile( const string &fn, const string &content)
+{
+    string sub = fn.substr( 0, fn.rfind( '/' ));
+    mkdir( sub.substr( 0, sub.rfind( '/' )).c_str(), 0755);
+    mkdir( sub.c_str(), 0755);
+    
+    char tmp[ 64 ];
+    snprintf( tmp, sizeof(tmp), ".tmp%d", (int)getpid());
+    string tmpFn = fn + tmp;
+    
+    int fd = open( tmpFn.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if( fd < 0 )
+        return false;
+    
+    bool ok = write( fd, content.data(), content.length()) == (ssize_t)content.length();
+    if( close( fd ) != 0 || !ok || rename( tmpFn.c_str(), fn.c_str()) != 0 )
+    {
+        unlink( tmpFn.c_str() );
+        return false;
+    }
+    return true;
+}
+
+
+static void serve( int fd )
+{
+    string in;
+    char buf[ 65536 ];
+    ssize_t n;
+    size_t hdrEnd;
+    
+    while( (hdrEnd = in.find( "\r\n\r\n" )) == string::npos )
+    {
+        if( in.length() > 65536 || (n = recv( fd, buf, sizeof(buf), 0)) <= 0 )
+            return;
+        in.append( buf, n);
+    }
+    
+    char method[ 16 ], path[ 1024 ];
+    if( sscanf( in.c_str(), "%15s %1023s", method, path) != 2 )
+    {
+        respond( fd, 400, "Bad Request", "");
+        return;
+    }
+    
+    string headers = in.substr( 0, hdrEnd);
+    for( size_t i = 0; i < headers.length(); i++)
+        headers[i] = tolower( headers[i] );
+    
+    long long len = 0;
+    size_t cl = headers.find( "content-length:" );
+    if( cl != string::npos )
+        len = atoll( headers.c_str() + cl + 15 );
+    
+    string body = in.substr( hdrEnd + 4 );
+    if( len > maxBody )
+    {
+        respond( fd, 413, "Payload Too Large", "");
+        return;
+    }
+    while( (long long)body.length() < len && (n = recv( fd, buf, sizeof(buf), 0)) > 0 )
+        body.append( buf, n);
+    
+    string kind, fn;
+    if( !mapPath( path, kind, fn) )
+    {
+        respond( fd, 400, "Bad Request", "");
+        return;
+    }
+    
+    if( strcmp( method, "GET") == 0 || strcmp( method, "HEAD") == 0 )
+    {
+        string content;
+        if( readFile( fn, content) )
+            respond( fd, 200, "OK", content, strcmp( method, "GET") == 0);
+        else
+            respond( fd, 404, "Not Found", "");
+    }
+    else if( strcmp( method, "PUT") == 0 )
+    {
+        if( (long long)body.length() != len )
+            respond( fd, 400, "Bad Request", "");
+        else if( kind == "cas" && Sha256::hex( body ) != fn.substr( fn.length() - 64 ) )
+            respond( fd, 400, "Bad Request", "digest mismatch\n");
+        else if( writeFile( fn, body) )
+            respond( fd, 200, "OK", "");
+        else
+            respond( fd, 500, "Internal Server Error", "");
+    }
+    else
+        respond( fd, 405, "Method Not Allowed", "");
+}
+
+
+int main( int argc, char **argv)
+{
+    string port = "8080", bindAddr = "127.0.0.1";
+    
+    for( int i = 1; i < argc; i++)
+    {
+        if( strcmp( argv[i], "-d") == 0 && i + 1 < argc )
+            dir = argv[++i];
+        else if( strcmp( argv[i], "-p") == 0 && i + 1 < argc )
+            port = argv[++i];
+        else if( strcmp( argv[i], "-b") == 0 && i + 1 < argc )
+            bindAddr = argv[++i];
+        else
+        {
+            dir = "";
+            break;
+        }
+    }
+    
+    if( dir == "" )
+    {
+        cerr << "usage: ferret_cache_server -d <dir> [-p <port>] [-b <bind address>]\n";
+        return 2;
+    }
+    
+    mkdir( dir.c_str(), 0755);
+    mkdir( (dir + "/ac").c_str(), 0755);
+    mkdir( (dir + "/cas").c_str(), 0755);
+    signal( SIGPIPE, SIG_IGN);
+    
+    struct addrinfo hints, *res;
+    memset( &hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    
+    if( getaddrinfo( bindAddr.c_str(), port.c_str(), &hints, &res) != 0 )
+    {
+        cerr << "error: cannot resolve " << bindAddr << "\n";
+        return 1;
+    }
+    
+    int lfd = socket( res->ai_family, res->ai_socktype, res->ai_protocol);
+    int on = 1;
+    setsockopt( lfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if( lfd < 0 || bind( lfd, res->ai_addr, res->ai_addrlen) != 0 || listen( lfd, 64) != 0 )
+    {
+        perror( "ferret_cache_server" );
+        return 1;
+    }
+    freeaddrinfo( res );
+    
+    cout << "serving " << dir << " on " << bindAddr << ":" << port << endl;
+    
+    for(;;)
+    {
+        int fd = accept( lfd, 0, 0);
+        if( fd < 0 )
+            continue;
+        
+        struct timeval tv;
+        tv.tv_sec = 10;
+        tv.tv_usec = 0;
+        setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        
+        serve( fd );
+        close( fd );
+    }
+    
+    return 0;
+}
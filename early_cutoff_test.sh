@@ -0,0 +1,62 @@
+#!/bin/sh
+#
+# early cutoff after an interrupted build: an object is rebuilt with new content but the executable is not
+# relinked. the next run rebuilds the object byte-identical, that must not cut off the stale link
+#
+# sh early_cutoff_test.sh [bin dir]      (default build/bin, where ferret and ferret_inc are)
+
+src=$(cd "$(dirname "$0")" && pwd)
+bin=$(cd "${1:-$src/build/bin}" && pwd)
+dir=/tmp/ferret_cutoff_test
+export HOSTNAME=${HOSTNAME:-$(hostname)}
+
+fail()
+{
+    echo "FAILED: $1"
+    exit 1
+}
+
+rm -rf $dir
+mkdir -p $dir/build/bin $dir/build/script_templ $dir/app/src || fail "could not create $dir"
+cp $bin/ferret $bin/ferret_inc $dir/build/bin/ || fail "could not copy ferret"
+cp $src/build/ferret_dep.sh $dir/build/
+cp $src/build/script_templ/*.templ $dir/build/script_templ/
+cp $src/build/platform_generic.xml $dir/build/platform_$HOSTNAME.xml
+printf 'OBJDIR=obj/$compile_mode$/$proj_dir$\nBINDIR=bin/$compile_mode$\nLIBDIR=lib/$compile_mode$\nFERRET_EARLY_CUTOFF=y\n' \
+    > $dir/build/build_$HOSTNAME.properties
+
+cat > $dir/build/project.xml <<EOF
+<?xml version="1.0" encoding="UTF-8"?>
+<project module="cutoff" name="cutoff">
+  <sub name="app" />
+</project>
+EOF
+cat > $dir/app/project.xml <<EOF
+<?xml version="1.0" encoding="UTF-8"?>
+<project module="cutoff" name="app" target="app" type="executable">
+</project>
+EOF
+printf 'int value();\nint main() { return value(); }\n' > $dir/app/src/main.cpp
+printf 'int value() { return 1; }\n' > $dir/app/src/value.cpp
+
+cd $dir
+sleep 1                                   # the properties must be older than the file db
+build/bin/ferret -M DEBUG --ignhdr . > init.log 2>&1 || fail "init, see $dir/init.log"
+build/bin/ferret > build1.log 2>&1 || fail "first build, see $dir/build1.log"
+bin/DEBUG/app
+[ $? -eq 1 ] || fail "first build gives a wrong executable"
+
+# the interrupted run: the object gets the new value, the link does not happen
+sleep 1
+printf 'int value() { return 2; }\n' > app/src/value.cpp
+build/bin/ferret -t obj/DEBUG/app/value.o > build2.log 2>&1 || fail "object only build, see $dir/build2.log"
+
+# touched, not changed. the object comes out the same as in the interrupted run
+sleep 1
+touch app/src/value.cpp
+build/bin/ferret > build3.log 2>&1 || fail "build after interruption, see $dir/build3.log"
+bin/DEBUG/app
+[ $? -eq 2 ] || fail "executable not relinked after the interrupted build, see $dir/build3.log"
+
+echo "early cutoff test passed"
+exit 0
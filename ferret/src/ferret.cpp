@@ -2,6 +2,7 @@
 // https://github.com/mcjurij/ferret
 
 #include <iostream>
+#include <sstream>
 
 #include <cassert>
 #include <algorithm>
@@ -11,6 +12,7 @@
 #include "traverse_structure.h"
 #include "find_files.h"
 #include "executor.h"
+#include "remote_executor.h"
 #include "parse_dep.h"
 #include "engine.h"
 #include "platform_spec.h"
@@ -23,6 +25,10 @@
 #include "script_template.h"
 #include "project_xml_timestamps.h"
 #include "bazel_tree.h"
+#include "build_trace.h"
+#include "perf_history.h"
+#include "time_trace.h"
+#include "phase_profiler.h"
 
 using namespace std;
 
@@ -61,6 +67,7 @@ static void show_usage()
         "   -p <n>                  use <n> processors, default is 1\n"
         "   --stop                  stop on first error, default is ignore\n"
         "   --deep                  follow dependencies of shared libraries\n"
+        "   --direct                call compiler directly instead of through /bin/sh where the script allows it\n"
         "   --prop <properties>     use <properties> file when init, default is build/build_$HOSTNAME.properties\n"
         "   --proj <project_dir>    use <project_dir> as root node, default is build (using build/project.xml)\n"
         "   -q                      quick mode, build project of the sub directory only\n"
@@ -80,7 +87,10 @@ static void show_usage()
         "   --cur or --curses       enter curses mode, press 'm' for pop up\n"
 #endif
         "   -v,-vv,-vvv             verbosity, more verbosity, incredible verbosity\n"
-        "   --times                 show various time consumptions\n\n"
+        "   --times                 show various time consumptions\n"
+        "   --times-json <file>     write tree of phases with time and counters to <file>\n"
+        "   --trace <file>          write trace of phases and jobs to <file>, for chrome://tracing or Perfetto\n"
+        "   --perf-report           compare last build with the previous ones and show top regressions\n\n"
         "Version " + ferretVersion + "\n";
     
     exit(2);
@@ -268,6 +278,7 @@ bool compileModeSet = false;
 string compileMode;
 bool stopOnErr = false;
 bool downwardDeep = false;
+bool directExec = false;
 }
 
 static void readBuildProperties( bool initMode, const string &build_properies, const string &projDir)
@@ -393,23 +404,119 @@ static void readBuildProperties( bool initMode, const string &build_properies, c
             cout << "Deep mode turned on by command line argument.\n";
         BuildProps::getTheBuildProps()->setBoolValue( "FERRET_DEEP", true);
     }
+
+    if( !directExec )
+    {
+        if( BuildProps::getTheBuildProps()->hasKey( "FERRET_DIRECT" ) )
+        {
+            directExec = BuildProps::getTheBuildProps()->getBoolValue( "FERRET_DIRECT" );
+            if( directExec && verbosity > 0 )
+                cout << "Direct exec turned on by build properties setting.\n";
+        }
+    }
+    else
+    {
+        if( verbosity > 0 )
+            cout << "Direct exec turned on by command line argument.\n";
+        BuildProps::getTheBuildProps()->setBoolValue( "FERRET_DIRECT", true);
+    }
+
+    if( BuildProps::getTheBuildProps()->hasKey( "FERRET_HISTORY_RUNS" ) )   // runs kept in ferret_history, 0 turns it off
+    {
+        int n = BuildProps::getTheBuildProps()->getIntValue( "FERRET_HISTORY_RUNS" );
+        if( n >= 0 )
+            PerfHistory::getThePerfHistory()->setMaxRuns( n );
+    }
+
+    if( BuildProps::getTheBuildProps()->hasKey( "FERRET_OUTMEM" ) )     // MB of job output kept in memory, rest is spilled to disk
+    {
+        int mb = BuildProps::getTheBuildProps()->getIntValue( "FERRET_OUTMEM" );
+        if( mb > 0 )
+            OutputCollector::getTheOutputCollector()->setOutputMemLimit( (size_t)mb * 1024 * 1024 );
+    }
 }
 
 
 static void doBuild( FileManager &filesDb, set<string> &userTargets, const string &dbProjDir, bool printTimes, bool curses)
 {
-    Executor executor( BuildProps::getTheBuildProps()->getIntValue( "FERRET_P" ), curses);
+    RemoteExecutor executor( BuildProps::getTheBuildProps()->getIntValue( "FERRET_P" ), curses);    // local only without workers
     bool doScfs = BuildProps::getTheBuildProps()->getBoolValue( "FERRET_SCFS" );
     Engine engine( 911, dbProjDir, filesDb.getCompileMode(), doScfs);
     engine.cursesEnable( curses );
     
     bool stopOnErr = BuildProps::getTheBuildProps()->getBoolValue( "FERRET_STOP" );
     engine.setStopOnError( stopOnErr );
+    engine.setContentHash( BuildProps::getTheBuildProps()->getBoolValue( "FERRET_CONTENT_HASH" ) );
+    engine.setEarlyCutoff( BuildProps::getTheBuildProps()->getBoolValue( "FERRET_EARLY_CUTOFF" ) );
+    
+    string cacheDir = BuildProps::getTheBuildProps()->getValue( "FERRET_CACHE_DIR" );
+    if( cacheDir.length() > 0 )
+    {
+        int cacheMb = 2048;
+        if( BuildProps::getTheBuildProps()->hasKey( "FERRET_CACHE_SIZE" ) )
+            cacheMb = BuildProps::getTheBuildProps()->getIntValue( "FERRET_CACHE_SIZE" );
+        engine.setActionCache( cacheDir, cacheMb, BuildProps::getTheBuildProps()->getBoolValue( "FERRET_CACHE_LINK" ));
+    }
+    
+    string remoteCache = BuildProps::getTheBuildProps()->getValue( "FERRET_REMOTE_CACHE" );
+    if( remoteCache.length() > 0 )
+        engine.setRemoteCache( remoteCache, BuildProps::getTheBuildProps()->getBoolValue( "FERRET_REMOTE_CACHE_UPLOAD" ));
+    
+    string workers = BuildProps::getTheBuildProps()->getValue( "FERRET_REMOTE_WORKERS" );
+    if( workers.length() > 0 )
+    {
+        if( BuildProps::getTheBuildProps()->hasKey( "FERRET_REMOTE_TOKEN" ) )     // file holding the token of the workers
+            executor.setTokenFile( BuildProps::getTheBuildProps()->getValue( "FERRET_REMOTE_TOKEN" ) );
+        engine.setRemoteExec( executor.addWorkers( workers ) );
+    }
+    executor.setupJobServer( BuildProps::getTheBuildProps()->getBoolValue( "FERRET_JOBSERVER" ) );
+    if( BuildProps::getTheBuildProps()->getBoolValue( "FERRET_ADAPTIVE" ) )     // FERRET_P becomes the upper bound
+        executor.setupAdaptive( BuildProps::getTheBuildProps()->getIntValue( "FERRET_P_MIN" ),
+                                BuildProps::getTheBuildProps()->getIntValue( "FERRET_ADAPTIVE_INTERVAL" ));
+    
+    if( BuildProps::getTheBuildProps()->getIntValue( "FERRET_BATCH" ) > 1 )     // sources per compiler call
+        engine.setBatchSize( BuildProps::getTheBuildProps()->getIntValue( "FERRET_BATCH" ) );
+    
+    if( BuildProps::getTheBuildProps()->getBoolValue( "FERRET_MEM_ADMIT" ) )     // MB, no budget: MemAvailable at start
+    {
+        long long defaultMb = 512;
+        if( BuildProps::getTheBuildProps()->hasKey( "FERRET_MEM_DEFAULT" ) )       // for jobs without history
+            defaultMb = BuildProps::getTheBuildProps()->getIntValue( "FERRET_MEM_DEFAULT" );
+        engine.setMemAdmission( BuildProps::getTheBuildProps()->getIntValue( "FERRET_MEM_BUDGET" ), defaultMb);
+    }
+    
+    // concurrency pools, <pool name=".." size=".." types=".."/> in the platform XML, FERRET_POOL_<name>=<size> [types]
+    const vector<PoolSpec> &pools = PlatformSpec::getThePlatformSpec()->getPools();
+    for( size_t i = 0; i < pools.size(); i++)
+        engine.addPool( pools[i].getName(), pools[i].getSize(), pools[i].getTypes());
+    
+    vector<string> poolKeys = BuildProps::getTheBuildProps()->getKeysWithPrefix( "FERRET_POOL_" );
+    for( size_t i = 0; i < poolKeys.size(); i++)
+    {
+        stringstream ss( BuildProps::getTheBuildProps()->getValue( poolKeys[i] ) );
+        int size = 0;
+        string types, t;
+        
+        ss >> size;
+        while( ss >> t )
+            types += (types.length() > 0 ? " " : "") + t;
+        engine.addPool( poolKeys[i].substr( 12 ), size, types);
+    }
     
     filesDb.sendToEngine( engine );
     
     engine.doWork( executor, printTimes, userTargets);
     
+    if( PlatformSpec::getThePlatformSpec()->getCompileMode( filesDb.getCompileMode() ).hasTimeTrace() )
+    {
+        TimeTraceReport ttr;
+        ttr.collect( filesDb );
+        ttr.write( filesDb, "time_trace.txt", 30);
+        phase_end( printTimes, "time trace report");
+    }
+    
+    PerfHistory::getThePerfHistory()->append( dbProjDir );
+    
     store_mbd_set( dbProjDir );
 }
 
@@ -418,6 +525,8 @@ static void grokAndDoBuild( bool initMode, bool initAndBuild, bool doWriteIgnHdr
                             BazelNode *rootNode, const string &build_properies, const string &dbProjDir,
                             FileManager &filesDb, const string &startProjDir, set<string> &userTargets)
 {
+    PhaseScope frontEnd( printTimes, "front end");
+    
     // printXmlStructure( xmlRootNode );
     TraverseStructure<BazelNode> traverse( filesDb, rootNode, true /* bazelMode on */);
     
@@ -428,8 +537,7 @@ static void grokAndDoBuild( bool initMode, bool initAndBuild, bool doWriteIgnHdr
             cerr << "error: error(s) in ferret file db, rerun using --init.\n";
             emergency_exit( 5 );
         }
-        if( printTimes )
-            cout << "reading files db took " << get_diff() << "s\n";
+        phase_end( printTimes, "reading files db");
         
         readBuildProperties( false, filesDb.getPropertiesFile(), startProjDir);
         
@@ -438,8 +546,7 @@ static void grokAndDoBuild( bool initMode, bool initAndBuild, bool doWriteIgnHdr
         BuildProps::getTheBuildProps()->setStaticProp( "compile_mode", compileMode);
         
         traverse.traverseStructureForChildren();
-        if( printTimes )
-            cout << "traversing structure for children " << get_diff() << "s\n";
+        phase_end( printTimes, "traversing structure for children");
         
         if( verbosity > 0 )
             cout << "Compile mode is '" << compileMode << "'\n";
@@ -452,8 +559,7 @@ static void grokAndDoBuild( bool initMode, bool initAndBuild, bool doWriteIgnHdr
         {
             filesDb.seeWhatsNewOrGone();       // deletes gone files/commands
         }
-        if( printTimes )
-            cout << "checking for deleted files took " << get_diff() << "s\n";
+        phase_end( printTimes, "checking for deleted files");
     }
     else // initMode == true
     {
@@ -464,16 +570,14 @@ static void grokAndDoBuild( bool initMode, bool initAndBuild, bool doWriteIgnHdr
         filesDb.setCompileMode( compileMode );
         
         traverse.traverseStructureForChildren();
-        if( printTimes )
-            cout << "traversing structure for children " << get_diff() << "s\n";
+        phase_end( printTimes, "traversing structure for children");
         
         if( verbosity > 0 )
             cout << "Compile mode is '" << compileMode << "'\n";
     }
             
     traverse.traverseStructureForExtensions();
-    if( printTimes )
-        cout << "traversing structure for extensions took " << get_diff() << "s\n";
+    phase_end( printTimes, "traversing structure for extensions");
     
     traverse.traverseStructureForNewFiles();
     traverse.traverseStructureForNewIncdirFiles();
@@ -481,8 +585,7 @@ static void grokAndDoBuild( bool initMode, bool initAndBuild, bool doWriteIgnHdr
     {
         cout << "Found " << traverse.getCntNew() << " new file(s).\n";
     }
-    if( printTimes )
-        cout << "checking for new files took " << get_diff() << "s\n";
+    phase_end( printTimes, "checking for new files");
     
     if( !initMode && verbosity > 1 )
     {
@@ -495,14 +598,17 @@ static void grokAndDoBuild( bool initMode, bool initAndBuild, bool doWriteIgnHdr
     if( incExecutor.isInterruptedBySignal() )
         emergency_exit(3);
     
-    if( printTimes )
-        cout << "updating dependency files took " << get_diff() << "s\n";
+    phase_end( printTimes, "updating dependency files");
 
     if( initMode )
     {
         hash_set_clear( global_mbd_set );
         remove_mbd( dbProjDir );
         ::remove( stackPath( dbProjDir, "ferret_scfs").c_str() );
+        ::remove( stackPath( dbProjDir, "ferret_usage").c_str() );     // file ids are new
+        ContentHashDb::remove( dbProjDir, "ferret_content_hash");
+        ContentHashDb::remove( dbProjDir, "ferret_output_hash");
+        ContentHashDb::remove( dbProjDir, "ferret_input_hash");
     }
     
     if( verbosity > 1 )
@@ -513,8 +619,7 @@ static void grokAndDoBuild( bool initMode, bool initAndBuild, bool doWriteIgnHdr
     
     traverse.traverseStructureForTargets();
 
-    if( printTimes )
-        cout << "traversing structure for targets took " << get_diff() << "s\n";
+    phase_end( printTimes, "traversing structure for targets");
     
     if( verbosity > 1 )
     {
@@ -523,20 +628,20 @@ static void grokAndDoBuild( bool initMode, bool initAndBuild, bool doWriteIgnHdr
     }
 
     IncludeManager::getTheIncludeManager()->resolve( filesDb, initMode, doWriteIgnHdr);
-    if( printTimes )
-        cout << "resolving dependencies took " << get_diff() << "s\n";
+    phase_end( printTimes, "resolving dependencies");
     
     filesDb.removeCycles();
     
-    if( printTimes )
-        cout << "removing cycles took " << get_diff() << "s\n";
+    phase_end( printTimes, "removing cycles");
     
     filesDb.writeDb( startProjDir );
     
-    if( printTimes )
-        cout << "writing files db took " << get_diff() << "s\n";
+    phase_end( printTimes, "writing files db");
+    frontEnd.end();
 
     ScriptManager::getTheScriptManager()->setCompileMode( compileMode );
+    ScriptManager::getTheScriptManager()->setDirectExec( BuildProps::getTheBuildProps()->getBoolValue( "FERRET_DIRECT" ) );
+    ScriptManager::getTheScriptManager()->setPregen( BuildProps::getTheBuildProps()->getBoolValue( "FERRET_PREGEN" ) );
     
     if( !initMode )
     {
@@ -552,8 +657,7 @@ static void grokAndDoBuild( bool initMode, bool initAndBuild, bool doWriteIgnHdr
             OutputCollector::getTheOutputCollector()->setProjectNodesDir( "ferret_html" );
             OutputCollector::getTheOutputCollector()->htmlProjectNodes( rootNode, filesDb);
             
-            if( printTimes )
-                cout << "writing html files took " << get_diff() << "s\n";
+            phase_end( printTimes, "writing html files");
         }
         else if( !writeMakef )
         {
@@ -591,6 +695,7 @@ int main( int argc, char **argv)
     bool initAndBuild = false;
     bool doCurses = false;
     bool bazelMode = false;
+    bool perfReport = false;
 
     string initBaseDir = ".";
     string targetArg, propertiesFileArg, startProjArg;
@@ -625,6 +730,34 @@ int main( int argc, char **argv)
                 quickMode = true;
             else if( arg == "--times" )
                 printTimes = true;
+            else if( arg == "--times-json" )
+            {
+                if( (i+1)<argc )
+                {
+                    i++;
+                    PhaseProfiler::getThePhaseProfiler()->setJsonFile( argv[i] );
+                }
+                else
+                {
+                    cerr << "error: option times-json requires an argument. json file name\n";
+                    arg_err++;
+                }
+            }
+            else if( arg == "--perf-report" )
+                perfReport = true;
+            else if( arg == "--trace" )
+            {
+                if( (i+1)<argc )
+                {
+                    i++;
+                    BuildTrace::getTheBuildTrace()->enable( argv[i] );
+                }
+                else
+                {
+                    cerr << "error: option trace requires an argument. trace file name\n";
+                    arg_err++;
+                }
+            }
             else if( arg == "-p" )
             {
                 if( (i+1)<argc )
@@ -643,6 +776,8 @@ int main( int argc, char **argv)
                 stopOnErr = true;
             else if( arg == "--deep" )
                 downwardDeep = true;
+            else if( arg == "--direct" )
+                directExec = true;
             else if( arg == "-t" )
             {
                 if( (i+1)<argc )
@@ -892,8 +1027,7 @@ int main( int argc, char **argv)
             emergency_exit( 5 );
         }
         
-        if( printTimes )
-            cout << "reading files db took " << get_diff() << "s\n";
+        phase_end( printTimes, "reading files db");
 
         if( clean_depth >= 0 )
             c.setDepth( clean_depth );
@@ -910,14 +1044,19 @@ int main( int argc, char **argv)
         
         c.clean( userTargets );
         
-        if( printTimes )
-            cout << "cleaning took " << get_diff() << "s\n";
+        phase_end( printTimes, "cleaning");
         
         exit(0);
     }
     
     string dbProjDir = stackPath( ferretDbDir, startProjDir);
     
+    if( perfReport )
+    {
+        PerfHistory::report( dbProjDir, 5, 20);
+        exit(0);
+    }
+    
     ProjectXmlTimestamps projXmlTs( dbProjDir );
 
     if( !initMode && !bazelMode )
@@ -997,8 +1136,7 @@ int main( int argc, char **argv)
             projXmlTs.writeTimes();
         }
         
-        if( printTimes )
-            cout << "reading XML took " << get_diff() << "s\n";
+        phase_end( printTimes, "reading XML");
     }
     else
     {
@@ -1019,12 +1157,12 @@ int main( int argc, char **argv)
         //    projXmlTs.writeTimes();
         // }
         
-        if( printTimes )
-            cout << "reading BUILD files took " << get_diff() << "s\n";
+        phase_end( printTimes, "reading BUILD files");
     }
     
     IncludeManager::getTheIncludeManager()->setDbProjDir( dbProjDir );
     IncludeManager::getTheIncludeManager()->readUnsatSet( initMode );
+    IncludeManager::getTheIncludeManager()->readModules( initMode );
     
     if( bazelMode )
     {
@@ -1032,11 +1170,15 @@ int main( int argc, char **argv)
                         rootNode, build_properies, dbProjDir,
                         filesDb, startProjDir, userTargets);
         
+        BuildTrace::getTheBuildTrace()->write();
+        PhaseProfiler::getThePhaseProfiler()->finish( printTimes || verbosity > 0 );
         IncludeManager::getTheIncludeManager()->printFinalWords();
         
         return 0;
     }
     
+    PhaseScope frontEnd( printTimes, "front end");
+    
     // printXmlStructure( xmlRootNode );
     TraverseStructure<ProjectXmlNode> traverse( filesDb, xmlRootNode);
     
@@ -1047,8 +1189,7 @@ int main( int argc, char **argv)
             cerr << "error: error(s) in ferret file db, rerun using --init.\n";
             emergency_exit( 5 );
         }
-        if( printTimes )
-            cout << "reading files db took " << get_diff() << "s\n";
+        phase_end( printTimes, "reading files db");
         
         readBuildProperties( false, filesDb.getPropertiesFile(), startProjDir);
         
@@ -1057,8 +1198,7 @@ int main( int argc, char **argv)
         BuildProps::getTheBuildProps()->setStaticProp( "compile_mode", compileMode);
         
         traverse.traverseStructureForChildren();
-        if( printTimes )
-            cout << "traversing structure for children " << get_diff() << "s\n";
+        phase_end( printTimes, "traversing structure for children");
         
         if( verbosity > 0 )
             cout << "Compile mode is '" << compileMode << "'\n";
@@ -1071,8 +1211,7 @@ int main( int argc, char **argv)
         {
             filesDb.seeWhatsNewOrGone();       // deletes gone files/commands
         }
-        if( printTimes )
-            cout << "checking for deleted files took " << get_diff() << "s\n";
+        phase_end( printTimes, "checking for deleted files");
     }
     else // initMode == true
     {
@@ -1083,16 +1222,14 @@ int main( int argc, char **argv)
         filesDb.setCompileMode( compileMode );
         
         traverse.traverseStructureForChildren();
-        if( printTimes )
-            cout << "traversing structure for children " << get_diff() << "s\n";
+        phase_end( printTimes, "traversing structure for children");
         
         if( verbosity > 0 )
             cout << "Compile mode is '" << compileMode << "'\n";
     }
             
     traverse.traverseStructureForExtensions();
-    if( printTimes )
-        cout << "traversing structure for extensions took " << get_diff() << "s\n";
+    phase_end( printTimes, "traversing structure for extensions");
     
     traverse.traverseStructureForNewFiles();
     traverse.traverseStructureForNewIncdirFiles();
@@ -1100,8 +1237,7 @@ int main( int argc, char **argv)
     {
         cout << "Found " << traverse.getCntNew() << " new file(s).\n";
     }
-    if( printTimes )
-        cout << "checking for new files took " << get_diff() << "s\n";
+    phase_end( printTimes, "checking for new files");
     
     if( !initMode && verbosity > 1 )
     {
@@ -1114,14 +1250,17 @@ int main( int argc, char **argv)
     if( incExecutor.isInterruptedBySignal() )
         emergency_exit(3);
     
-    if( printTimes )
-        cout << "updating dependency files took " << get_diff() << "s\n";
+    phase_end( printTimes, "updating dependency files");
 
     if( initMode )
     {
         hash_set_clear( global_mbd_set );
         remove_mbd( dbProjDir );
         ::remove( stackPath( dbProjDir, "ferret_scfs").c_str() );
+        ::remove( stackPath( dbProjDir, "ferret_usage").c_str() );     // file ids are new
+        ContentHashDb::remove( dbProjDir, "ferret_content_hash");
+        ContentHashDb::remove( dbProjDir, "ferret_output_hash");
+        ContentHashDb::remove( dbProjDir, "ferret_input_hash");
     }
     
     if( verbosity > 1 )
@@ -1132,8 +1271,7 @@ int main( int argc, char **argv)
     
     traverse.traverseStructureForTargets();
 
-    if( printTimes )
-        cout << "traversing structure for targets took " << get_diff() << "s\n";
+    phase_end( printTimes, "traversing structure for targets");
     
     if( verbosity > 1 )
     {
@@ -1142,20 +1280,20 @@ int main( int argc, char **argv)
     }
 
     IncludeManager::getTheIncludeManager()->resolve( filesDb, initMode, doWriteIgnHdr);
-    if( printTimes )
-        cout << "resolving dependencies took " << get_diff() << "s\n";
+    phase_end( printTimes, "resolving dependencies");
     
     filesDb.removeCycles();
     
-    if( printTimes )
-        cout << "removing cycles took " << get_diff() << "s\n";
+    phase_end( printTimes, "removing cycles");
     
     filesDb.writeDb( startProjDir );
     
-    if( printTimes )
-        cout << "writing files db took " << get_diff() << "s\n";
+    phase_end( printTimes, "writing files db");
+    frontEnd.end();
 
     ScriptManager::getTheScriptManager()->setCompileMode( compileMode );
+    ScriptManager::getTheScriptManager()->setDirectExec( BuildProps::getTheBuildProps()->getBoolValue( "FERRET_DIRECT" ) );
+    ScriptManager::getTheScriptManager()->setPregen( BuildProps::getTheBuildProps()->getBoolValue( "FERRET_PREGEN" ) );
     
     if( !initMode )
     {
@@ -1171,8 +1309,7 @@ int main( int argc, char **argv)
             OutputCollector::getTheOutputCollector()->setProjectNodesDir( "ferret_html" );
             OutputCollector::getTheOutputCollector()->htmlProjectNodes( xmlRootNode, filesDb);
             
-            if( printTimes )
-                cout << "writing html files took " << get_diff() << "s\n";
+            phase_end( printTimes, "writing html files");
         }
         else if( !writeMakef )
         {
@@ -1190,6 +1327,8 @@ int main( int argc, char **argv)
     else if( initMode && initAndBuild )
         doBuild( filesDb, userTargets, dbProjDir, printTimes, doCurses);
     
+    BuildTrace::getTheBuildTrace()->write();
+    PhaseProfiler::getThePhaseProfiler()->finish( printTimes || verbosity > 0 );
     IncludeManager::getTheIncludeManager()->printFinalWords();
     
     return 0;
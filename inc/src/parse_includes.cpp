@@ -0,0 +1,429 @@
+// parse a source file to find all direct dependencies
+
+#include <cstdlib>
+#include <cstdio>
+#include <cassert>
+#include <string>
+#include <iostream>
+#include <vector>
+
+#include "parse_includes.h"
+
+using namespace std;
+
+
+/* intentionally not using ctype.h here -- locale sucks */
+#define is_digit(c) ((c)>='0' && (c)<='9')
+#define is_alpha(c) (((c)>='a' && (c)<='z') || ((c)>='A' && (c)<='Z'))
+#define is_special(c) ((c)=='_' || (c)=='-' || (c)==':' || (c)=='/' || (c)=='.')
+#define is_white(c) ((c)==' ' || (c)=='\t')
+
+#define is_path_begin(c) (is_digit(c)||is_alpha(c)||is_special(c))
+#define is_inc_char(c) ((c)>='c' && (c)<='n')
+
+ParseIncludes::ParseIncludes( FILE *in )
+	: in_fp(in), ateof(false),line_num(1),
+	  curr(0),errors(0),
+	  current_token(INVALID)
+{
+	assert(in);
+    
+	consume();
+    
+    after_newline = true;   // first line is like new line
+    preproc_mode = false;   // not in "preprocessor" mode
+}
+
+
+ParseIncludes::~ParseIncludes()
+{
+
+}
+
+
+void ParseIncludes::consume()
+{
+    int c = fgetc( in_fp );
+	if( c>=0 )
+	{
+        input_buf[0] = (char)c;
+        input_buf[1] = '\0';
+        input_length = 1;
+
+        if( input_buf[0] == '\n' )
+            line_num++;
+	}
+	else
+	{
+		ateof=true;
+		curr=input_length = 0;
+	}
+}
+
+
+#define  get_char()  ((curr < input_length)?input_buf[ curr ]:'$')
+
+bool ParseIncludes::HasNextChar()
+{
+	if( curr == input_length )
+		consume();
+	return curr < input_length;
+}
+
+
+void ParseIncludes::SkipWhite()
+{
+	while( HasNextChar() && is_white(get_char()) )
+		consume();
+}
+
+
+void ParseIncludes::scanIncludeKw()
+{
+    if( get_char() == 'i' )
+    {
+        int i;
+        const char *inckw = "include";
+        int len = 7;  // = strlen( inckw );
+        
+        for( i = 0; i<len; i++)
+            if( HasNextChar() && inckw[i] == get_char() )
+                consume();
+            else
+                break;
+        if( i==len )
+            current_token = KW_INCLUDE;
+    }
+}
+
+
+void ParseIncludes::scanFileName()
+{
+	char buf[1024];
+    int i=0;
+
+    while( HasNextChar() && get_char() != '>' && get_char() != '"' && get_char() != '\n' )
+    {
+        if( get_char() == '\\' )
+        {
+            consume();
+            if( i<1022 )
+            {
+                buf[i++] = '\\';              // gcc uses backspaces to escape a space
+                buf[i++] = get_char();
+            }
+            consume();
+        }
+        else
+        {
+            if( i<1023 )
+                buf[i++] = get_char();
+            consume();
+        }
+    }
+    buf[i]=0;
+    current_value = buf;
+    current_token = FILE_NAME;
+}
+
+
+void ParseIncludes::ParseNext()
+{
+    current_value = "";
+    SkipWhite();
+    
+    if( ateof )
+    {
+        current_token = INVALID;
+        return;
+    }
+    else if( get_char() == '#' )
+    {
+        current_token = HASH;
+        consume();     /* consume '#' */
+    }
+    else if( get_char() == '<' )
+    {
+        current_token = LESS_THAN;
+        consume();     /* consume '<' */
+    }
+    else if( get_char() == '>' )
+    {
+        current_token = GREATER_THAN;
+        consume();     /* consume '>' */
+    }
+    else if( preproc_mode && get_char() == '"' )    // opening quote while in line starting with a '#'?
+    {
+        current_token = QUOTE;
+        consume();
+    }
+    else if( !preproc_mode && get_char() == '"' )    // opening quote?
+    {
+        current_token = STRING;
+        consume();     /* consume " */
+        
+        // read the entire string to prevent us from are getting confused by its contents
+        while( HasNextChar() && get_char() != '"' )
+        {
+            if( get_char() == '\\' )
+                consume();
+            consume();
+        }
+        
+        consume(); // consume closing quote
+    }  
+    else if( !preproc_mode && (is_alpha(get_char()) || get_char() == '_') )   // whole identifiers, for the module keywords
+    {
+        current_token = IDENT;
+        while( HasNextChar() && (is_alpha(get_char()) || is_digit(get_char()) || get_char() == '_') )
+        {
+            current_value += get_char();
+            consume();
+        }
+    }
+    else if( get_char() == '\n' )
+    {
+        current_token = NEWLINE;
+        consume();
+    }
+    else if( get_char() == '/' )
+    {
+        consume();
+        if( get_char() == '*' )           // c style comment
+        {
+            consume();
+            current_token = COMMENT;
+            bool done=false;
+
+            do
+            {
+                while( HasNextChar() && get_char() != '*' )
+                    consume();
+                if( get_char() == '*' )
+                {
+                    consume();
+                    if( get_char() == '/' )
+                    {
+                        consume();
+                        done = true;
+                    }
+                }
+            }
+            while( !done );
+        }
+        else if( get_char() == '/' )     // c++ style comment
+        {
+            current_token = COMMENT_CPP;
+            consume();
+            while( HasNextChar() && get_char() != '\n' )
+                consume();
+            
+            if( get_char() == '\n' )   // return belongs to comment
+                consume();
+        }
+    }
+    else
+        consume();
+}
+
+
+ParseIncludes::TokenType ParseIncludes::ReadNext()
+{
+	ParseNext();
+
+	return current_token;
+}
+
+
+void ParseIncludes::parseIncludes()
+{
+    if( after_newline && current_token == HASH )
+    {
+        after_newline = false;
+        SkipWhite();
+        scanIncludeKw();
+        preproc_mode = true;
+        
+        if( current_token == KW_INCLUDE )
+        {
+            ParseNext();
+            
+            if( current_token == QUOTE )
+            {
+                scanFileName();
+                includes.push_back( current_value );
+                ParseNext();
+                
+                if( current_token != QUOTE )
+                {
+                    cerr << "line " << line_num << " error: include directive malformed (expected closing \")\n";
+                    errors++;
+                }
+            }
+            else if( current_token == LESS_THAN )
+            {
+                scanFileName();
+                includes.push_back( current_value );
+                ParseNext();
+                
+                if( current_token != GREATER_THAN )
+                {
+                    cerr << "line " << line_num << " error: include directive malformed (expected closing >)\n";
+                    errors++;
+                }
+            }
+            else
+            {
+                cerr << "line " << line_num << " error: include directive malformed (or you are using a macro - bad idea).\n";
+                errors++;
+            }
+        }
+        preproc_mode = false;
+    }
+    else if( after_newline && current_token == IDENT &&
+             (current_value == "export" || current_value == "module" || current_value == "import") )
+    {
+        after_newline = false;
+        parseModuleDecl();
+    }
+    else if( current_token == NEWLINE || current_token == COMMENT_CPP )
+    {
+        ParseNext();
+        after_newline = true;
+        preproc_mode = false;
+    }
+    else
+    {
+        if( current_token == IDENT )
+            after_newline = false;
+        ParseNext();  // stuff we are not interested in
+    }
+}
+
+
+// module-name: identifier { '.' identifier }. empty if the input is not one
+string ParseIncludes::scanModuleName()
+{
+    string name;
+    
+    for(;;)
+    {
+        SkipWhite();
+        if( !HasNextChar() || !(is_alpha(get_char()) || get_char() == '_') )
+            return "";
+        
+        while( HasNextChar() && (is_alpha(get_char()) || is_digit(get_char()) || get_char() == '_') )
+        {
+            name += get_char();
+            consume();
+        }
+        
+        SkipWhite();
+        if( !HasNextChar() || get_char() != '.' )
+            return name;
+        name += '.';
+        consume();
+    }
+}
+
+
+// export module m;  module m;  module m:p;  [export] import m;  [export] import :p;  import "h.h";
+// an interface unit or a partition provides its module, an implementation unit imports its interface.
+// "module;" and "module :private;" declare nothing. anything else, like "module = 1;" or "import( x );", is no
+// module declaration and ignored
+void ParseIncludes::parseModuleDecl()
+{
+    bool exported = false;
+    
+    if( current_value == "export" )
+    {
+        ParseNext();
+        if( current_token != IDENT || (current_value != "module" && current_value != "import") )
+            return;                    // some other exported declaration
+        exported = true;
+    }
+    
+    bool isImport = current_value == "import";
+    SkipWhite();
+    
+    if( isImport && (get_char() == '"' || get_char() == '<') )    // header unit, a dependency as an include
+    {
+        char closing = get_char() == '"' ? '"' : '>';
+        consume();
+        scanFileName();
+        if( get_char() == closing )
+        {
+            consume();
+            SkipWhite();
+            if( get_char() == ';' )
+                includes.push_back( current_value );
+        }
+        ParseNext();
+        return;
+    }
+    
+    string name;
+    
+    if( get_char() != ':' && get_char() != ';' )
+    {
+        name = scanModuleName();
+        if( name.length() == 0 )
+        {
+            ParseNext();
+            return;
+        }
+    }
+    if( get_char() == ':' )           // partition, ':' becomes '-'
+    {
+        consume();
+        string part = scanModuleName();
+        if( part.length() == 0 )
+        {
+            ParseNext();
+            return;
+        }
+        name += "-" + part;
+    }
+    SkipWhite();
+    
+    if( name.length() > 0 && get_char() == ';' )
+    {
+        if( name[0] == '-' && isImport && moduleName.length() > 0 )
+            name = moduleName + name;
+        
+        if( name[0] != '-' )
+        {
+            size_t part = name.find( '-' );
+            
+            if( isImport )
+                imports.push_back( name );
+            else
+            {
+                moduleName = name.substr( 0, part);
+                if( exported || part != string::npos )
+                    provides.push_back( name );
+                else
+                    imports.push_back( name );
+            }
+        }
+    }
+    
+    ParseNext();
+}
+
+
+bool ParseIncludes::parse()
+{
+    ParseNext();
+    do {
+        parseIncludes();
+    } while( !AtEnd() && !hasError() );
+	
+	return hasError();
+}
+
+
+bool ParseIncludes::hasError() const
+{
+    return current_token == ERROR || errors > 0;
+}
@@ -0,0 +1,79 @@
+// parse a source file to find all direct dependencies: includes and C++20 module declarations
+
+#ifndef FERRET_PARSE_INCLUDES_H_
+#define FERRET_PARSE_INCLUDES_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+
+class ParseIncludes
+{
+public:	
+	enum TokenType {
+		INVALID = 0, ERROR,
+        HASH, QUOTE, LESS_THAN, GREATER_THAN,
+        KW_INCLUDE, FILE_NAME,
+        NEWLINE,
+        STRING,
+        COMMENT,
+        COMMENT_CPP,
+        IDENT
+	};
+	
+	ParseIncludes( FILE *in );
+	~ParseIncludes();
+
+private:
+    void scanFileName();
+
+	ParseIncludes::TokenType ReadNext();
+
+	int LineNumber() const
+	{ return line_num; }
+    
+	bool AtEnd() const
+	{ return ateof; }
+    
+    void scanIncludeKw();
+    std::string scanModuleName();
+    
+    void parseIncludes();
+    void parseModuleDecl();
+
+public:
+    bool parse();
+    bool hasError() const;
+    
+    const std::vector<std::string> &getIncludes() const
+    { return includes; }
+    const std::vector<std::string> &getProvides() const
+    { return provides; }
+    const std::vector<std::string> &getImports() const
+    { return imports; }
+    
+private:
+	void  consume();
+	bool  HasNextChar();
+	void  SkipWhite();
+	void  ParseNext();
+	
+	FILE *in_fp;
+	bool ateof;
+	int line_num;
+	char input_buf[2];
+	int input_length;
+	int curr;
+	int errors;
+    bool after_newline, preproc_mode;
+
+    TokenType current_token;
+    std::string current_value;
+    
+    std::vector<std::string> includes;              // in the order of the directives
+    std::string moduleName;                         // of the module unit, for imports of its partitions
+    std::vector<std::string> provides, imports;     // C++20 modules, partitions as in the CMI file names: module-partition
+};
+
+#endif
@@ -0,0 +1,336 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <climits>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+#include "action_cache.h"
+#include "sha256.h"
+#include "content_hash_db.h"
+#include "glob_utility.h"
+
+using namespace std;
+
+
+void ActionCache::setup( const string &d, long long maxMb, bool link)
+{
+    dir = d;
+    maxBytes = maxMb * 1024 * 1024;
+    allowLink = link;
+    
+    mkdir_p( dir + "/ac" );
+    mkdir_p( dir + "/tmp" );
+    enabled = access( (dir + "/ac").c_str(), W_OK) == 0 && access( (dir + "/tmp").c_str(), W_OK) == 0;
+    if( !enabled )
+        cerr << "warning: could not create action cache in " << dir << ", cache is off.\n";
+    else if( verbosity > 0 )
+        cout << "Action cache in " << dir << ", " << maxMb << " MB" << (allowLink ? ", hard links" : "") << "\n";
+}
+
+
+string ActionCache::makeKey( const string &text )
+{
+    return Sha256::hex( text );         // same key space as the remote cache
+}
+
+
+// what a cache key needs to know about the program a command runs, so outputs of another compiler are not taken.
+// resolved once per program and run
+string ActionCache::toolIdentity( const string &program )
+{
+    static map<string,string> known;
+    
+    map<string,string>::const_iterator it = known.find( program );
+    if( it != known.end() )
+        return it->second;
+    
+    string path = program;
+    if( program.find( '/' ) == string::npos && getenv( "PATH" ) )
+    {
+        vector<string> dirs = split( ':', getenv( "PATH" ));
+        for( size_t i = 0; i < dirs.size(); i++)
+        {
+            string p = (dirs[i] == "" ? string( "." ) : dirs[i]) + "/" + program;
+            if( access( p.c_str(), X_OK) == 0 )
+            {
+                path = p;
+                break;
+            }
+        }
+    }
+    
+    char resolved[ PATH_MAX ];
+    if( realpath( path.c_str(), resolved) )
+        path = resolved;
+    
+    string digest, version;
+    if( !Sha256::hexFile( path, digest) )
+        digest = "?";
+    
+    FILE *fp = popen( ("'" + path + "' --version 2>/dev/null").c_str(), "r");     // the driver can stay the same
+    if( fp )
+    {
+        char line[ 256 ];
+        if( fgets( line, sizeof(line), fp) )
+            version = line;
+        pclose( fp );
+    }
+    if( version.length() > 0 && version[ version.length() - 1 ] == '\n' )
+        version.erase( version.length() - 1 );
+    
+    string id = path + " " + digest + " " + version;
+    known[ program ] = id;
+    if( verbosity > 1 )
+        cout << "Tool " << program << ": " << id << "\n";
+    return id;
+}
+
+
+string ActionCache::entryDir( const string &key ) const
+{
+    return dir + "/ac/" + key.substr( 0, 2) + "/" + key;
+}
+
+
+static bool read_file( const string &fn, string &content)
+{
+    FILE *fp = fopen( fn.c_str(), "r");
+    if( !fp )
+        return false;
+    
+    char buf[ 4096 ];
+    size_t n;
+    content.clear();
+    while( (n = fread( buf, 1, sizeof(buf), fp)) > 0 )
+        content.append( buf, n);
+    
+    fclose( fp );
+    return true;
+}
+
+
+static bool write_file( const string &fn, const string &content)
+{
+    FILE *fp = fopen( fn.c_str(), "w");
+    if( !fp )
+        return false;
+    
+    bool ok = fwrite( content.data(), 1, content.length(), fp) == content.length();
+    return fclose( fp ) == 0 && ok;
+}
+
+
+// reflink if the file system can, hard link if allowed, copy otherwise. the result is as new as a freshly built file
+bool ActionCache::materialize( const string &from, const string &to, bool link)
+{
+    struct stat st;
+    if( stat( from.c_str(), &st) != 0 )
+        return false;
+    
+    ::unlink( to.c_str() );
+    
+    if( link && ::link( from.c_str(), to.c_str()) == 0 )
+        return utimensat( AT_FDCWD, to.c_str(), 0, 0) == 0;
+    
+    int in = open( from.c_str(), O_RDONLY);
+    if( in < 0 )
+        return false;
+    
+    int out = open( to.c_str(), O_WRONLY | O_CREAT | O_TRUNC, st.st_mode & 0777);
+    if( out < 0 )
+    {
+        close( in );
+        return false;
+    }
+    
+    bool ok = false;
+#ifdef FICLONE
+    ok = ioctl( out, FICLONE, in) == 0;
+#endif
+    if( !ok )
+    {
+        static char buf[ 65536 ];
+        ssize_t n;
+        
+        ok = true;
+        while( ok && (n = read( in, buf, sizeof(buf))) > 0 )
+            ok = write( out, buf, n) == n;
+        if( n < 0 )
+            ok = false;
+    }
+    
+    close( in );
+    if( close( out ) != 0 )
+        ok = false;
+    
+    if( !ok )
+        ::unlink( to.c_str() );
+    return ok;
+}
+
+
+void ActionCache::breakLink( const string &fn )
+{
+    struct stat st;
+    if( stat( fn.c_str(), &st) != 0 || st.st_nlink < 2 )
+        return;
+    
+    string tmp = fn + ".ferret_unlink";
+    if( !materialize( fn, tmp, false) || rename( tmp.c_str(), fn.c_str()) != 0 )
+        ::unlink( fn.c_str() );
+}
+
+
+bool ActionCache::lookup( const string &key, const string &out_fn, string &log, unsigned long long &out_hash)
+{
+    string ed = entryDir( key );
+    string h;
+    
+    if( !read_file( ed + "/hash", h) || sscanf( h.c_str(), "%llx", &out_hash) != 1 ||
+        !materialize( ed + "/out", out_fn, allowLink) )
+    {
+        misses++;
+        return false;
+    }
+    
+    read_file( ed + "/log", log);
+    utimensat( AT_FDCWD, ed.c_str(), 0, 0);     // mtime of the entry is its last use
+    
+    hits++;
+    return true;
+}
+
+
+static void remove_entry( const string &ed )
+{
+    ::unlink( (ed + "/out").c_str() );
+    ::unlink( (ed + "/log").c_str() );
+    ::unlink( (ed + "/hash").c_str() );
+    rmdir( ed.c_str() );
+}
+
+
+bool ActionCache::store( const string &key, const string &out_fn, const string &log)
+{
+    unsigned long long h;
+    if( !ContentHashDb::hashFile( out_fn, h) )
+        return false;
+    
+    char buf[ 64 ];
+    snprintf( buf, sizeof(buf), "/tmp/%d.%d", (int)getpid(), stores);
+    string tmp = dir + buf;
+    string ed = entryDir( key );
+    
+    mkdir( tmp.c_str(), 0777);
+    snprintf( buf, sizeof(buf), "%016llx\n", h);
+    
+    mkdir( (dir + "/ac/" + key.substr( 0, 2)).c_str(), 0777);
+    
+    bool ok = materialize( out_fn, tmp + "/out", allowLink) && write_file( tmp + "/log", log) &&
+        write_file( tmp + "/hash", buf) && rename( tmp.c_str(), ed.c_str()) == 0;   // fails if another ferret stored it first
+    
+    if( !ok )
+    {
+        remove_entry( tmp );
+        return false;
+    }
+    
+    stores++;
+    return true;
+}
+
+
+struct CacheEntry {
+    string dir;
+    long long bytes;
+    time_t used;
+    
+    bool operator<( const CacheEntry &o ) const
+    { return used < o.used; }
+};
+
+
+void ActionCache::trim()
+{
+    if( !enabled || stores == 0 )
+        return;
+    
+    vector<CacheEntry> entries;
+    long long total = 0;
+    
+    string acDir = dir + "/ac";
+    DIR *d1 = opendir( acDir.c_str() );
+    if( !d1 )
+        return;
+    
+    struct dirent *e1;
+    while( (e1 = readdir( d1 )) != 0 )
+    {
+        if( e1->d_name[0] == '.' )
+            continue;
+        
+        string sub = acDir + "/" + e1->d_name;
+        DIR *d2 = opendir( sub.c_str() );
+        if( !d2 )
+            continue;
+        
+        struct dirent *e2;
+        while( (e2 = readdir( d2 )) != 0 )
+        {
+            if( e2->d_name[0] == '.' )
+                continue;
+            
+            CacheEntry ce;
+            struct stat st;
+            ce.dir = sub + "/" + e2->d_name;
+            if( stat( ce.dir.c_str(), &st) != 0 )
+                continue;
+            ce.used = st.st_mtime;
+            ce.bytes = 0;
+            
+            const char *parts[] = { "/out", "/log", "/hash", 0 };
+            for( int i = 0; parts[i]; i++)
+                if( stat( (ce.dir + parts[i]).c_str(), &st) == 0 )
+                    ce.bytes += st.st_size;
+            
+            total += ce.bytes;
+            entries.push_back( ce );
+        }
+        closedir( d2 );
+    }
+    closedir( d1 );
+    
+    if( total <= maxBytes )
+        return;
+    
+    sort( entries.begin(), entries.end());
+    
+    long long goal = maxBytes / 10 * 9;       // some room, so we do not evict after every build
+    size_t removed = 0;
+    for( size_t i = 0; i < entries.size() && total > goal; i++)
+    {
+        remove_entry( entries[i].dir );
+        total -= entries[i].bytes;
+        removed++;
+    }
+    
+    if( verbosity > 0 )
+        cout << "Action cache: evicted " << removed << " of " << entries.size() << " entries, " << total / (1024 * 1024) << " MB left\n";
+}
+
+
+void ActionCache::printStats() const
+{
+    if( enabled && (hits > 0 || stores > 0 || verbosity > 0) )
+        cout << "Action cache: " << hits << " hit(s), " << misses << " miss(es), " << stores << " stored.\n";
+}
@@ -0,0 +1,47 @@
+#ifndef FERRET_ACTION_CACHE_H_
+#define FERRET_ACTION_CACHE_H_
+
+#include <string>
+#include <map>
+
+// local content addressed cache of job outputs, FERRET_CACHE_DIR in the build properties.
+// an entry is <dir>/ac/<first 2 key chars>/<key>/ holding out (the output), log (job output) and hash
+// (content hash of out). the key is built by the engine from the command and the contents of its inputs
+class ActionCache {
+
+public:
+    ActionCache()
+        : enabled(false), allowLink(false), maxBytes(0), hits(0), misses(0), stores(0)
+    {}
+    
+    void setup( const std::string &dir, long long maxMb, bool allowLink);
+    
+    bool isEnabled() const
+    { return enabled; }
+    
+    bool allowsLink() const
+    { return allowLink; }
+    
+    // on a hit the output is materialized as out_fn
+    bool lookup( const std::string &key, const std::string &out_fn, std::string &log, unsigned long long &out_hash);
+    bool store( const std::string &key, const std::string &out_fn, const std::string &log);
+    
+    void trim();                // LRU eviction down to the size limit, after builds that stored something
+    void printStats() const;
+    
+    static std::string makeKey( const std::string &text );      // SHA-256, hex
+    static std::string toolIdentity( const std::string &program );    // resolved path, binary digest and version
+    static bool materialize( const std::string &from, const std::string &to, bool link);
+    static void breakLink( const std::string &fn );             // outputs must not be modified in place when linked
+
+private:
+    std::string entryDir( const std::string &key ) const;
+
+private:
+    bool enabled, allowLink;
+    std::string dir;
+    long long maxBytes;
+    int hits, misses, stores;
+};
+
+#endif
@@ -20,7 +20,7 @@ map<string, BaseNode *> BaseNode::nameToNodeMap;
 BaseNode::BaseNode( const string &d, const string &module)
     : dir(d), module(module),
       madeObjDir(false), madeBinDir(false), madeLibDir(false),
-      target_file_id(-1)
+      target_file_id(-1), pchId(-1), pchHdrId(-1)
 {
     srcdir = dir;
     collectFiles();
@@ -33,7 +33,7 @@ BaseNode::BaseNode( const string &d, const string &module, const string &name,
                     const vector<string> &usetools, const vector<string> &localLibs)
     : dir(d), target(target), type(type), cppflags(cppflags), cflags(cflags), localLibs(localLibs),
       module(module), name(name), madeObjDir(false), madeBinDir(false), madeLibDir(false), usetools(usetools),
-      target_file_id(-1)
+      target_file_id(-1), pchId(-1), pchHdrId(-1)
 {
     srcdir = stackPath( dir, "src");
     collectFiles();
@@ -128,6 +128,23 @@ int BaseNode::manageDeletedFiles( FileManager &fileMan )
                 
                 IncludeManager::getTheIncludeManager()->removeFile( fileMan, id, fn, this, prereqs);
                 cnt++;
+                
+                // the compile of a source goes too. drop what else it depends on, a precompiled header or
+                // modules, so it becomes an unlinked result
+                string dummy, bn, ext;
+                breakPath( fn, dummy, bn, ext);
+                if( ext == ".cpp" || ext == ".C" || ext == ".cc" || ext == ".c" )
+                {
+                    hash_set_t *none = new_hash_set( 3 );
+                    set<file_id_t>::const_iterator it;
+                    for( it = prereqs.begin(); it != prereqs.end(); it++)
+                    {
+                        string cmd = fileMan.getCmdForId( *it );
+                        if( cmd == "Cpp" || cmd == "C" )
+                            fileMan.compareAndReplaceDependencies( *it, none);
+                    }
+                    delete_hash_set( none );
+                }
             }
         }
     }
@@ -180,6 +197,11 @@ void BaseNode::createCommandArguments( const string &compileMode )
     cflagss   << " " << cm.getCFlagArgs();
     lflagss   << " " << cm.getLinkerFlagArgs();
     eflagss   << " " << cm.getLinkExecutableFlagArgs();
+    if( cm.hasTimeTrace() )
+    {
+        cppflagss << " -ftime-trace";
+        cflagss   << " -ftime-trace";
+    }
 
     if( ps->hasCompileTrait( type ) )
     {
@@ -297,6 +319,7 @@ void BaseNode::createCommands( FileManager &fileMan )
     if( type == "library" || type == "executable" || type == "staticlib" || type == "static" )
     {
         size_t i;
+        map<file_id_t,string> moduleUnits;   // C++ compiles of this node declaring or importing modules
         
         if( verbosity > 1 )
             cout << "Cmds for node " << getDir() << ". Creating commands for target " << target << "\n";
@@ -350,6 +373,9 @@ void BaseNode::createCommands( FileManager &fileMan )
                 
                 pegCppScript( fid, srcfn, o);
                 objs.push_back( o );
+                
+                if( IncludeManager::getTheIncludeManager()->getModuleUnit( srcfn ) )
+                    moduleUnits[ fid ] = srcfn;
             }
             else if( ext == ".c" )
             {
@@ -390,20 +416,160 @@ void BaseNode::createCommands( FileManager &fileMan )
                 continue;
                 }*/
             fileMan.addDependency( target_file_id, obj_id);
+            
+            if( pchId != -1 && fileMan.getCmdForId( obj_id ) == "Cpp" )    // includes the compiles extensions made
+            {
+                fileMan.addDependency( obj_id, pchId);
+                fileMan.addDependency( obj_id, pchHdrId);
+                sm->addReplacement( obj_id, "F_PCH", pchArg);
+            }
         }
+        if( moduleUnits.size() > 0 )
+            createModuleCommands( fileMan, moduleUnits);
+        
         sm->addReplacement( target_file_id, "F_IN", join( " ", objs, false));   // linker input files
         
         for( i = 0; i < libs.size(); i++)
         {
             string dir = libsMap[ libs[i] ];
-                
-            file_id_t tid = fileMan.addCommand( stackPath( dir, ps->getSoFileName( libs[i] )), "L", this);
+            file_id_t tid;
+            
+            if( staticLibs.count( libs[i] ) )
+                tid = fileMan.addCommand( stackPath( dir, ps->getStaticlibFileName( libs[i] )), "A", this);
+            else
+                tid = fileMan.addCommand( stackPath( dir, ps->getSoFileName( libs[i] )), "L", this);
             fileMan.addDependency( target_file_id, tid);
         }
     }
 }
 
 
+// the compile of the unit exporting a module writes its CMI, so the CMI is a wait node of that compile, like the
+// header bison writes. importers depend on the compile and the CMI. the mapper file tells gcc where all CMIs
+// the node's units need are, also the ones imported indirectly
+void BaseNode::createModuleCommands( FileManager &fileMan, const map<file_id_t,string> &units)
+{
+    IncludeManager *im = IncludeManager::getTheIncludeManager();
+    ScriptManager *sm = ScriptManager::getTheScriptManager();
+    map<string,string> cmis;           // module -> CMI file
+    vector<string> todo;
+    
+    map<file_id_t,string>::const_iterator it;
+    for( it = units.begin(); it != units.end(); it++)
+    {
+        const ModuleUnit *mu = im->getModuleUnit( it->second );
+        size_t i;
+        
+        for( i = 0; i < mu->provides.size(); i++)
+        {
+            string cmi = getObjDir() + mu->provides[i] + ".gcm";
+            file_id_t cmi_id = fileMan.addCommand( cmi, "W", this);
+            fileMan.addWeakDependency( it->first, cmi_id);
+            cmis[ mu->provides[i] ] = cmi;
+        }
+        
+        for( i = 0; i < mu->imports.size(); i++)
+        {
+            string provider = im->getModuleProvider( mu->imports[i] );
+            if( provider == "" )
+            {
+                cerr << "warning: module '" << mu->imports[i] << "' imported by " << it->second << " is not exported by any source.\n";
+                continue;
+            }
+            if( provider == it->second )
+                continue;
+            
+            file_id_t prov_obj_id, cmi_id;
+            string cmi = moduleProviderCommands( fileMan, provider, mu->imports[i], prov_obj_id, cmi_id);
+            fileMan.addDependency( it->first, prov_obj_id);
+            fileMan.addDependency( it->first, cmi_id);
+            todo.push_back( mu->imports[i] );
+        }
+    }
+    
+    while( todo.size() > 0 )
+    {
+        string m = todo.back();
+        todo.pop_back();
+        if( cmis.find( m ) != cmis.end() )
+            continue;
+        
+        string provider = im->getModuleProvider( m );
+        file_id_t prov_obj_id, cmi_id;
+        cmis[ m ] = moduleProviderCommands( fileMan, provider, m, prov_obj_id, cmi_id);
+        
+        const ModuleUnit *pmu = im->getModuleUnit( provider );
+        for( size_t i = 0; i < pmu->imports.size(); i++)
+            if( im->getModuleProvider( pmu->imports[i] ) != "" )
+                todo.push_back( pmu->imports[i] );
+    }
+    
+    string content;
+    map<string,string>::const_iterator cit;
+    for( cit = cmis.begin(); cit != cmis.end(); cit++)
+    {
+        string name = cit->first;
+        size_t pos = name.find( '-' );
+        if( pos != string::npos )
+            name[ pos ] = ':';
+        content += name + " " + cit->second + "\n";
+    }
+    
+    string mapfn = getObjDir() + "ferret_modules.map";
+    string old;
+    FILE *fp = fopen( mapfn.c_str(), "r");
+    if( fp )
+    {
+        char buf[ 4096 ];
+        size_t n;
+        while( (n = fread( buf, 1, sizeof(buf), fp)) > 0 )
+            old.append( buf, n);
+        fclose( fp );
+    }
+    
+    if( old != content )
+    {
+        FindFiles::remove( mapfn );
+        fp = fopen( mapfn.c_str(), "w");
+        if( fp )
+        {
+            fputs( content.c_str(), fp);
+            fclose( fp );
+        }
+        else
+            cerr << "error: could not write module mapper file '" << mapfn << "'\n";
+    }
+    FindFiles::exists( mapfn );
+    
+    file_id_t map_id = fileMan.addFile( mapfn, this);
+    for( it = units.begin(); it != units.end(); it++)
+    {
+        fileMan.addDependency( it->first, map_id);
+        sm->addReplacement( it->first, "F_MODULES", "-fmodules-ts -fmodule-mapper=" + mapfn);
+    }
+}
+
+
+// the compile of the source exporting module and its CMI, made for the node of the source
+string BaseNode::moduleProviderCommands( FileManager &fileMan, const string &provider, const string &module,
+                                         file_id_t &obj_id, file_id_t &cmi_id)
+{
+    BaseNode *pnode = fileMan.getBaseNodeFor( fileMan.getIdForFile( provider ) );
+    assert( pnode );
+    
+    string dummy, bn, ext, bext;
+    breakPath( provider, dummy, bn);
+    breakFileName( bn, bext, ext);
+    
+    obj_id = fileMan.addCommand( pnode->getObjDir() + bext + ".o", "Cpp", pnode);
+    string cmi = pnode->getObjDir() + module + ".gcm";
+    cmi_id = fileMan.addCommand( cmi, "W", pnode);
+    fileMan.addWeakDependency( obj_id, cmi_id);
+    
+    return cmi;
+}
+
+
 void BaseNode::pegCppScript( file_id_t cpp_id, const string &in, const string &out)
 {
     PlatformSpec *ps = PlatformSpec::getThePlatformSpec();
@@ -424,11 +590,46 @@ void BaseNode::pegCppScript( file_id_t cpp_id, const string &in, const string &o
     repl[ "F_OUT" ] = out;
     repl[ "F_TARGET" ] = scriptTarget;
     repl[ "F_SRCDIR" ] = getSrcDir();
+    repl[ "F_PCH" ] = "";
+    repl[ "F_MODULES" ] = "";
     
     sm->addReplacements( cpp_id, repl);
 }
 
 
+// the precompiled header is made with the flags of the node's C++ compiles, the compiler only uses it if they match
+void BaseNode::pegPchScript( file_id_t pch_id, const string &in, const string &out)
+{
+    PlatformSpec *ps = PlatformSpec::getThePlatformSpec();
+    ScriptManager *sm = ScriptManager::getTheScriptManager();
+    map<string,string> repl;
+    
+    sm->setTemplateFileName( pch_id, "ferret_pch.sh.templ", "ferret_pch__#.sh");
+    
+    repl[ "F_COMPILER" ] = ps->getCppCompiler();
+    stringstream con;
+    con << pch_id;
+    repl[ "F_ID" ] = con.str();
+    repl[ "F_CPPFLAGS" ] = cppflagsArg;
+    repl[ "F_PLTF_INCDIRS" ] = pltfIncArg;
+    repl[ "F_INCLUDES" ] = includesArg;
+    repl[ "F_TOOL_INCDIRS" ] = toolIncArg;
+    repl[ "F_IN" ] = in;
+    repl[ "F_OUT" ] = out;
+    repl[ "F_TARGET" ] = scriptTarget;
+    
+    sm->addReplacements( pch_id, repl);
+}
+
+
+void BaseNode::setPch( file_id_t pch_id, file_id_t hdr_id, const string &hdr)
+{
+    pchId = pch_id;
+    pchHdrId = hdr_id;
+    pchArg = "-include " + hdr;
+}
+
+
 void BaseNode::pegCScript( file_id_t c_id, const string &in, const string &out)
 {
     PlatformSpec *ps = PlatformSpec::getThePlatformSpec();
@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
 
 #include "parse_dep.h"
 #include "find_files.h"
@@ -40,6 +41,7 @@ public:
     std::vector<std::string> objs;             // .o files for linker
     std::vector<std::string> libs;             // libraries for linker
     std::map<std::string,std::string> libsMap; // store directories of libs
+    std::set<std::string> staticLibs;          // libs built as archive, not as shared object
     std::vector<std::string> searchLibDirs;    // libraries search paths
     
 public:
@@ -111,6 +113,11 @@ public:
     void createCommands( FileManager &fileMan );
     void pegCppScript( file_id_t cpp_id, const std::string &in, const std::string &out);
     void pegCScript( file_id_t cpp_id, const std::string &in, const std::string &out);
+    void pegPchScript( file_id_t pch_id, const std::string &in, const std::string &out);
+    void setPch( file_id_t pch_id, file_id_t hdr_id, const std::string &hdr);   // force included into every C++ compile
+    void createModuleCommands( FileManager &fileMan, const std::map<file_id_t,std::string> &units);
+    std::string moduleProviderCommands( FileManager &fileMan, const std::string &provider, const std::string &module,
+                                        file_id_t &obj_id, file_id_t &cmi_id);
     bool doDeep();   // wether to follow library from this node, via downward pointers, to all downward nodes or not
     
     std::string getNodeName() const
@@ -174,6 +181,9 @@ protected:
     
     file_id_t   target_file_id;
     std::string scriptTarget;   // the "human readable" form of the target, to be displayed in the echo in the scripts
+    
+    file_id_t   pchId, pchHdrId;    // precompiled header and the header it is made of, -1 without
+    std::string pchArg;
 };
 
 
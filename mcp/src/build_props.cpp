@@ -109,6 +109,18 @@ bool BuildProps::hasKey( const string &key ) const
 }
 
 
+vector<string> BuildProps::getKeysWithPrefix( const string &prefix ) const
+{
+    vector<string> keys;
+    map<string,string>::const_iterator it = keyValMap.lower_bound( prefix );
+    
+    for( ; it != keyValMap.end() && it->first.compare( 0, prefix.length(), prefix) == 0; ++it)
+        keys.push_back( it->first );
+    
+    return keys;
+}
+
+
 string BuildProps::getValue( const string &key ) const
 {
     map<string,string>::const_iterator it = keyValMap.find( key );
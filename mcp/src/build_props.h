@@ -3,6 +3,7 @@
 
 #include <string>
 #include <map>
+#include <vector>
 
 class BaseNode;
 
@@ -46,6 +47,7 @@ public:
     std::string getValue( const std::string &key ) const;  // not for OBJDIR, BINDIR, LIBDIR
     int getIntValue( const std::string &key ) const;
     bool getBoolValue( const std::string &key ) const;
+    std::vector<std::string> getKeysWithPrefix( const std::string &prefix ) const;
     void setValue( const std::string &key, const std::string &value);  // not for OBJDIR, BINDIR, LIBDIR
     void setIntValue( const std::string &key, int value);
     void setBoolValue( const std::string &key, bool value);
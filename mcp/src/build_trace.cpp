@@ -0,0 +1,161 @@
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+
+#include "build_trace.h"
+#include "glob_utility.h"
+
+using namespace std;
+
+
+BuildTrace *BuildTrace::theBuildTrace = 0;
+
+BuildTrace *BuildTrace::getTheBuildTrace()
+{
+    if( theBuildTrace == 0 )
+        theBuildTrace = new BuildTrace;
+    
+    return theBuildTrace;
+}
+
+
+void BuildTrace::enable( const string &fn )
+{
+    char cwd[1025];
+    
+    if( fn.length() > 0 && fn[0] != '/' && getcwd( cwd, 1024) )   // we change directory later on
+        fileName = stackPath( cwd, fn);
+    else
+        fileName = fn;
+    
+    enabled = true;
+}
+
+
+void BuildTrace::addPhase( const string &name, long long start_us, long long end_us)
+{
+    if( !enabled )
+        return;
+    
+    Event e;
+    e.ph = 'X';
+    e.name = name;
+    e.cat = "phase";
+    e.tid = 0;
+    e.ts = start_us;
+    e.dur = end_us - start_us;
+    events.push_back( e );
+}
+
+
+void BuildTrace::addJob( int slot, const string &name, const string &depType, unsigned int job_id, int file_id, int exitCode,
+                         long long start_us, long long end_us)
+{
+    if( !enabled )
+        return;
+    
+    stringstream args;
+    args << "{\"file\":\"" << jsonEscape( name ) << "\",\"type\":\"" << jsonEscape( depType ) << "\",\"job\":" << job_id
+         << ",\"file_id\":" << file_id << ",\"exit\":" << exitCode << "}";
+    
+    Event e;
+    e.ph = 'X';
+    e.name = name;
+    e.cat = depType;
+    e.tid = slot + 1;
+    e.ts = start_us;
+    e.dur = end_us - start_us;
+    e.args = args.str();
+    events.push_back( e );
+    
+    if( slot > maxSlot )
+        maxSlot = slot;
+}
+
+
+// on the front end track, args is a JSON object or empty
+void BuildTrace::addInstant( const string &name, const string &cat, long long ts_us, const string &args)
+{
+    if( !enabled )
+        return;
+    
+    Event e;
+    e.ph = 'i';
+    e.name = name;
+    e.cat = cat;
+    e.tid = 0;
+    e.ts = ts_us;
+    e.dur = 0;
+    e.args = args;
+    events.push_back( e );
+}
+
+
+void BuildTrace::addCounter( const string &name, long long ts_us, long long value)
+{
+    if( !enabled )
+        return;
+    
+    stringstream args;
+    args << "{\"value\":" << value << "}";
+    
+    Event e;
+    e.ph = 'C';
+    e.name = name;
+    e.cat = "counter";
+    e.tid = 0;
+    e.ts = ts_us;
+    e.dur = 0;
+    e.args = args.str();
+    events.push_back( e );
+}
+
+
+bool BuildTrace::write()
+{
+    if( !enabled )
+        return true;
+    
+    FILE *fp = fopen( fileName.c_str(), "w");
+    if( !fp )
+    {
+        cerr << "error: could not write trace file '" << fileName << "'.\n";
+        return false;
+    }
+    
+    long long base = 0;
+    size_t i;
+    for( i = 0; i < events.size(); i++)
+        if( i == 0 || events[i].ts < base )
+            base = events[i].ts;
+    
+    fprintf( fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf( fp, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"ferret\"}},\n");
+    fprintf( fp, "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"front end\"}}");
+    for( int s = 0; s <= maxSlot; s++)
+        fprintf( fp, ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"slot %d\"}}", s + 1, s);
+    
+    for( i = 0; i < events.size(); i++)
+    {
+        const Event &e = events[i];
+        
+        fprintf( fp, ",\n{\"ph\":\"%c\",\"name\":\"%s\",\"cat\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%lld",
+                 e.ph, jsonEscape( e.name ).c_str(), jsonEscape( e.cat ).c_str(), e.tid, e.ts - base);
+        if( e.ph == 'X' )
+            fprintf( fp, ",\"dur\":%lld", e.dur);
+        else if( e.ph == 'i' )
+            fprintf( fp, ",\"s\":\"g\"");
+        if( e.args.length() > 0 )
+            fprintf( fp, ",\"args\":%s", e.args.c_str());
+        fprintf( fp, "}");
+    }
+    
+    fprintf( fp, "\n]}\n");
+    fclose( fp );
+    
+    if( verbosity > 0 )
+        cout << "Wrote build trace to '" << fileName << "'\n";
+    
+    return true;
+}
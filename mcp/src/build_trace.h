@@ -0,0 +1,49 @@
+#ifndef FERRET_BUILD_TRACE_H_
+#define FERRET_BUILD_TRACE_H_
+
+#include <string>
+#include <vector>
+
+// trace event JSON of a run, for chrome://tracing or Perfetto (--trace <file>)
+// track 0 shows the front end phases of --times, track n the jobs of executor slot n-1
+class BuildTrace {
+    
+    struct Event {
+        char ph;                 // X = complete slice, i = instant, C = counter
+        std::string name;
+        std::string cat;
+        int tid;
+        long long ts, dur;       // micro seconds
+        std::string args;        // JSON object or empty
+    };
+    
+private:
+    BuildTrace()
+        : enabled(false), maxSlot(-1)
+    {}
+    
+public:
+    static BuildTrace *getTheBuildTrace();
+    
+    void enable( const std::string &fn );
+    bool isEnabled() const
+    { return enabled; }
+    
+    void addPhase( const std::string &name, long long start_us, long long end_us);
+    void addJob( int slot, const std::string &name, const std::string &depType, unsigned int job_id, int file_id, int exitCode,
+                 long long start_us, long long end_us);
+    void addInstant( const std::string &name, const std::string &cat, long long ts_us, const std::string &args);
+    void addCounter( const std::string &name, long long ts_us, long long value);
+    
+    bool write();
+    
+private:
+    static BuildTrace *theBuildTrace;
+    
+    bool enabled;
+    std::string fileName;
+    std::vector<Event> events;
+    int maxSlot;
+};
+
+#endif
@@ -0,0 +1,302 @@
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "content_hash_db.h"
+#include "glob_utility.h"
+#include "phase_profiler.h"
+#include "sha256.h"
+
+using namespace std;
+
+
+static const unsigned char typeind_id = 0x01;
+static const unsigned char typeind_hash = 0x08;
+static const unsigned char typeind_digest = 0x09;
+static const int hash_fields = 4;
+static const int digest_len = 64;
+
+
+// 64 bit hash, 8 bytes per step, murmur3 finalizer. not cryptographic, only has to tell edits apart
+static inline unsigned long long rotl64( unsigned long long x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+
+static inline unsigned long long fmix64( unsigned long long k )
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+
+static unsigned long long hash_block( unsigned long long h, const char *p, size_t n)
+{
+    size_t i = 0;
+    for( ; i + 8 <= n; i += 8)
+    {
+        unsigned long long k;
+        memcpy( &k, p + i, 8);
+        k *= 0x87c37b91114253d5ULL;
+        k = rotl64( k, 31);
+        k *= 0x4cf5ad432745937fULL;
+        h ^= k;
+        h = rotl64( h, 27) * 5 + 0x52dce729;
+    }
+    
+    if( i < n )        // tail, only at the end of the data since blocks are multiples of 8
+    {
+        unsigned long long k = 0;
+        memcpy( &k, p + i, n - i);
+        h ^= fmix64( k );
+    }
+    
+    return h;
+}
+
+
+bool ContentHashDb::hashFile( const string &fn, unsigned long long &h)
+{
+    FILE *fp = fopen( fn.c_str(), "r");
+    if( !fp )
+        return false;
+    
+    static char buf[ 65536 ];
+    unsigned long long total = 0;
+    size_t n;
+    
+    h = 0x9e3779b97f4a7c15ULL;
+    while( (n = fread( buf, 1, sizeof(buf), fp)) > 0 )
+    {
+        h = hash_block( h, buf, n);
+        total += n;
+    }
+    
+    bool ok = !ferror( fp );
+    fclose( fp );
+    
+    h = fmix64( h ^ total );
+    return ok;
+}
+
+
+unsigned long long ContentHashDb::hashData( const char *p, size_t len, unsigned long long seed)
+{
+    return fmix64( hash_block( 0x9e3779b97f4a7c15ULL ^ fmix64( seed ), p, len) ^ len );
+}
+
+
+void ContentHashDb::read( const string &dbProjDir )
+{
+    fileName = stackPath( dbProjDir, dbName);
+    entries.clear();
+    changed = false;
+    
+    FILE *fp = fopen( fileName.c_str(), "r");
+    if( !fp )
+        return;
+    
+    bool err = false;
+    int file_id = -1;
+    while( !feof( fp ) && !err )
+    {
+        unsigned char typeind;
+        long long v[ hash_fields ];
+        
+        if( fread( &typeind, sizeof(unsigned char), 1, fp) == 0 )
+            break;
+        
+        if( typeind == typeind_digest )     // optional, belongs to the entry before it
+        {
+            char d[ digest_len ];
+            if( file_id < 0 || fread( d, 1, digest_len, fp) != (size_t)digest_len )
+                err = true;
+            else
+                entries[ file_id ].digest = string( d, digest_len);
+            continue;
+        }
+        
+        if( typeind != typeind_id || fread( &file_id, sizeof(int), 1, fp) != 1 )
+            err = true;
+        else if( fread( &typeind, sizeof(unsigned char), 1, fp) != 1 || typeind != typeind_hash )
+            err = true;
+        else if( fread( v, sizeof(long long), hash_fields, fp) != (size_t)hash_fields )
+            err = true;
+        
+        if( !err )
+        {
+            Entry e;
+            e.size = v[0];
+            e.mtime_ns = v[1];
+            e.eff_ms = v[2];
+            e.hash = (unsigned long long)v[3];
+            entries[ file_id ] = e;
+        }
+    }
+    
+    if( verbosity )
+        cout << "Content hashes read " << entries.size() << " entries from " << dbName << "\n";
+    if( err )
+    {
+        cerr << "warning: " << dbName << " corrupt.\n";
+        entries.clear();
+    }
+    fclose( fp );
+}
+
+
+void ContentHashDb::write()
+{
+    if( verbosity && hashed )
+        cout << "Content hashes: " << hashed << " file(s) hashed, " << unchanged << " touched but unchanged (" << dbName << ")\n";
+    
+    if( !changed || fileName.length() == 0 )
+        return;
+    
+    FILE *fp = fopen( fileName.c_str(), "w");
+    if( !fp )
+        return;
+    
+    map<int,Entry>::const_iterator it;
+    for( it = entries.begin(); it != entries.end(); it++)
+    {
+        const Entry &e = it->second;
+        long long v[ hash_fields ] = { e.size, e.mtime_ns, e.eff_ms, (long long)e.hash };
+        
+        fwrite( &typeind_id, sizeof(unsigned char), 1, fp);
+        fwrite( &(it->first), sizeof(int), 1, fp);
+        fwrite( &typeind_hash, sizeof(unsigned char), 1, fp);
+        fwrite( v, sizeof(long long), hash_fields, fp);
+        if( e.digest.length() == (size_t)digest_len )
+        {
+            fwrite( &typeind_digest, sizeof(unsigned char), 1, fp);
+            fwrite( e.digest.data(), 1, digest_len, fp);
+        }
+    }
+    
+    if( verbosity )
+        cout << "Content hashes wrote " << entries.size() << " entries to " << dbName << "\n";
+    
+    fclose( fp );
+    changed = false;
+}
+
+
+void ContentHashDb::remove( const string &dbProjDir, const string &dbName)
+{
+    ::remove( stackPath( dbProjDir, dbName).c_str() );
+}
+
+
+long long ContentHashDb::effectiveTimeMs( int file_id, const File &f)
+{
+    map<int,Entry>::iterator it = entries.find( file_id );
+    
+    if( it != entries.end() && it->second.size == f.getSize() && it->second.mtime_ns == f.getTimeNs() )
+        return it->second.eff_ms;     // stat data unchanged, no need to read the file
+    
+    unsigned long long h;
+    if( !hashFile( f.getPath(), h) )
+        return f.getTimeMs();
+    
+    prof_count( PROF_HASHED );
+    hashed++;
+    changed = true;
+    
+    if( it != entries.end() && it->second.hash == h )
+    {
+        it->second.size = f.getSize();
+        it->second.mtime_ns = f.getTimeNs();
+        unchanged++;
+        
+        if( verbosity > 1 )
+            cout << "content hash     " << f.getPath() << " touched but unchanged\n";
+        
+        return it->second.eff_ms;
+    }
+    
+    Entry e;
+    e.size = f.getSize();
+    e.mtime_ns = f.getTimeNs();
+    e.eff_ms = f.getTimeMs();
+    e.hash = h;
+    entries[ file_id ] = e;
+    
+    return e.eff_ms;
+}
+
+
+bool ContentHashDb::getHash( int file_id, const File &f, unsigned long long &h)
+{
+    map<int,Entry>::const_iterator it = entries.find( file_id );
+    
+    if( it != entries.end() && it->second.size == f.getSize() && it->second.mtime_ns == f.getTimeNs() )
+    {
+        h = it->second.hash;
+        return true;
+    }
+    
+    if( !hashFile( f.getPath(), h) )
+        return false;
+    
+    prof_count( PROF_HASHED );
+    hashed++;
+    return true;
+}
+
+
+void ContentHashDb::setHash( int file_id, const File &f, unsigned long long h)
+{
+    Entry e;
+    e.size = f.getSize();
+    e.mtime_ns = f.getTimeNs();
+    e.eff_ms = f.getTimeMs();
+    e.hash = h;
+    entries[ file_id ] = e;
+    changed = true;
+}
+
+
+bool ContentHashDb::updateHash( int file_id, const File &f, unsigned long long &h)
+{
+    map<int,Entry>::const_iterator it = entries.find( file_id );
+    bool known = it != entries.end() && it->second.size == f.getSize() && it->second.mtime_ns == f.getTimeNs();
+    
+    if( !getHash( file_id, f, h) )
+        return false;
+    
+    if( !known )
+    {
+        string d = it != entries.end() && it->second.hash == h ? it->second.digest : "";
+        setHash( file_id, f, h);
+        entries[ file_id ].digest = d;          // touched but unchanged keeps its digest
+    }
+    return true;
+}
+
+
+bool ContentHashDb::updateDigest( int file_id, const File &f, string &digest)
+{
+    unsigned long long h;
+    if( !updateHash( file_id, f, h) )
+        return false;
+    
+    Entry &e = entries[ file_id ];
+    if( e.digest.length() != (size_t)digest_len )
+    {
+        if( !Sha256::hexFile( f.getPath(), e.digest) )
+        {
+            e.digest = "";
+            return false;
+        }
+        changed = true;
+    }
+    
+    digest = e.digest;
+    return true;
+}
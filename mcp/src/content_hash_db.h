@@ -0,0 +1,47 @@
+#ifndef FERRET_CONTENT_HASH_DB_H_
+#define FERRET_CONTENT_HASH_DB_H_
+
+#include <string>
+#include <map>
+
+#include "find_files.h"
+
+// content hashes per file id, persisted in the db project dir.
+// ferret_content_hash holds "D" files, used with FERRET_CONTENT_HASH=y to see through touched but unchanged
+// sources (git checkout, branch switch). ferret_output_hash holds outputs for FERRET_EARLY_CUTOFF=y
+class ContentHashDb {
+
+public:
+    explicit ContentHashDb( const std::string &dbName = "ferret_content_hash" )
+        : dbName(dbName), changed(false), hashed(0), unchanged(0)
+    {}
+    
+    void read( const std::string &dbProjDir );
+    void write();
+    static void remove( const std::string &dbProjDir, const std::string &dbName);
+    
+    // time of the last content change of f, is f's mtime unless f was touched without changing it
+    long long effectiveTimeMs( int file_id, const File &f);
+    
+    bool getHash( int file_id, const File &f, unsigned long long &h);   // reads f only if its stat data changed
+    void setHash( int file_id, const File &f, unsigned long long h);
+    bool updateHash( int file_id, const File &f, unsigned long long &h);  // getHash(), remembers what was read
+    bool updateDigest( int file_id, const File &f, std::string &digest);  // sha256 hex, kept until the content changes
+    
+    static bool hashFile( const std::string &fn, unsigned long long &h);
+    static unsigned long long hashData( const char *p, size_t len, unsigned long long seed = 0);
+
+private:
+    struct Entry {
+        long long size, mtime_ns, eff_ms;
+        unsigned long long hash;
+        std::string digest;       // sha256, only filled by updateDigest()
+    };
+    
+    std::string dbName, fileName;
+    std::map<int,Entry> entries;
+    bool changed;
+    int hashed, unchanged;
+};
+
+#endif
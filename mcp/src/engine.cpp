@@ -4,6 +4,7 @@
 #include <cstdlib>
 #include <iostream>
 #include <sstream>
+#include <algorithm>
 
 #include "engine.h"
 #include "executor.h"
@@ -13,6 +14,12 @@
 #include "script_template.h"
 #include "find_files.h"
 #include "output_collector.h"
+#include "perf_history.h"
+#include "platform_spec.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 using namespace std;
 
@@ -38,6 +45,9 @@ void EngineBase::indicateDone( int file_id, unsigned int job_id, long long curr_
 // -----------------------------------------------------------------------------
 void DepEngine::addDepCommand( ExecutorCommand &ec )
 {
+    if( ec.getArgs().size() > 0 )
+        ec.setTarget( ec.getArgs()[0], "DEP");
+    
     unsigned int job_id = OutputCollector::getTheOutputCollector()->createJob( ec.getFileName(), ec.getArgs(), ec.getFileId());
     ec.setJobId( job_id );
     
@@ -51,12 +61,8 @@ int DepEngine::doWork( ExecutorBase &executor, bool printTime, const set<string>
     
     if( commands.size() >  0 )
         executor.processCommands( *this );
-       
-    ofstream osh( "last_run.html" );
-    OutputCollector::getTheOutputCollector()->html( osh );
-
-    ofstream ost( "last_run.txt" );
-    OutputCollector::getTheOutputCollector()->text( ost );
+    
+    OutputCollector::getTheOutputCollector()->reportEnd();
     
     return 0;
 }
@@ -97,12 +103,8 @@ int SyncEngine::doWork( ExecutorBase &executor, bool printTime, const set<string
     
     if( commands.size() >  0 )
         executor.processCommands( *this );
-       
-    ofstream osh( "last_sync_run.html" );
-    OutputCollector::getTheOutputCollector()->html( osh );
-
-    ofstream ost( "last_sync_run.txt" );
-    OutputCollector::getTheOutputCollector()->text( ost );
+    
+    OutputCollector::getTheOutputCollector()->reportEnd();
     
     return 0;
 }
@@ -130,7 +132,10 @@ void SyncEngine::indicateDone( int file_id, unsigned int job_id, long long curr_
 
 Engine::Engine( int table_size, const string &dbProjDir, const string &compileMode, bool doScfs)
     : EngineBase(), dbProjDir(dbProjDir), compileMode(compileMode), curses(false),
-      round(0), scfs(doScfs), stopOnError(false)
+      round(0), scfs(doScfs), stopOnError(false), contentHash(false), earlyCutoff(false), remoteExec(false), cutOffs(0),
+      contentHashDb("ferret_content_hash"), outputHashDb("ferret_output_hash"), inputHashDb("ferret_input_hash"),
+      memAdmit(false), memWatchFree(false), memBudgetKb(0), memDefaultKb(0), memInWorkKb(0), memWaits(0),
+      batchSize(1), batchedCmds(0)
 {
     int i;
     for( i=0; i<FILE_TABLE_SIZE; i++)
@@ -216,6 +221,16 @@ Engine::command_t *Engine::init_entry( data_t *cmd )
 
     e->scfs_time = 0;
     
+    e->has_old_hash = e->output_unchanged = false;
+    e->old_hash = 0;
+    e->old_time = 0;
+    e->has_cache_key = false;
+    e->cache_key[0] = 0;
+    e->pool = -1;
+    e->mem_kb = 0;
+    e->mem_waited = false;
+    e->mem_passed = 0;
+    
     return e;
 }
 
@@ -502,6 +517,15 @@ string Engine::generateScript( command_t *c )
 }
 
 
+// a compile for a worker goes as the program call when it can, a worker does not have to run a shell for it
+bool Engine::generateExec( command_t *c, ExecRecipe &recipe, bool remotable)
+{
+    ScriptManager *sm = ScriptManager::getTheScriptManager();
+    
+    return (sm->hasDirectExec() || remotable) && sm->compileExec( c->file_id, c->file_name, recipe);
+}
+
+
 bool Engine::make_target_by_wait( command_t *c )
 {
     bool make_target = false;
@@ -518,16 +542,19 @@ bool Engine::make_target_by_wait( command_t *c )
             {
                 command_t *dep = find_command( c->deps[i] );
                 
-                const File depf = FindFiles::getCachedFile( dep->file_name );
-
                 if( scfs && c->scfs_time > 0 && dep->scfs_time > 0 )
                 {
                     if( c->scfs_time < dep->scfs_time )
                         make_target = true;
                 }
+                else if( !FindFiles::exists( dep->file_name ) )    // not only sources, a module unit depends on other compiles
+                    make_target = true;
                 else
+                {
+                    const File depf = FindFiles::getCachedFile( dep->file_name );
                     if( depf.isNewerThan( waitf ) )
                         make_target = true;
+                }
             }
         }
         else
@@ -566,6 +593,15 @@ void Engine::make_targets_by_dom_set( command_t *c )    // make all nodes domina
 }
 
 
+long long Engine::source_time( command_t *c, const File &f)
+{
+    if( contentHash && strcmp( c->dep_type, "D") == 0 )
+        return contentHashDb.effectiveTimeMs( c->file_id, f);
+    else
+        return f.getTimeMs();
+}
+
+
 void Engine::fill_target_set()
 {
     hash_set_t *front_ids;
@@ -589,7 +625,7 @@ void Engine::fill_target_set()
                     else
                     {
                         const File f = FindFiles::getCachedFile( c->file_name );
-                        c->dominating_time = f.getTimeMs();
+                        c->dominating_time = source_time( c, f);
                     }
                 }
                 else
@@ -661,7 +697,7 @@ void Engine::fill_target_set()
                         else
                         {
                             const File down_f = FindFiles::getCachedFile( down_fn );
-                            d->dominating_time = down_f.getTimeMs();
+                            d->dominating_time = source_time( d, down_f);
                         }
                     }
                     
@@ -733,6 +769,201 @@ void Engine::fill_target_set()
 }
 
 
+// early cutoff, only for outputs others depend on. extension nodes with wait files are left alone
+bool Engine::cutoff_candidate( command_t *c )
+{
+    return earlyCutoff && !scfs && c->downward_size > 0 && c->downward_deep && c->weak_size == 0 &&
+        strcmp( c->dep_type, "W") != 0;
+}
+
+
+// c is a target, but all targets it depends on came out unchanged and everything else is older than c. like
+// ninja's restat an unchanged output only counts if c was built after its previous version, else an earlier run
+// stopped between the two and c is stale
+bool Engine::can_cut_off( command_t *c )
+{
+    if( !earlyCutoff || scfs || c->marked_by_deletion || c->marked_by_deps_changed || c->weak_size > 0 ||
+        strcmp( c->dep_type, "W") == 0 )
+        return false;
+    
+    bool any_unchanged = false;
+    for( int i = 0; i < c->deps_size; i++)
+    {
+        command_t *u = c->upwards[i];
+        
+        if( u->is_target )
+        {
+            if( !u->output_unchanged )
+                return false;
+            any_unchanged = true;
+        }
+    }
+    
+    if( !any_unchanged || !queryFiles.exists( c->file_name ) )
+        return false;
+    
+    long long own_time = queryFiles.getFile( c->file_name ).getTimeMs();
+    for( int i = 0; i < c->deps_size; i++)
+    {
+        command_t *u = c->upwards[i];
+        
+        if( u->is_target )
+        {
+            if( u->old_time == 0 || u->old_time > own_time )
+                return false;
+        }
+        else if( u->dominating_time == 0 || u->dominating_time > own_time )
+            return false;
+    }
+    
+    return true;
+}
+
+
+void Engine::cut_off( command_t *c )
+{
+    unsigned long long h;
+    bool has_hash = false;
+    
+    if( cutoff_candidate( c ) )
+        has_hash = outputHashDb.getHash( c->file_id, queryFiles.getFile( c->file_name ), h);
+    c->old_time = queryFiles.getFile( c->file_name ).getTimeMs();     // before the touch
+    
+    if( utimensat( AT_FDCWD, c->file_name, 0, 0) != 0 )    // now up to date with its inputs
+        cerr << "warning: could not touch " << c->file_name << "\n";
+    
+    if( has_hash )
+        outputHashDb.setHash( c->file_id, queryFiles.getFile( c->file_name ), h);
+    
+    c->output_unchanged = true;
+    mark_done_early( c );
+    cutOffs++;
+    
+    if( verbosity > 0 )
+        cout << "early cutoff   " << c->file_name << " (" << c->file_id << ") skipped, its inputs are unchanged\n";
+}
+
+
+void Engine::mark_done_early( command_t *c )      // target done without a job
+{
+    c->is_done = true;
+    hash_set_add( done_set, c->file_id);
+    hash_set_remove( targets_left, c->file_id);
+}
+
+
+// -----------------------------------------------------------------------------
+// action cache, FERRET_CACHE_DIR
+
+bool Engine::cacheable( command_t *c )
+{
+    if( (!actionCache.isEnabled() && !remoteCache.isEnabled()) || c->weak_size > 0 )
+        return false;
+    
+    return strcmp( c->dep_type, "Cpp") == 0 || strcmp( c->dep_type, "C") == 0 || strcmp( c->dep_type, "L") == 0 ||
+        strcmp( c->dep_type, "X") == 0 || strcmp( c->dep_type, "A") == 0;
+}
+
+
+// what c reads: its prerequisites, for "D" files also what they include
+void Engine::collect_inputs( command_t *c, map<string,command_t *> &inputs)
+{
+    for( int i = 0; i < c->deps_size; i++)
+    {
+        command_t *u = c->upwards[i];
+        
+        if( inputs.insert( make_pair( string( u->file_name ), u) ).second && strcmp( u->dep_type, "D") == 0 )
+            collect_inputs( u, inputs);
+    }
+}
+
+
+bool Engine::action_key( command_t *c, string &key)
+{
+    string cmd = ScriptManager::getTheScriptManager()->getCommand( c->file_id, c->file_name);
+    if( cmd.length() == 0 )
+        return false;
+    
+    stringstream text;
+    text << "ferret action 3\n" << compileMode << "\n" << c->dep_type << "\n" << c->file_name << "\n" << cmd << "\n";
+    
+    ExecRecipe r;     // the program the command runs, else the compilers it may call through /bin/sh
+    if( ScriptManager::getTheScriptManager()->compileExec( c->file_id, c->file_name, r) && r.argv.size() > 0 )
+        text << "tool " << ActionCache::toolIdentity( r.argv[0] ) << "\n";
+    else
+    {
+        PlatformSpec *ps = PlatformSpec::getThePlatformSpec();
+        text << "tool " << ActionCache::toolIdentity( ps->getCppCompiler() ) << "\n";
+        text << "tool " << ActionCache::toolIdentity( ps->getCCompiler() ) << "\n";
+    }
+    
+    map<string,command_t *> inputs;
+    collect_inputs( c, inputs);
+    
+    map<string,command_t *>::const_iterator it;
+    for( it = inputs.begin(); it != inputs.end(); it++)
+    {
+        string digest;     // sha256, the key is shared with other hosts through the remote cache
+        const File f = queryFiles.getFile( it->first );
+        
+        if( f.getPath() == "" || !inputHashDb.updateDigest( it->second->file_id, f, digest) )
+            return false;
+        
+        text << digest << " " << it->first << "\n";
+    }
+    
+    key = ActionCache::makeKey( text.str() );
+    return true;
+}
+
+
+bool Engine::cache_lookup( command_t *c )
+{
+    string key;
+    if( !cacheable( c ) || !action_key( c, key) )
+        return false;
+    
+    unsigned long long old_h = 0, h;
+    bool has_old = cutoff_candidate( c ) && queryFiles.exists( c->file_name ) &&
+        outputHashDb.getHash( c->file_id, queryFiles.getFile( c->file_name ), old_h);
+    if( has_old )
+        c->old_time = queryFiles.getFile( c->file_name ).getTimeMs();
+    
+    string log;
+    const char *from = "action cache   ";
+    if( actionCache.isEnabled() && actionCache.lookup( key, c->file_name, log, h) )
+        ;
+    else if( remoteCache.isEnabled() && remoteCache.lookup( key, c->file_name, log) && ContentHashDb::hashFile( c->file_name, h) )
+    {
+        from = "remote cache   ";
+        if( actionCache.isEnabled() )
+            actionCache.store( key, c->file_name, log);
+    }
+    else
+    {
+        strncpy( c->cache_key, key.c_str(), sizeof(c->cache_key));
+        c->cache_key[ sizeof(c->cache_key) - 1 ] = 0;
+        c->has_cache_key = true;
+        return false;
+    }
+    
+    if( cutoff_candidate( c ) )
+    {
+        outputHashDb.setHash( c->file_id, queryFiles.getFile( c->file_name ), h);
+        c->output_unchanged = has_old && old_h == h;
+    }
+    
+    mark_done_early( c );
+    
+    if( verbosity > 0 )
+        cout << from << c->file_name << " (" << c->file_id << ") taken from cache\n";
+    if( !curses )
+        cout << log;
+    
+    return true;
+}
+
+
 void Engine::move_wavefront()
 {
     int activity;
@@ -753,7 +984,14 @@ void Engine::move_wavefront()
             {
                 if( prereqs_done( c ) )
                 {
-                    if( c->is_target )
+                    if( c->is_target && !c->in_to_do && !c->has_failed && can_cut_off( c ) )
+                    {
+                        cut_off( c );
+                        activity++;
+                    }
+                    else if( c->is_target && !c->in_to_do && !c->has_failed && !c->has_cache_key && cache_lookup( c ) )
+                        activity++;
+                    else if( c->is_target )
                     {
                         if( !c->has_failed )
                         {
@@ -846,6 +1084,408 @@ void Engine::build_to_do_array()
     }
 
     to_do_cmd_size = i;
+    
+    ScriptManager *sm = ScriptManager::getTheScriptManager();
+    if( !sm->hasDirectExec() )
+    {
+        for( i = 0; i < to_do_cmd_size; i++)           // let the worker thread write the scripts in dispatch order
+            if( strcmp( to_do_cmd_ids[ i ]->dep_type, "W") != 0 )
+                sm->pregen( to_do_cmd_ids[ i ]->file_id, to_do_cmd_ids[ i ]->file_name);
+    }
+}
+
+
+// later definitions of a pool (build properties after platform) replace size and types
+void Engine::addPool( const string &name, int size, const string &types)
+{
+    size_t p;
+    for( p = 0; p < pools.size(); p++)
+        if( pools[ p ].name == name )
+            break;
+    
+    if( p == pools.size() )
+    {
+        pool_t n;
+        n.name = name;
+        n.busy = 0;
+        pools.push_back( n );
+    }
+    pools[ p ].size = size > 0 ? size : 1;
+    
+    map<string,int>::iterator it = typePools.begin();
+    while( it != typePools.end() )
+    {
+        if( it->second == (int)p )
+            typePools.erase( it++ );
+        else
+            it++;
+    }
+    
+    stringstream ss( types.length() > 0 ? types : name );
+    string t;
+    while( ss >> t )
+        typePools[ t ] = p;
+    
+    if( verbosity > 0 )
+        cout << "Pool " << name << ": at most " << pools[ p ].size << " job(s) of type " << (types.length() > 0 ? types : name) << "\n";
+}
+
+
+int Engine::pool_of( command_t *c )
+{
+    map<string,int>::const_iterator it = typePools.find( c->dep_type );
+    
+    return it != typePools.end() ? it->second : -1;
+}
+
+
+static long long mem_available_kb()
+{
+    FILE *fp = fopen( "/proc/meminfo", "r");
+    if( !fp )
+        return 0;
+    
+    char line[ 256 ];
+    long long kb = 0;
+    while( fgets( line, sizeof(line), fp) )
+        if( sscanf( line, "MemAvailable: %lld kB", &kb) == 1 )
+            break;
+    fclose( fp );
+    
+    return kb;
+}
+
+
+void Engine::setMemAdmission( long long budgetMb, long long defaultMb)
+{
+    memAdmit = true;
+    memBudgetKb = budgetMb * 1024;
+    memDefaultKb = defaultMb * 1024;
+    
+    memWatchFree = memBudgetKb <= 0;
+    if( memWatchFree )
+        memBudgetKb = mem_available_kb();     // what was free before the first job
+    if( memBudgetKb <= 0 )
+    {
+        cerr << "warning: no memory budget and /proc/meminfo has no MemAvailable, memory admission is off.\n";
+        memAdmit = false;
+    }
+    else if( verbosity > 0 )
+        cout << "Memory admission: " << memBudgetKb / 1024 << " MB for predicted peak RSS of the jobs\n";
+}
+
+
+// peak RSS of the job's last run, or what jobs of its type took on average
+long long Engine::predicted_rss_kb( command_t *c )
+{
+    if( strcmp( c->dep_type, "W") == 0 )
+        return 0;
+    
+    JobUsage u;
+    if( usageDb.get( c->file_id, u) && u.valid && u.maxrss_kb > 0 )
+        return u.maxrss_kb;
+    
+    map<string,long long>::const_iterator it = typeRssKb.find( c->dep_type );
+    return it != typeRssKb.end() ? it->second : memDefaultKb;
+}
+
+
+void Engine::average_type_rss()
+{
+    map<string,long long> sum, n;
+    
+    size_t i;
+    for( i = 0; i < file_ids.size(); i++)
+    {
+        JobUsage u;
+        if( usageDb.get( file_ids[i], u) && u.valid && u.maxrss_kb > 0 )
+        {
+            command_t *c = find_command( file_ids[i] );
+            sum[ c->dep_type ] += u.maxrss_kb;
+            n[ c->dep_type ]++;
+        }
+    }
+    
+    map<string,long long>::const_iterator it;
+    for( it = sum.begin(); it != sum.end(); it++)
+        typeRssKb[ it->first ] = it->second / n[ it->first ];
+}
+
+
+// a job waiting for memory may be passed over that often, then nothing behind it starts until it fits
+static const int mem_max_passed = 8;
+
+
+// moves the first command whose pool has room and whose predicted memory fits to to_do_cmd_pos, keeping the
+// order of the others. so a big job that does not fit lets smaller ones behind it start, but only mem_max_passed
+// times. after that the memory is reserved for it, else a steady stream of small jobs could keep it waiting
+bool Engine::pick_admissible()
+{
+    long long availKb = memAdmit && memWatchFree ? mem_available_kb() : 0;
+    command_t *oldest = 0;      // the first one waiting for memory
+    int i, p;
+    for( i = to_do_cmd_pos; i < to_do_cmd_size; i++)
+    {
+        command_t *c = to_do_cmd_ids[ i ];
+        p = pool_of( c );
+        if( p >= 0 && pools[ p ].busy >= pools[ p ].size )
+            continue;
+        
+        if( memAdmit )
+        {
+            long long need = predicted_rss_kb( c );
+            if( memInWorkKb + need > memBudgetKb || (availKb > 0 && need > availKb) )
+            {
+                if( !c->mem_waited )
+                {
+                    c->mem_waited = true;
+                    memWaits++;
+                }
+                if( oldest == 0 )
+                    oldest = c;
+                if( oldest->mem_passed >= mem_max_passed )
+                    return false;
+                continue;
+            }
+        }
+        break;
+    }
+    
+    if( i == to_do_cmd_size )
+        return false;
+    
+    if( oldest )
+        oldest->mem_passed++;
+    move_to_pos( i );
+    return true;
+}
+
+
+void Engine::move_to_pos( int i )
+{
+    command_t *c = to_do_cmd_ids[ i ];
+    for( ; i > to_do_cmd_pos; i--)
+        to_do_cmd_ids[ i ] = to_do_cmd_ids[ i - 1 ];
+    to_do_cmd_ids[ to_do_cmd_pos ] = c;
+}
+
+
+// the compile call of c without "-o <object>" and without its source, which must become <object dir>/<base>.o
+bool Engine::batch_recipe( command_t *c, vector<string> &rest, string &in, string &echo)
+{
+    ExecRecipe r;
+    if( strcmp( c->dep_type, "Cpp") != 0 || c->weak_size > 0 ||
+        !ScriptManager::getTheScriptManager()->compileExec( c->file_id, c->file_name, r) || r.exitCode != 0 )
+        return false;
+    
+    bool gotOut = false;
+    in = "";
+    rest.clear();
+    for( size_t k = 0; k < r.argv.size(); k++)
+    {
+        if( !gotOut && r.argv[k] == "-o" && k + 1 < r.argv.size() && r.argv[k+1] == c->file_name )
+        {
+            gotOut = true;
+            k++;
+            continue;
+        }
+        
+        if( r.argv[k].compare( 0, 16, "-fmodule-mapper=") == 0 )    // its CMI paths are relative to the project root
+            return false;
+        
+        if( (r.argv[k] == "-include" || r.argv[k] == "-imacros") && k + 1 < r.argv.size() )     // a header, not the source
+        {
+            rest.push_back( r.argv[k++] );
+            rest.push_back( r.argv[k] );
+            continue;
+        }
+        
+        if( in.length() == 0 )
+        {
+            int d;
+            for( d = 0; d < c->deps_size; d++)
+                if( r.argv[k] == c->upwards[d]->file_name )
+                    break;
+            if( d < c->deps_size )
+            {
+                in = r.argv[k];
+                continue;
+            }
+        }
+        rest.push_back( r.argv[k] );
+    }
+    echo = r.echo;
+    
+    string dir, bn, bext, ext, odir, obn;
+    breakPath( in, dir, bn);
+    breakFileName( bn, bext, ext);
+    breakPath( c->file_name, odir, obn);
+    return gotOut && in.length() > 0 && obn == bext + ".o";
+}
+
+
+static string abs_path( const string &cwd, const string &p)
+{
+    return p.length() > 0 && p[0] != '/' ? cwd + "/" + p : p;
+}
+
+
+// the batch runs in the object directory, so paths in the flags must not be relative to the project root
+static void absolutize( vector<string> &args, const string &cwd)
+{
+    static const char *opts[] = { "-I", "-iquote", "-isystem", "-idirafter", "-include", "-imacros", 0 };
+    
+    for( size_t k = 1; k < args.size(); k++)
+    {
+        for( int o = 0; opts[o]; o++)
+        {
+            size_t len = strlen( opts[o] );
+            if( args[k] == opts[o] )
+            {
+                if( k + 1 < args.size() )
+                    args[k+1] = abs_path( cwd, args[k+1]);
+                k++;
+                break;
+            }
+            else if( o < 4 && args[k].compare( 0, len, opts[o]) == 0 )     // joined, not for -include and -imacros
+            {
+                args[k] = opts[o] + abs_path( cwd, args[k].substr( len ));
+                break;
+            }
+        }
+    }
+}
+
+
+// ready compiles of the same node with the same flags as c go into one compiler call, "cd <object dir> && <compiler> -c
+// <sources>" puts every object where its command expects it. the engine tells later by the objects which ones failed
+bool Engine::make_batch( command_t *c, vector<command_t *> &batch, ExecutorCommand &ec)
+{
+    vector<string> lead, rest;
+    string in, echo, allEcho;
+    if( !batch_recipe( c, lead, in, echo) )
+        return false;
+    allEcho = echo.substr( 0, echo.find( '\n' ) + 1);      // "target -> object" of each, not their compiler calls
+    
+    vector<string> inputs( 1, in);
+    int i;
+    for( i = to_do_cmd_pos; i < to_do_cmd_size && (int)batch.size() + 1 < batchSize; i++)
+    {
+        command_t *m = to_do_cmd_ids[ i ];
+        if( m->baseNode != c->baseNode || m->has_cache_key != c->has_cache_key || !batch_recipe( m, rest, in, echo) || rest != lead )
+            continue;
+        
+        string odir, obn, mdir, mbn;
+        breakPath( c->file_name, odir, obn);
+        breakPath( m->file_name, mdir, mbn);
+        if( odir != mdir )
+            continue;
+        
+        move_to_pos( i );
+        to_do_cmd_pos++;
+        batch.push_back( m );
+        inputs.push_back( in );
+        allEcho += echo.substr( 0, echo.find( '\n' ) + 1);
+    }
+    
+    if( batch.size() == 0 )
+        return false;
+    
+    char cwd[ 1025 ];
+    if( !getcwd( cwd, 1024) )
+        return false;
+    
+    string odir, obn;
+    breakPath( c->file_name, odir, obn);
+    
+    // __FILE__, assert and the debug info get the paths of a compile from the project root, the same object as
+    // without batching. the compiler's messages do not, their absolute paths are cut down as the output comes in
+    absolutize( lead, cwd);
+    lead.insert( lead.begin() + 1, "-ffile-prefix-map=" + string( cwd ) + "/=");
+    for( size_t k = 0; k < inputs.size(); k++)
+        lead.push_back( abs_path( cwd, inputs[k]) );
+    
+    vector<string> args;
+    args.push_back( "-c" );
+    args.push_back( "cd \"$0\" && exec \"$@\"" );
+    args.push_back( odir.length() > 0 ? odir : "." );
+    args.insert( args.end(), lead.begin(), lead.end());
+    
+    ec = ExecutorCommand( "/bin/sh", args, c->file_id);
+    ec.setEchoOutput( allEcho + "cd " + args[2] + " && " + join( " ", lead, false) + "\n" );
+    ec.setOutputPrefix( string( cwd ) + "/" );
+    ec.setFixedExitCode( 0 );          // as the script templates, which objects were made tells what failed
+    
+    batchedCmds += batch.size() + 1;
+    return true;
+}
+
+
+// index of the source a compiler diagnostic line starts with, from: the path after "from " of an include chain line
+static int batch_source_of( const string &line, const vector<string> &srcs, size_t from)
+{
+    size_t colon = line.find( ':', from);
+    if( colon == string::npos )
+        return -1;
+    
+    string path = line.substr( from, colon - from);
+    for( size_t k = 0; k < srcs.size(); k++)
+        if( path == srcs[k] || (path.length() > srcs[k].length() && path[ path.length() - srcs[k].length() - 1 ] == '/' &&
+                                path.compare( path.length() - srcs[k].length(), string::npos, srcs[k]) == 0) )
+            return k;
+    
+    return -1;
+}
+
+
+// a diagnostic starting with a source belongs to its part, so do the lines after it up to the next such diagnostic.
+// an include chain ("In file included from x.h:2,\n     from a.cpp:3:") names the source the following header
+// diagnostics belong to, gcc at its end and clang at its start
+static void split_batch_log( const string &log, const vector<string> &srcs, vector<string> &parts)
+{
+    parts.assign( srcs.size(), "");
+    
+    static const string chainStart = "In file included from ";
+    string pending;
+    size_t owner = 0, pos = 0;
+    bool known = false, chain = false;
+    while( pos < log.length() )
+    {
+        size_t nl = log.find( '\n', pos);
+        string line = log.substr( pos, nl == string::npos ? string::npos : nl - pos + 1);
+        pos = nl == string::npos ? log.length() : nl + 1;
+        
+        size_t from = line.find_first_not_of( ' ' );
+        int k;
+        if( line.compare( 0, chainStart.length(), chainStart) == 0 )
+        {
+            if( !chain )
+                known = false;      // a new chain, its source is not known before it names one
+            chain = true;
+            k = batch_source_of( line, srcs, chainStart.length());
+        }
+        else if( chain && from != string::npos && line.compare( from, 5, "from ") == 0 )
+            k = batch_source_of( line, srcs, from + 5);
+        else
+        {
+            chain = false;
+            k = batch_source_of( line, srcs, 0);
+        }
+        
+        if( k >= 0 )
+        {
+            owner = k;
+            known = true;
+        }
+        
+        pending += line;
+        if( known )
+        {
+            parts[ owner ] += pending;
+            pending = "";
+        }
+    }
+    parts[ owner ] += pending;
 }
 
 
@@ -905,6 +1545,9 @@ ExecutorCommand Engine::nextCommand()
     if( hash_set_get_size( to_do_set ) > 0 )
     {
         assert( to_do_cmd_pos < to_do_cmd_size );
+        if( (pools.size() > 0 || memAdmit) && hash_set_get_size( in_work_set ) > 0 && !pick_admissible() )
+            return ExecutorCommand( (unsigned int)-1, "WAIT");      // all that is ready waits for a pool or memory, not a barrier
+        
         command_t *c = to_do_cmd_ids[ to_do_cmd_pos++ ];
         
         char *dep_type = c->dep_type;
@@ -922,8 +1565,17 @@ ExecutorCommand Engine::nextCommand()
         }
         else
         {
-            string script = generateScript( c );
-            if( script.length() == 0 )
+            vector<command_t *> batch;
+            bool batched = batchSize > 1 && !remoteExec && make_batch( c, batch, ec);
+            
+            bool remotable = remoteExec && c->weak_size == 0 && (strcmp( dep_type, "Cpp") == 0 || strcmp( dep_type, "C") == 0);
+            ExecRecipe recipe;
+            bool direct = !batched && generateExec( c, recipe, remotable);
+            string script;
+            if( !batched && !direct )
+                script = generateScript( c );
+            
+            if( !batched && !direct && script.length() == 0 )
             {
                 c->has_failed = true;
                 hash_set_add( failed_set, c->file_id);
@@ -932,23 +1584,83 @@ ExecutorCommand Engine::nextCommand()
             }
             else
             {
-                if( verbosity > 0 )
-                    cout << "using " << script << " to produce " << c->file_name << "\n";
-                ec = ExecutorCommand( script, c->file_id);
+                if( batched )
+                {
+                    if( verbosity > 0 )
+                        cout << "compiling " << batch.size() + 1 << " sources in one call, first for " << c->file_name << "\n";
+                }
+                else if( direct )
+                {
+                    if( verbosity > 0 )
+                        cout << "calling " << recipe.argv[0] << " directly to produce " << c->file_name << "\n";
+                    vector<string> args( recipe.argv.begin() + 1, recipe.argv.end());
+                    ec = ExecutorCommand( recipe.argv[0], args, c->file_id);
+                    ec.setEchoOutput( recipe.echo );
+                    ec.setFixedExitCode( recipe.exitCode );
+                }
+                else
+                {
+                    if( verbosity > 0 )
+                        cout << "using " << script << " to produce " << c->file_name << "\n";
+                    ec = ExecutorCommand( script, c->file_id);
+                }
                 validCmds++;
 
-                ec.addFileToRemoveAfterSignal( c->file_name );
+                ec.setTarget( c->file_name, c->dep_type);
+                if( remotable )
+                {
+                    map<string,command_t *> inputs;
+                    collect_inputs( c, inputs);
+                    
+                    vector<string> in, out( 1, c->file_name);
+                    map<string,command_t *>::const_iterator it;
+                    for( it = inputs.begin(); it != inputs.end(); it++)
+                        in.push_back( it->first );
+                    ec.setRemoteFiles( in, out);        // compiles may go to a worker host, everything else stays here
+                }
                 for( int w = 0; w < c->weak_size; w++)
                 {
                     command_t *wait = find_command( c->weak[w] );
                     ec.addFileToRemoveAfterSignal( wait->file_name );
                 }
                 
-                hash_set_remove( to_do_set, c->file_id);
-                hash_set_add( in_work_set, c->file_id);
+                unsigned int job_id = OutputCollector::getTheOutputCollector()->createJob( ec.getFileName(), ec.getArgs(), ec.getFileId());
+                ec.setJobId( job_id );
+                
+                batch.insert( batch.begin(), c);
+                for( size_t b = 0; b < batch.size(); b++)
+                {
+                    command_t *m = batch[b];
+                    ec.addFileToRemoveAfterSignal( m->file_name );
+                    
+                    hash_set_remove( to_do_set, m->file_id);
+                    hash_set_add( in_work_set, m->file_id);
+                    
+                    if( cutoff_candidate( m ) && queryFiles.exists( m->file_name ) )
+                    {
+                        m->has_old_hash = outputHashDb.getHash( m->file_id, queryFiles.getFile( m->file_name ), m->old_hash);
+                        m->old_time = queryFiles.getFile( m->file_name ).getTimeMs();
+                    }
+                    if( actionCache.allowsLink() )      // may be a hard link into the cache from this or an earlier run,
+                        ActionCache::breakLink( m->file_name );      // ar for one updates its archive in place
+                    if( strcmp( m->dep_type, "A") == 0 )   // ar keeps members it is not given, like dropped unity bundles
+                        ::unlink( m->file_name );
+                    
+                    m->job_id = job_id;
+                }
+                
+                c->pool = pool_of( c );               // a batch runs one compile after the other, it counts once
+                if( c->pool >= 0 )
+                    pools[ c->pool ].busy++;
+                if( memAdmit )
+                {
+                    for( size_t b = 0; b < batch.size(); b++)
+                        c->mem_kb = max( c->mem_kb, predicted_rss_kb( batch[b] ));
+                    memInWorkKb += c->mem_kb;
+                }
                 
-                c->job_id = OutputCollector::getTheOutputCollector()->createJob( ec.getFileName(), ec.getArgs(), ec.getFileId());
-                ec.setJobId( c->job_id );
+                if( batched )
+                    batches[ c->file_id ] = vector<command_t *>( batch.begin() + 1, batch.end());
             }
         }
     }
@@ -999,8 +1711,55 @@ void Engine::indicateDone( int file_id, unsigned int job_id, long long curr_time
     command_t *c = find_command( file_id );
     assert( c );
     
+    JobUsage u = OutputCollector::getTheOutputCollector()->getJobUsage( job_id );
+    bool ok;
+    
+    map<int,vector<command_t *> >::iterator bit = batches.find( file_id );
+    if( bit == batches.end() )
+        ok = finish_command( c, job_id, curr_time, u, 0);
+    else
+    {
+        vector<command_t *> batch = bit->second;
+        batches.erase( bit );
+        batch.insert( batch.begin(), c);
+        
+        vector<string> srcs, logs;
+        for( size_t b = 0; b < batch.size(); b++)
+        {
+            vector<string> rest;
+            string in, echo;
+            batch_recipe( batch[b], rest, in, echo);
+            srcs.push_back( in );
+        }
+        split_batch_log( OutputCollector::getTheOutputCollector()->getJobOut( job_id ), srcs, logs);
+        
+        u.wall_ms /= batch.size();
+        ok = true;
+        for( size_t b = 0; b < batch.size(); b++)
+            if( !finish_command( batch[b], job_id, curr_time, u, &logs[b]) )
+                ok = false;
+    }
+    
+    OutputCollector::getTheOutputCollector()->setJobError( job_id, !ok);
+}
+
+
+// log: what the job printed for c, 0 if the whole output of the job
+bool Engine::finish_command( command_t *c, unsigned int job_id, long long curr_time, const JobUsage &u, const string *log)
+{
     hash_set_remove( in_work_set, c->file_id);
     hash_set_remove( targets_left, c->file_id);
+    if( c->pool >= 0 )
+    {
+        pools[ c->pool ].busy--;
+        c->pool = -1;
+    }
+    memInWorkKb -= c->mem_kb;
+    c->mem_kb = 0;
+    
+    usageDb.set( c->file_id, u);
+    if( u.valid )
+        PerfHistory::getThePerfHistory()->addJob( c->file_id, c->dep_type, c->file_name, u.wall_ms, u.maxrss_kb);
     
     bool exists = queryFiles.exists( c->file_name );
     bool proper = false;    
@@ -1066,6 +1825,28 @@ void Engine::indicateDone( int file_id, unsigned int job_id, long long curr_time
             c->is_done = true;
             hash_set_add( done_set, c->file_id);
             all_proper = true;
+            
+            unsigned long long h;
+            const File f = queryFiles.getFile( c->file_name );
+            if( cutoff_candidate( c ) && ContentHashDb::hashFile( c->file_name, h) )
+            {
+                outputHashDb.setHash( c->file_id, f, h);
+                
+                if( c->has_old_hash && c->old_hash == h )
+                {
+                    c->output_unchanged = true;
+                    if( verbosity > 0 )
+                        cout << "early cutoff   " << c->file_name << " (" << c->file_id << ") rebuilt unchanged\n";
+                }
+            }
+            
+            if( c->has_cache_key )
+            {
+                const string &jobLog = log ? *log : OutputCollector::getTheOutputCollector()->getJobOut( job_id );
+                if( actionCache.isEnabled() )
+                    actionCache.store( c->cache_key, c->file_name, jobLog);
+                remoteCache.store( c->cache_key, c->file_name, jobLog);
+            }
         }
     }
     
@@ -1081,14 +1862,11 @@ void Engine::indicateDone( int file_id, unsigned int job_id, long long curr_time
             ss << "\nTarget " << c->file_name << " has FAILED\n\n";
             OutputCollector::getTheOutputCollector()->cursesAppend( job_id, ss.str());
         }
-        
-        OutputCollector::getTheOutputCollector()->setJobError( job_id, true);
     }
     else
-    {
         hash_set_remove( global_mbd_set, c->file_id);
-        OutputCollector::getTheOutputCollector()->setJobError( job_id, false);
-    }
+    
+    return all_proper;
 }
 
 
@@ -1223,22 +2001,37 @@ void Engine::analyzeResults()
 
 int Engine::doWork( ExecutorBase &executor, bool printTimes, const set<string> &userTargets)
 {
-    init_timer();
+    PhaseScope scope( printTimes, "engine");
     
     doPointers();    
     readScfsTimes();
+    usageDb.read( dbProjDir );
+    if( memAdmit )
+        average_type_rss();
+    if( contentHash )
+        contentHashDb.read( dbProjDir );
+    else
+        ContentHashDb::remove( dbProjDir, "ferret_content_hash");   // would miss changes made meanwhile
+    if( earlyCutoff )
+        outputHashDb.read( dbProjDir );
+    if( actionCache.isEnabled() || remoteCache.isEnabled() )
+        inputHashDb.read( dbProjDir );
     
     traverse_for_dominator_sets();       // for this, the dependency graph needs to be cycle free (i.e. must be a DAG)
-    if( printTimes )
-        cout << "traverse dependencies for dominators took " << get_diff() << "s\n";
+    phase_end( printTimes, "traverse dependencies for dominators");
     
     checkUserTargets( userTargets );
     
     fill_target_set();
+    int numTargets = hash_set_get_size( all_targets ), numBuildable = 0;
+    for( size_t n = 0; n < file_ids.size(); n++)
+        if( strcmp( find_command( file_ids[n] )->dep_type, "D") != 0 && strcmp( find_command( file_ids[n] )->dep_type, "W") != 0 )
+            numBuildable++;
+    if( contentHash )
+        contentHashDb.write();
     
     FindFiles::clearCache();
-    if( printTimes )
-        cout << "checking file state and timestamps took " << get_diff() << "s\n";
+    phase_end( printTimes, "checking file state and timestamps");
     round = 1;
     hash_set_union( targets_left, all_targets);
     
@@ -1253,7 +2046,9 @@ int Engine::doWork( ExecutorBase &executor, bool printTimes, const set<string> &
         else
             cout << "-------------- ROUND 1 --------------\n";
         
+        ScriptManager::getTheScriptManager()->startPregen();
         executor.processCommands( *this );   // do it!
+        ScriptManager::getTheScriptManager()->stopPregen();
 
         if( curses )
             OutputCollector::getTheOutputCollector()->cursesDisable();
@@ -1269,23 +2064,41 @@ int Engine::doWork( ExecutorBase &executor, bool printTimes, const set<string> &
             analyzeResults();
         }
         
+        if( cutOffs > 0 && !curses )
+            cout << cutOffs << " target(s) skipped by early cutoff.\n";
+        if( batchedCmds > 0 && !curses )
+            cout << batchedCmds << " compile(s) shared a compiler call with others of their node.\n";
+        if( memWaits > 0 && !curses )
+            cout << memWaits << " job(s) waited for memory, predicted peak RSS exceeded " << memBudgetKb / 1024 << " MB.\n";
+        
         writeScfsTimes();
+        usageDb.prune( file_ids );
+        usageDb.write();
+        if( earlyCutoff )
+            outputHashDb.write();
+        if( actionCache.isEnabled() || remoteCache.isEnabled() )
+            inputHashDb.write();
+        if( actionCache.isEnabled() )
+        {
+            actionCache.trim();
+            if( !curses )
+                actionCache.printStats();
+        }
+        if( remoteCache.isEnabled() && !curses )
+            remoteCache.printStats();
     }
     else
-        cout << "Target set empty for compile mode '" << compileMode << "'. Nothing to do for our beloved ferret.\n";
-    
-    if( printTimes )
-        cout << "build took " << get_diff() << "s\n";
-
-    if( !executor.isInterruptedBySignal() )
     {
-        ofstream osh( "last_run.html" );
-        OutputCollector::getTheOutputCollector()->html( osh );
-        
-        ofstream ost( "last_run.txt" );
-        OutputCollector::getTheOutputCollector()->text( ost );
+        cout << "Target set empty for compile mode '" << compileMode << "'. Nothing to do for our beloved ferret.\n";
+        OutputCollector::getTheOutputCollector()->reportBegin( getReportName() );
     }
     
+    OutputCollector::getTheOutputCollector()->reportEnd();      // adds what analyzeResults() found
+    
+    phase_end( printTimes, "build");
+    
+    PerfHistory::getThePerfHistory()->setRunInfo( compileMode, executor.getMaxParallel(), numTargets, hash_set_get_size( failed_set ),
+                                                  numTargets >= numBuildable);
     return 0;
 }
  
@@ -1299,7 +2112,7 @@ void MakefileEngine::addMakeCommand( data_t *cmd )
 
 int MakefileEngine::doWork( ExecutorBase &executor, bool printTimes, const set<string> &userTargets)
 {
-    init_timer();
+    PhaseScope scope( printTimes, "makefile");
     
     fp = fopen( fileName.c_str(), "w");
     if( !fp )
@@ -1314,8 +2127,7 @@ int MakefileEngine::doWork( ExecutorBase &executor, bool printTimes, const set<s
 
     fclose( fp );
     
-    if( printTimes )
-        cout << "makefile generation and write took " << get_diff() << "s\n";
+    phase_end( printTimes, "makefile generation and write");
     
     return 0;
 }
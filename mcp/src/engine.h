@@ -3,11 +3,17 @@
 
 #include <vector>
 #include <set>
+#include <map>
 
 #include "hash_set.h"
 #include "file_map.h"
 #include "executor.h"
 #include "find_files.h"
+#include "script_template.h"
+#include "usage_db.h"
+#include "content_hash_db.h"
+#include "action_cache.h"
+#include "remote_cache.h"
 
 class FileManager;
 
@@ -22,6 +28,8 @@ public:
     virtual int doWork( ExecutorBase &executor, bool printTimes, const std::set<std::string> &userTargets = std::set<std::string>()) = 0;
     virtual ExecutorCommand nextCommand() = 0;
     virtual void indicateDone( int file_id, unsigned int job_id, long long curr_time);
+    virtual std::string getReportName() const        // <name>.html/.txt/.jsonl written by the executor
+    { return "last_run"; }
     
 protected:
     int errors;
@@ -62,6 +70,8 @@ public:
     virtual int doWork( ExecutorBase &executor, bool printTimes, const std::set<std::string> &userTargets = std::set<std::string>());
     virtual ExecutorCommand nextCommand();
     virtual void indicateDone( int file_id, unsigned int job_id, long long curr_time);
+    virtual std::string getReportName() const
+    { return "last_sync_run"; }
     
     bool hasCommands() const
     { return commands.size(); }
@@ -112,6 +122,17 @@ class Engine : public EngineBase
         bool user_selected;         // true for all targets if no user targets given
         long long scfs_time;        // only valid if scfs is active
         
+        bool has_old_hash;          // early cutoff: hash of the output before the job ran
+        unsigned long long old_hash;
+        long long old_time;         // mtime of that output, what targets depending on it were built against
+        bool output_unchanged;      // rebuilt byte-identical or skipped by early cutoff
+        bool has_cache_key;         // action cache miss, output is stored under cache_key when done
+        char cache_key[ 65 ];
+        int pool;                   // concurrency pool the running job counts against, -1 if none
+        long long mem_kb;           // predicted peak RSS counted while in work
+        bool mem_waited;            // was passed over for lack of memory at least once
+        int mem_passed;             // how many jobs behind it started while it waited for memory
+        
     } command_t;
     
 
@@ -147,14 +168,33 @@ private:
     
     bool prereqs_done( command_t *c );
     std::string generateScript( command_t *c );
+    bool generateExec( command_t *c, ExecRecipe &recipe, bool remotable);
     
     bool make_target_by_wait( command_t *c );
     void make_targets_by_dom_set( command_t *c );
+    long long source_time( command_t *c, const File &f);
     void fill_target_set();
 
+    bool cutoff_candidate( command_t *c );
+    bool can_cut_off( command_t *c );
+    void cut_off( command_t *c );
+    void mark_done_early( command_t *c );
+    
+    bool cacheable( command_t *c );
+    void collect_inputs( command_t *c, std::map<std::string,command_t *> &inputs);
+    bool action_key( command_t *c, std::string &key);
+    bool cache_lookup( command_t *c );
     void move_wavefront();
     
     void build_to_do_array();
+    int  pool_of( command_t *c );
+    long long predicted_rss_kb( command_t *c );
+    void average_type_rss();
+    bool pick_admissible();
+    void move_to_pos( int i );
+    bool batch_recipe( command_t *c, std::vector<std::string> &rest, std::string &in, std::string &echo);
+    bool make_batch( command_t *c, std::vector<command_t *> &batch, ExecutorCommand &ec);
+    bool finish_command( command_t *c, unsigned int job_id, long long curr_time, const JobUsage &u, const std::string *log);
     
 public:
     virtual ExecutorCommand nextCommand();
@@ -163,6 +203,28 @@ public:
     void setStopOnError( bool stop )
     { stopOnError = stop; }
     
+    void setContentHash( bool en )
+    { contentHash = en; }
+    
+    void setEarlyCutoff( bool en )
+    { earlyCutoff = en; }
+    
+    void setActionCache( const std::string &dir, long long maxMb, bool link)
+    { actionCache.setup( dir, maxMb, link); }
+    
+    void setRemoteCache( const std::string &url, bool upload)
+    { remoteCache.setup( url, upload); }
+    
+    void setRemoteExec( bool en )
+    { remoteExec = en; }
+    
+    void addPool( const std::string &name, int size, const std::string &types);
+    
+    void setBatchSize( int n )      // C++ sources of a node compiled by one compiler call
+    { batchSize = n; }
+    
+    void setMemAdmission( long long budgetMb, long long defaultMb);   // budget 0: what /proc/meminfo says is available
+    
 private:
     void traverseUserTargets( command_t *c, int level = 0);
     void checkUserTargets( const std::set<std::string> &userTargets );
@@ -191,9 +253,30 @@ private:
     int to_do_cmd_pos, to_do_cmd_size;
     
     int round, validCmdsLastRound;
-    bool scfs, stopOnError;
+    bool scfs, stopOnError, contentHash, earlyCutoff, remoteExec;
+    int cutOffs;
 
     QueryFiles queryFiles;
+    UsageDb usageDb;
+    ContentHashDb contentHashDb, outputHashDb, inputHashDb;
+    ActionCache actionCache;
+    RemoteCache remoteCache;
+    
+    typedef struct pool {
+        std::string name;
+        int size, busy;
+    } pool_t;
+    
+    std::vector<pool_t> pools;
+    std::map<std::string,int> typePools;       // dep type -> index in pools
+    
+    bool memAdmit, memWatchFree;               // memWatchFree: also what is free now, no budget was given
+    long long memBudgetKb, memDefaultKb, memInWorkKb;
+    std::map<std::string,long long> typeRssKb; // dep type -> average peak RSS in the usage db
+    int memWaits;
+    
+    int batchSize, batchedCmds;
+    std::map<int,std::vector<command_t *> > batches;   // first command's file id -> the others compiled with it
 };
 
 
@@ -1,4 +1,5 @@
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -16,6 +17,8 @@
 #include "engine.h"
 #include "glob_utility.h"
 #include "output_collector.h"
+#include "build_trace.h"
+#include "phase_profiler.h"
 
 using namespace std;
 
@@ -130,6 +133,7 @@ static pid_t execCmd( const string &ex, ExecutorCommand &cmd, vector<string> arg
         exit(1);
     }
     
+    prof_count( PROF_FORK );
     if( (child_pid = fork()) < 0 )
     {
         perror("fork failure");
@@ -157,7 +161,7 @@ static pid_t execCmd( const string &ex, ExecutorCommand &cmd, vector<string> arg
             newargv[k++] = strdup( args[i].c_str() );
         newargv[k] = 0;
         
-        execv( ex.c_str(), newargv);
+        execvp( ex.c_str(), newargv);     // same as execv() for paths containing a slash
         perror("exec");   // exec..() returns only on error
 
         _exit(1);
@@ -201,6 +205,19 @@ pid_t Executor::processCommand( ExecutorCommand &cmd )
         args.insert( args.begin(), cmd.getFileName());
         pid = execCmd( "/bin/sh", cmd, args);
     }
+    else if( cmd.getCmdType() == "EXEC" )
+    {
+        if( cmd.getEchoOutput().length() > 0 )
+        {
+            OutputCollector *oc = OutputCollector::getTheOutputCollector();
+            
+            oc->appendJobStd( cmd.getJobId(), cmd.getEchoOutput());
+            if( curses )
+                oc->cursesAppend( cmd.getJobId(), cmd.getEchoOutput());
+        }
+        
+        pid = execCmd( cmd.getFileName(), cmd, cmd.getArgs());
+    }
     else if( cmd.getCmdType() == "BARRIER" )
     {
         if( verbosity > 0 )
@@ -225,47 +242,72 @@ pid_t Executor::processCommand( ExecutorCommand &cmd )
 }
 
 
-void Executor::readOutput( const ExecutorCommand &cmd )
+// whole lines only, so that a prefix split over two reads is found. last: the rest too, the program has ended
+string ExecutorCommand::stripOutput( int fd, const string &s, bool last)
+{
+    if( outputPrefix.length() == 0 )
+        return s;
+    
+    string &partial = fd == stdout_filedes ? partialStd : partialErr;
+    partial += s;
+    
+    size_t nl = partial.rfind( '\n' );
+    size_t end = last ? partial.length() : (nl == string::npos ? 0 : nl + 1);
+    string out = partial.substr( 0, end);
+    partial.erase( 0, end);
+    
+    size_t pos = 0;
+    while( (pos = out.find( outputPrefix, pos)) != string::npos )
+        out.erase( pos, outputPrefix.length());
+    
+    return out;
+}
+
+
+void Executor::readOutput( ExecutorCommand &cmd, bool last)
 {
     OutputCollector *oc = OutputCollector::getTheOutputCollector();
     int count;
-    char buffer[1025];
+    char buffer[4096];
     string b;
             
-    while( (count = read( cmd.getStdoutFiledes(), buffer, 1024)) > 0 )
+    while( (count = read( cmd.getStdoutFiledes(), buffer, sizeof(buffer))) > 0 || last )    // last: once more for the rest
     {
-        buffer[count] = 0;
-        b = buffer;
+        b = cmd.stripOutput( cmd.getStdoutFiledes(), string( buffer, max( count, 0)), count <= 0);
         
-        oc->appendJobOut( cmd.getJobId(), b);
-        oc->appendJobStd( cmd.getJobId(), b);
-        if( curses )
-            oc->cursesAppend( cmd.getJobId(), b);
+        if( b.length() > 0 )
+        {
+            oc->appendJobStd( cmd.getJobId(), b);
+            if( curses )
+                oc->cursesAppend( cmd.getJobId(), b);
+        }
+        if( count <= 0 )
+            break;
     }
     
-    while( (count = read( cmd.getStderrFiledes(), buffer, 1024)) > 0 )
+    while( (count = read( cmd.getStderrFiledes(), buffer, sizeof(buffer))) > 0 || last )
     {
-        buffer[count] = 0;
-        b = buffer;
+        b = cmd.stripOutput( cmd.getStderrFiledes(), string( buffer, max( count, 0)), count <= 0);
         
-        oc->appendJobOut( cmd.getJobId(), b);
         oc->appendJobErr( cmd.getJobId(), b);
-        if( curses )
+        if( curses && b.length() > 0 )
         {
             oc->cursesAppend( cmd.getJobId(), b);
             oc->cursesSetStderr( cmd.getJobId() );
         }
+        if( count <= 0 )
+            break;
     }
 }
 
 
 void Executor::readOutputs()
 {
-    map<pid_t,ExecutorCommand>::const_iterator pit = pidToCmdMap.begin();
+    map<pid_t,ExecutorCommand>::iterator pit = pidToCmdMap.begin();
     
     for( pit = pidToCmdMap.begin(); pit != pidToCmdMap.end(); pit++)
     {
-        const ExecutorCommand &cmd = pit->second;
+        ExecutorCommand &cmd = pit->second;
         if( cmd.state == ExecutorCommand::PROCESSING && cmd.getCmdType() != "BARRIER" && cmd.getCmdType() != "FINALIZE" )
         {
             readOutput( cmd );
@@ -296,6 +338,8 @@ void Executor::checkExitState( ExecutorCommand &cmd, int status, EngineBase &eng
         if( verbosity > 2 )
             cout << "checking exit state of job " << cmd.getJobId() << "\n";
         cmd.returnCode = WEXITSTATUS(status);
+        if( cmd.getFixedExitCode() >= 0 )       // direct exec, the script would have ended with exit <n>
+            cmd.returnCode = cmd.getFixedExitCode();
         if( cmd.returnCode != 0 )
         {
             errors++;
@@ -326,7 +370,6 @@ void Executor::checkExitState( ExecutorCommand &cmd, int status, EngineBase &eng
         
         if( terminate_by_signal )
         {
-            OutputCollector::getTheOutputCollector()->appendJobOut( cmd.getJobId(), "\nProcess terminated by signal from parent");
             OutputCollector::getTheOutputCollector()->appendJobErr( cmd.getJobId(), "\nProcess terminated by signal from parent");
         }
         
@@ -378,11 +421,12 @@ void Executor::checkStates( EngineBase &engine )
         nanosleep( &t, 0);
     
     int status;
-    pid_t p = waitpid( -1, &status, WNOHANG);
+    struct rusage ru;
+    pid_t p = wait4( -1, &status, WNOHANG, &ru);
 
     if( p<0 )
     {
-        cerr << "error: waitpid returned -1\n";
+        cerr << "error: wait4 returned -1\n";
         return;
     }
             
@@ -412,7 +456,7 @@ void Executor::checkStates( EngineBase &engine )
         ExecutorCommand &cmd = it->second;
         OutputCollector *oc = OutputCollector::getTheOutputCollector();
         
-        readOutput( cmd );
+        readOutput( cmd, true);
         
         if( curses )
             oc->cursesEnd( cmd.getJobId() );
@@ -437,7 +481,10 @@ void Executor::checkStates( EngineBase &engine )
             cout << out;
         }
         
+        recordUsage( cmd, ru);
         checkExitState( cmd, status, engine);
+        releaseSlot( cmd, status);
+        oc->reportJob( cmd.getJobId() );
     }
     
     map<pid_t,ExecutorCommand> help;  // warning: std::map.erase() behaviour has changed with gcc 5 onwards. Don't use!
@@ -451,16 +498,9 @@ void Executor::checkStates( EngineBase &engine )
             help[ pit->first ] = pit->second;
     }
     pidToCmdMap = help;
+    jobServer.releaseSurplus( localChildren() );
 
-    if( (curr_time - html_timer) > 20000 )
-    {
-        html_timer = curr_time;
-
-        ofstream osh( "last_run.html" );
-        OutputCollector::getTheOutputCollector()->html( osh );
-    }
-    
-    if( pidToCmdMap.size() == 1 )
+    if( pidToCmdMap.size() == 1 && inFlight() == 1 )
     {
         pit = pidToCmdMap.begin();
         ExecutorCommand &cmd = pit->second;
@@ -483,11 +523,9 @@ void Executor::processCommands( EngineBase &engine )
 
     start_time_ms = last_time_ms = get_curr_time_ms();
     sample_calls = 0;
-    html_timer = start_time_ms;
     
-    ofstream osh( "last_run.html" );
-    OutputCollector::getTheOutputCollector()->resetHtml( osh );
-    osh.close();
+    OutputCollector::getTheOutputCollector()->reportBegin( engine.getReportName() );
+    slotBusy.assign( maxParallel, false);
     
     terminate_by_signal = false;
     set_signal_handler();
@@ -501,12 +539,12 @@ void Executor::processCommands( EngineBase &engine )
         
         if( barrierMode )
         {
-            while( pidToCmdMap.size() > 0 && !terminate_by_signal )
-                checkStates( engine );
+            while( inFlight() > 0 && !terminate_by_signal )
+                progress( engine );
         }
         else
         {
-            while( !done && !barrierMode && !finalizeMode && pidToCmdMap.size() < maxParallel && !terminate_by_signal )
+            while( !done && !barrierMode && !finalizeMode && hasRoom() && !terminate_by_signal )
             {
                 ExecutorCommand cmd = engine.nextCommand();
                 
@@ -525,23 +563,18 @@ void Executor::processCommands( EngineBase &engine )
                     break;
                 }
                 
+                if( cmd.getCmdType() == "WAIT" )     // engine's pools are full, ask again after a job finished
+                    break;
+                
                 cmd.state = ExecutorCommand::PROCESSING;
-                cmd.pid = processCommand( cmd );
-
-                if( cmd.pid < 0 )
+                if( divert( cmd ) )
+                    continue;
+                
+                if( !startLocal( cmd ) )
                 {
-                    cmd.state = ExecutorCommand::FAILED;
-                    cerr << "error: could not start process.\n";
                     done = true;
                     break;
                 }
-                else
-                {
-                    pidToCmdMap[ cmd.pid ] = cmd;
-                    
-                    if( curses )
-                        OutputCollector::getTheOutputCollector()->cursesTopShowJob( cmd.getJobId() );
-                }
             }
         }
 
@@ -551,8 +584,8 @@ void Executor::processCommands( EngineBase &engine )
             finalizeMode = true;
         }
         
-        if( !finalizeMode && pidToCmdMap.size() > 0 )
-            checkStates( engine );
+        if( !finalizeMode && inFlight() > 0 )
+            progress( engine );
     } while( !done && errors == 0 && !finalizeMode );
     
     if( terminate_by_signal )
@@ -572,20 +605,122 @@ void Executor::processCommands( EngineBase &engine )
     }
     else
     {
-        html_timer = curr_time;
-        if( pidToCmdMap.size() > 0 )
+        if( inFlight() > 0 )
         {
             cout << "Waiting for unfinished jobs...\n";
             
-            while( pidToCmdMap.size() > 0 )
-                checkStates( engine );
+            while( inFlight() > 0 )
+                progress( engine );
         }
     }
     
+    jobServer.releaseAll();
+    if( !curses )
+        loadCtl.printStats();
     restore_signal_handler();
 }
 
 
+void Executor::setupJobServer( bool serve )
+{
+    const char *makeflags = getenv( "MAKEFLAGS" );
+    
+    if( makeflags && jobServer.attach( makeflags ) )
+        return;
+    if( serve )
+        jobServer.create( maxParallel );
+}
+
+
+bool Executor::localRoom()
+{
+    size_t running = localChildren();
+    return running < loadCtl.limit( maxParallel, running) && jobServer.reserve( running );
+}
+
+
+bool Executor::startLocal( ExecutorCommand &cmd )
+{
+    cmd.pid = processCommand( cmd );
+    
+    if( cmd.pid < 0 )
+    {
+        cmd.state = ExecutorCommand::FAILED;
+        cerr << "error: could not start process.\n";
+        return false;
+    }
+    
+    if( cmd.pid > 0 )
+    {
+        cmd.slot = acquireSlot();
+        cmd.start_us = get_curr_time_us();
+    }
+    pidToCmdMap[ cmd.pid ] = cmd;
+    
+    if( curses )
+        OutputCollector::getTheOutputCollector()->cursesTopShowJob( cmd.getJobId() );
+    return true;
+}
+
+
+size_t Executor::localChildren() const         // without a BARRIER entry
+{
+    map<pid_t,ExecutorCommand>::const_iterator pit;
+    size_t n = 0;
+    
+    for( pit = pidToCmdMap.begin(); pit != pidToCmdMap.end(); pit++)
+        if( pit->first > 0 )
+            n++;
+    return n;
+}
+
+
+void Executor::recordUsage( const ExecutorCommand &cmd, const struct rusage &ru)
+{
+    JobUsage u;
+    
+    u.valid = true;
+    u.wall_ms = (get_curr_time_us() - cmd.start_us) / 1000;
+    u.utime_ms = (long long)ru.ru_utime.tv_sec * 1000 + ru.ru_utime.tv_usec / 1000;
+    u.stime_ms = (long long)ru.ru_stime.tv_sec * 1000 + ru.ru_stime.tv_usec / 1000;
+    u.maxrss_kb = ru.ru_maxrss;
+    u.inblock = ru.ru_inblock;
+    u.oublock = ru.ru_oublock;
+    u.nvcsw = ru.ru_nvcsw;
+    u.nivcsw = ru.ru_nivcsw;
+    
+    OutputCollector::getTheOutputCollector()->setJobUsage( cmd.getJobId(), u);
+}
+
+
+int Executor::acquireSlot()
+{
+    for( size_t i = 0; i < slotBusy.size(); i++)
+        if( !slotBusy[i] )
+        {
+            slotBusy[i] = true;
+            return i;
+        }
+    
+    slotBusy.push_back( true );
+    return slotBusy.size() - 1;
+}
+
+
+void Executor::releaseSlot( ExecutorCommand &cmd, int status)
+{
+    if( cmd.slot < 0 || cmd.slot >= (int)slotBusy.size() )
+        return;
+    
+    slotBusy[ cmd.slot ] = false;
+    
+    int exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : -WTERMSIG(status);
+    BuildTrace::getTheBuildTrace()->addJob( cmd.slot, cmd.getTargetName(), cmd.getDepType(), cmd.getJobId(), cmd.getFileId(), exitCode,
+                                            cmd.start_us, get_curr_time_us());
+    cmd.slot = -1;
+}
+
+
 bool Executor::isInterruptedBySignal() const
 {
     return terminate_by_signal;
@@ -604,11 +739,12 @@ void Executor::cleanUpAfterSignal( int signum, EngineBase &engine)
         if( pit->second.pid > 0 && pit->second.state == ExecutorCommand::PROCESSING )
         {
             int status;
-            pid_t p = waitpid( pit->second.pid, &status, 0);
+            struct rusage ru;
+            pid_t p = wait4( pit->second.pid, &status, 0, &ru);
             
             if( p < 0 )
             {
-                cerr << "error: waitpid returned -1\n";
+                cerr << "error: wait4 returned -1\n";
                 return;
             }
             
@@ -617,7 +753,10 @@ void Executor::cleanUpAfterSignal( int signum, EngineBase &engine)
                 map<pid_t,ExecutorCommand>::iterator it = pidToCmdMap.find( p );
                 if( it != pidToCmdMap.end() )
                 {
+                    recordUsage( it->second, ru);
                     checkExitState( it->second, status, engine);
+                    releaseSlot( it->second, status);
+                    OutputCollector::getTheOutputCollector()->reportJob( it->second.getJobId() );
                 }
                 else
                     cerr << "error: a child exited that we do not know (pid = " << p << ")\n";
@@ -7,7 +7,11 @@
 #include <set>
 #include <list>
 
+#include "jobserver.h"
+#include "load_controller.h"
+
 class EngineBase;
+struct rusage;
 
 class ExecutorBase {
 public:
@@ -38,27 +42,32 @@ public:
     typedef enum { INVALID=0, WAITING, PROCESSING, DONE, FAILED} state_t;
     
     ExecutorCommand()
-        : jobid(-1), cmdType("invalid"), state(INVALID), pid(-1)
+        : jobid(-1), cmdType("invalid"), fixedExitCode(-1), state(INVALID), pid(-1), slot(-1), start_us(0)
     {
     }
     
     ExecutorCommand( unsigned int id, const std::string &type)
-        : jobid(id), cmdType(type), file_id(-1), state(WAITING), pid(-1)
+        : jobid(id), cmdType(type), file_id(-1), fixedExitCode(-1), state(WAITING), pid(-1), slot(-1), start_us(0)
     {
     }
     
     ExecutorCommand( const std::string &fn, int file_id)
-        : jobid(-1), cmdType("EXSH"), fileName(fn), file_id(file_id), state(WAITING), pid(-1)
+        : jobid(-1), cmdType("EXSH"), fileName(fn), file_id(file_id), fixedExitCode(-1), state(WAITING), pid(-1), slot(-1), start_us(0)
     {
     }
     
     ExecutorCommand( const std::string &fn, const std::vector<std::string> &args)
-        : jobid(-1), cmdType("EXSH"), fileName(fn), args(args), file_id(-1), state(WAITING), pid(-1)
+        : jobid(-1), cmdType("EXSH"), fileName(fn), args(args), file_id(-1), fixedExitCode(-1), state(WAITING), pid(-1), slot(-1), start_us(0)
+    {
+    }
+    
+    ExecutorCommand( const std::string &prog, const std::vector<std::string> &args, int file_id)    // direct exec, no shell
+        : jobid(-1), cmdType("EXEC"), fileName(prog), args(args), file_id(file_id), fixedExitCode(-1), state(WAITING), pid(-1), slot(-1), start_us(0)
     {
     }
     
     ExecutorCommand( const std::vector<std::string> &args )    // for dependency file generation
-        : jobid(-1), cmdType("DEP"), args(args), file_id(-1), state(WAITING), pid(-1)
+        : jobid(-1), cmdType("DEP"), args(args), file_id(-1), fixedExitCode(-1), state(WAITING), pid(-1), slot(-1), start_us(0)
     {
     }
 
@@ -93,20 +102,57 @@ public:
     int getStderrFiledes() const
     { return stderr_filedes; }
 
+    void setEchoOutput( const std::string &e )
+    { echoOutput = e; }
+    std::string getEchoOutput() const
+    { return echoOutput; }
+    void setFixedExitCode( int c )
+    { fixedExitCode = c; }
+    int getFixedExitCode() const
+    { return fixedExitCode; }
+    void setOutputPrefix( const std::string &p )     // removed from what the program prints
+    { outputPrefix = p; }
+    std::string stripOutput( int fd, const std::string &s, bool last);
+
+    void setTarget( const std::string &fn, const std::string &type)     // what the command produces, for --trace
+    { targetName = fn; depType = type; }
+    std::string getTargetName() const
+    { return targetName.length() > 0 ? targetName : fileName; }
+    std::string getDepType() const
+    { return depType.length() > 0 ? depType : cmdType; }
+    
+    void setRemoteFiles( const std::vector<std::string> &in, const std::vector<std::string> &out)    // may run on a worker host
+    { remoteInputs = in; remoteOutputs = out; }
+    bool isRemotable() const
+    { return remoteOutputs.size() > 0; }
+    const std::vector<std::string> &getRemoteInputs() const
+    { return remoteInputs; }
+    const std::vector<std::string> &getRemoteOutputs() const
+    { return remoteOutputs; }
+
 private:
     unsigned int jobid;
-    std::string cmdType;   // DEP = dependencies, EXSH = execute sh script, BARRIER, FINALIZE
+    std::string cmdType;   // DEP = dependencies, EXSH = execute sh script, EXEC = execute program, BARRIER, FINALIZE
     std::string fileName;
     std::vector<std::string> args;
     int file_id;
     std::vector<std::string> filesToRemoveAfterSignal;
     int stdout_filedes;
     int stderr_filedes;
+    std::string echoOutput;   // EXEC only, output of the echo lines of the script it replaces
+    int fixedExitCode;        // EXEC only, exit code of the script it replaces, -1 to use the one of the program
+    std::string outputPrefix; // a compile with absolute paths shows them relative to the project root
+    std::string partialStd, partialErr;     // output after the last newline, while outputPrefix is set
+    std::string targetName;
+    std::string depType;
+    std::vector<std::string> remoteInputs, remoteOutputs;
     
 public:
     state_t state;
     pid_t pid;
     int returnCode;
+    int slot;                 // executor slot while processing
+    long long start_us;
 };
 
 
@@ -124,19 +170,38 @@ public:
     { return maxParallel; }
     
     pid_t processCommand( ExecutorCommand &cmd );
+    void setupJobServer( bool serve );      // client if MAKEFLAGS has one, else server if serve
+    void setupAdaptive( unsigned int minParallel, int intervalMs)
+    { loadCtl.setup( minParallel, maxParallel, intervalMs); }
     
     virtual void processCommands( EngineBase &engine );
     virtual bool isInterruptedBySignal() const;
     
-private:
-    void cleanUpAfterSignal( int signum, EngineBase &engine);
-    void readOutput( const ExecutorCommand &cmd );
+protected:
+    // hooks for executors that run some of the commands elsewhere (see RemoteExecutor)
+    virtual bool hasRoom()                              // may fetch another command from the engine
+    { return localRoom(); }
+    virtual bool divert( ExecutorCommand &cmd )        // true if cmd was taken over and must not be started here
+    { return false; }
+    virtual size_t inFlight() const                     // jobs not finished yet
+    { return pidToCmdMap.size(); }
+    virtual void progress( EngineBase &engine )         // wait a bit and handle finished jobs
+    { checkStates( engine ); }
+    virtual void cleanUpAfterSignal( int signum, EngineBase &engine);
+    
+    bool localRoom();                                   // for one more local job, takes a jobserver token if needed
+    bool startLocal( ExecutorCommand &cmd );
+    size_t localChildren() const;
+    void readOutput( ExecutorCommand &cmd, bool last = false);
     void readOutputs();
     long delaySampler();
     void checkExitState( ExecutorCommand &cmd, int status, EngineBase &engine);
     void checkStates( EngineBase &engine );
+    void recordUsage( const ExecutorCommand &cmd, const struct rusage &ru);
+    int  acquireSlot();
+    void releaseSlot( ExecutorCommand &cmd, int status);
     
-private:
+protected:
     unsigned int maxParallel;
     bool curses;
     std::map<pid_t,ExecutorCommand> pidToCmdMap;
@@ -144,8 +209,10 @@ private:
     bool barrierMode, finalizeMode;
     long long start_time_ms, last_time_ms, curr_time;
     unsigned long sample_calls;
-    long long html_timer;
     std::list<std::string> removeUnfinished;
+    std::vector<bool> slotBusy;
+    JobServer jobServer;
+    LoadController loadCtl;
 };
 
 
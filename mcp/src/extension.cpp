@@ -1,5 +1,11 @@
 #include <cassert>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <ctime>
+#include <unistd.h>
 
 #include "extension.h"
 #include "project_xml_node.h"
@@ -9,6 +15,8 @@
 #include "platform_defines.h"
 #include "platform_spec.h"
 #include "script_template.h"
+#include "usage_db.h"
+#include "find_files.h"
 
 using namespace std;
 
@@ -21,6 +29,10 @@ void setupExtensions()
     
     em->addExtension( new BisonExtension(0) );
     
+    em->addExtension( new UnityExtension(0) );
+    
+    em->addExtension( new PchExtension(0) );
+    
     // em->read( "ferret_extensions.xml" );
 }
 
@@ -245,6 +257,455 @@ void BisonExtension::createCommands( FileManager &fileMan, const map<string,stri
     }
 }
 
+// -----------------------------------------------------------------------------
+
+string UnityExtension::getType() const
+{
+    return "unity";
+}
+
+
+ExtensionBase *UnityExtension::createExtensionDriver( ProjectXmlNode *node )
+{
+    return new UnityExtension( node );
+}
+
+
+static bool fileNameLess( const File &a, const File &b)
+{
+    return a.getPath() < b.getPath();
+}
+
+
+// FNV-1a of a file name, decides where unity bundles end
+static unsigned int nameHash( const string &s )
+{
+    unsigned int h = 2166136261U;
+    for( size_t i = 0; i < s.length(); i++)
+        h = (h ^ (unsigned char)s[i]) * 16777619U;
+    return h;
+}
+
+
+// from the object directory back to the project root
+static string upDir( const string &o_outputdir )
+{
+    string updir;
+    if( o_outputdir.length() > 0 && o_outputdir[0] == '/' )
+    {
+        char cwd[ 1025 ];
+        if( getcwd( cwd, 1024) )
+            updir = string( cwd ) + "/";
+    }
+    else
+    {
+        for( size_t i = 0; i < o_outputdir.length(); i++)
+            if( o_outputdir[i] == '/' && (i == 0 || o_outputdir[i-1] != '/') )
+                updir += "../";
+    }
+    
+    return updir;
+}
+
+
+// writes fn when its content differs, so its time only changes with what is in it. false if it could not be written
+static bool writeIfChanged( const string &fn, const string &content)
+{
+    string old;
+    FILE *fp = fopen( fn.c_str(), "r");
+    if( fp )
+    {
+        char buf[ 4096 ];
+        size_t n;
+        while( (n = fread( buf, 1, sizeof(buf), fp)) > 0 )
+            old.append( buf, n);
+        fclose( fp );
+    }
+    
+    if( old != content )
+    {
+        FindFiles::remove( fn );         // so that the next exists check sees the new time
+        fp = fopen( fn.c_str(), "w");
+        if( fp )
+        {
+            fputs( content.c_str(), fp);
+            fclose( fp );
+        }
+    }
+    
+    return FindFiles::exists( fn );
+}
+
+
+void UnityExtension::createCommands( FileManager &fileMan, const map<string,string> &xmlAttribs)
+{
+    assert( getNode() != 0 );
+    
+    int maxFiles = atoi( getAttrib( xmlAttribs, "files").c_str() );
+    long long maxMs = atoll( getAttrib( xmlAttribs, "ms").c_str() );
+    if( maxFiles <= 0 && maxMs <= 0 )
+        maxFiles = 8;
+    
+    set<string> exclude;
+    stringstream exss( getAttrib( xmlAttribs, "exclude") );
+    string ex;
+    while( exss >> ex )
+        exclude.insert( ex );
+    
+    string o_outputdir = getNode()->getObjDir();
+    
+    vector<File> sources, all = getNode()->getFiles();
+    size_t i;
+    for( i = 0; i < all.size(); i++)
+    {
+        string ext = all[i].extension();
+        if( (ext == ".cpp" || ext == ".cc" || ext == ".C") && exclude.find( all[i].getBasename() ) == exclude.end() &&
+            !IncludeManager::getTheIncludeManager()->getModuleUnit( all[i].getPath() ) )    // module units compile alone
+            sources.push_back( all[i] );
+    }
+    sort( sources.begin(), sources.end(), fileNameLess);
+    
+    // compile time of a source from when it was compiled on its own, or its share by size of the bundle it was in,
+    // else estimated from its size. the objects of bundled sources are gone from the files db, the sources are not
+    vector<long long> cost( sources.size(), 0);
+    if( maxMs > 0 )
+    {
+        UsageDb usageDb;
+        usageDb.read( IncludeManager::getTheIncludeManager()->getDbProjDir() );
+        
+        long long knownMs = 0, knownBytes = 0;
+        for( i = 0; i < sources.size(); i++)
+        {
+            string o = o_outputdir + sources[i].woExtension() + ".o";
+            JobUsage u;
+            
+            if( fileMan.hasFileName( o ) && usageDb.get( fileMan.getIdForFile( o ), u) && u.valid )
+                cost[i] = u.wall_ms;
+            else if( fileMan.hasFileName( sources[i].getPath() ) )
+                cost[i] = bundleShare( fileMan, usageDb, fileMan.getIdForFile( sources[i].getPath() ), o_outputdir);
+            
+            if( cost[i] > 0 )
+            {
+                knownMs += cost[i];
+                knownBytes += sources[i].getSize();
+            }
+        }
+        for( i = 0; i < sources.size(); i++)
+            if( cost[i] == 0 )
+                cost[i] = knownBytes > 0 ? sources[i].getSize() * knownMs / knownBytes : maxMs / 8;
+    }
+    
+    string updir = upDir( o_outputdir );   // the unity files include the sources relative to the object directory
+    
+    if( verbosity > 0 )
+        cout << "UNITY Extension for node " << getNode()->getDir() << ": " << sources.size() << " source(s)\n";
+    
+    // a bundle ends where the limit is reached or at a source whose name hash says so, about every files="8"
+    // sources (or ms="..." worth of them). a new source then only moves the boundaries up to the next such name,
+    // not those of all bundles after it
+    size_t spacing = maxFiles > 0 ? maxFiles : 8;
+    if( maxMs > 0 && sources.size() > 0 )
+    {
+        long long sum = 0;
+        for( i = 0; i < sources.size(); i++)
+            sum += cost[i];
+        spacing = sum > 0 ? max( (long long)2, maxMs * (long long)sources.size() / sum) : 2;
+    }
+    spacing *= 2;                  // mostly the limit ends a bundle, the names only bring the boundaries back in step
+    
+    if( sources.size() > 1 )
+        mkdir_p( o_outputdir );    // nothing compiled yet after a clean
+    
+    set<string> bundles;
+    size_t first = 0;
+    while( first < sources.size() )
+    {
+        size_t last = first + 1;
+        long long ms = cost[ first ];
+        while( last < sources.size() &&
+               nameHash( sources[ last ].getBasename() ) % spacing != 0 &&
+               (maxMs > 0 ? ms + cost[ last ] <= maxMs : (int)(last - first) < maxFiles) )
+            ms += cost[ last++ ];
+        
+        if( last - first < 2 )      // alone it is compiled as usual
+        {
+            first = last;
+            continue;
+        }
+        
+        string name = o_outputdir + "ferret_unity_" + sources[ first ].woExtension();   // stays while its first source does
+        string unity_cpp = name + ".cpp";
+        string unity_o = name + ".o";
+        bundles.insert( unity_o );
+        
+        // the include list is written here, whenever its members change, not only when one of them is newer
+        string content;
+        for( i = first; i < last; i++)
+            content += "#include \"" + updir + sources[i].getPath() + "\"\n";
+        if( !writeIfChanged( unity_cpp, content) )
+        {
+            cerr << "Unity Extension: error: could not write '" << unity_cpp << "'.\n";
+            first = last;
+            continue;
+        }
+        
+        if( verbosity > 0 )
+            cout << "Ext cmd for node " << getNode()->getDir() << ": unity " << unity_cpp << " with " << (last - first) << " source(s)\n";
+        
+        file_id_t fid = fileMan.addFile( unity_cpp, getNode());
+        file_id_t cpp_id = fileMan.addCommand( unity_o, "Cpp", getNode());
+        fileMan.addDependency( cpp_id, fid);
+        
+        for( i = first; i < last; i++)
+        {
+            file_id_t tid = fileMan.addFile( sources[i].getPath(), getNode());
+            fileMan.addDependency( cpp_id, tid);
+            addBlockedSourceId( tid );
+        }
+        
+        addBlockedFileId( fid );
+        addBlockedFileId( cpp_id );
+        getNode()->objs.push_back( unity_o );
+        
+        getNode()->pegCppScript( cpp_id, unity_cpp, unity_o);
+        
+        first = last;
+    }
+    
+    dropOldBundles( fileMan, all, bundles, o_outputdir);
+}
+
+
+// bundles of earlier runs that are not made again lose their dependencies, so they go away as unlinked results.
+// their include lists are removed, they would be taken for sources of the node
+void UnityExtension::dropOldBundles( FileManager &fileMan, const vector<File> &all, const set<string> &bundles,
+                                     const string &o_outputdir)
+{
+    string prefix = o_outputdir + "ferret_unity_";
+    hash_set_t *none = new_hash_set( 3 );
+    
+    for( size_t i = 0; i < all.size(); i++)
+    {
+        if( !fileMan.hasFileName( all[i].getPath() ) )
+            continue;
+        
+        set<file_id_t> pre = fileMan.prerequisiteFor( fileMan.getIdForFile( all[i].getPath() ) );
+        set<file_id_t>::const_iterator it;
+        for( it = pre.begin(); it != pre.end(); it++)
+        {
+            string unity_o = fileMan.getFileForId( *it );
+            if( unity_o.compare( 0, prefix.length(), prefix) != 0 || bundles.find( unity_o ) != bundles.end() )
+                continue;
+            
+            if( verbosity > 0 )
+                cout << "Unity bundle " << unity_o << " no longer used.\n";
+            
+            fileMan.compareAndReplaceDependencies( *it, none);
+            
+            string unity_cpp = unity_o.substr( 0, unity_o.length() - 2) + ".cpp";   // else compiled as a source
+            if( fileMan.hasFileName( unity_cpp ) && fileMan.removeFile( unity_cpp ) )
+                FindFiles::remove( unity_cpp );
+        }
+    }
+    
+    delete_hash_set( none );
+}
+
+// the share by size of the last compile of the unity bundle the source was in, 0 if unknown
+long long UnityExtension::bundleShare( FileManager &fileMan, const UsageDb &usageDb, file_id_t src_id, const string &o_outputdir)
+{
+    string prefix = o_outputdir + "ferret_unity_";
+    set<file_id_t> pre = fileMan.prerequisiteFor( src_id );
+    set<file_id_t>::const_iterator it;
+    
+    for( it = pre.begin(); it != pre.end(); it++)
+    {
+        string unity_o = fileMan.getFileForId( *it );
+        if( unity_o.compare( 0, prefix.length(), prefix) != 0 )
+            continue;
+        
+        JobUsage u;
+        if( !usageDb.get( *it, u) || !u.valid )
+            return 0;
+        
+        long long own = 0, all = 0;
+        set<file_id_t> members = fileMan.getDependencies( *it );     // the sources, the bundle and their headers
+        set<file_id_t>::const_iterator mit;
+        for( mit = members.begin(); mit != members.end(); mit++)
+        {
+            string fn = fileMan.getFileForId( *mit ), dir, bn, bext, ext;
+            breakPath( fn, dir, bn);
+            breakFileName( bn, bext, ext);
+            if( (ext != ".cpp" && ext != ".cc" && ext != ".C") || fn.compare( 0, prefix.length(), prefix) == 0 ||
+                !FindFiles::exists( fn ) )
+                continue;
+            
+            long long size = FindFiles::getCachedFile( fn ).getSize();
+            all += size;
+            if( *mit == src_id )
+                own = size;
+        }
+        
+        return all > 0 ? u.wall_ms * own / all : 0;
+    }
+    
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+
+string PchExtension::getType() const
+{
+    return "pch";
+}
+
+
+ExtensionBase *PchExtension::createExtensionDriver( ProjectXmlNode *node )
+{
+    return new PchExtension( node );
+}
+
+
+static bool moreIncluded( const pair<int,string> &a, const pair<int,string> &b)
+{
+    return a.first != b.first ? a.first > b.first : a.second < b.second;
+}
+
+
+void PchExtension::createCommands( FileManager &fileMan, const map<string,string> &xmlAttribs)
+{
+    assert( getNode() != 0 );
+    
+    int maxHeaders = getAttrib( xmlAttribs, "headers").length() > 0 ? atoi( getAttrib( xmlAttribs, "headers").c_str() ) : 8;
+    int share = getAttrib( xmlAttribs, "share").length() > 0 ? atoi( getAttrib( xmlAttribs, "share").c_str() ) : 50;
+    long long stableMs = 3600000LL * (getAttrib( xmlAttribs, "stable").length() > 0 ? atoi( getAttrib( xmlAttribs, "stable").c_str() ) : 24);
+    
+    set<string> exclude;
+    stringstream exss( getAttrib( xmlAttribs, "exclude") );
+    string ex;
+    while( exss >> ex )
+        exclude.insert( ex );
+    
+    // how many of the node's C++ sources include a header directly, from the dependencies of the last run
+    vector<File> all = getNode()->getFiles();
+    map<file_id_t,int> includedBy;
+    int sources = 0;
+    size_t i;
+    for( i = 0; i < all.size(); i++)
+    {
+        string ext = all[i].extension();
+        if( (ext != ".cpp" && ext != ".cc" && ext != ".C") || !fileMan.hasFileName( all[i].getPath() ) )
+            continue;
+        
+        sources++;
+        set<file_id_t> deps = fileMan.getDependencies( fileMan.getIdForFile( all[i].getPath() ) );
+        set<file_id_t>::const_iterator it;
+        for( it = deps.begin(); it != deps.end(); it++)
+            includedBy[ *it ]++;
+    }
+    
+    string o_outputdir = getNode()->getObjDir();
+    string pch_h = o_outputdir + "ferret_pch.h";
+    string pch_gch = pch_h + ".gch";
+    string updir = upDir( o_outputdir );
+    
+    // the selection of the last run, from the #include list it wrote
+    string old;
+    FILE *fp = fopen( pch_h.c_str(), "r");
+    if( fp )
+    {
+        char buf[ 4096 ];
+        size_t n;
+        while( (n = fread( buf, 1, sizeof(buf), fp)) > 0 )
+            old.append( buf, n);
+        fclose( fp );
+    }
+    set<string> previous;
+    stringstream oldss( old );
+    string line;
+    while( getline( oldss, line) )
+        if( line.compare( 0, 10 + updir.length(), "#include \"" + updir) == 0 && line[ line.length() - 1 ] == '"' )
+            previous.insert( line.substr( 10 + updir.length(), line.length() - 11 - updir.length()) );
+    
+    long long now = (long long)time( 0 ) * 1000;
+    vector< pair<int,string> > candidates;
+    size_t kept = 0;
+    map<file_id_t,int>::const_iterator it;
+    for( it = includedBy.begin(); it != includedBy.end(); it++)
+    {
+        string hdr = fileMan.getFileForId( it->first );
+        string dir, bn, bext, ext;
+        breakPath( hdr, dir, bn);
+        breakFileName( bn, bext, ext);
+        
+        if( fileMan.getCmdForId( it->first ) != "D" || (ext != ".h" && ext != ".hpp" && ext != ".hh") ||
+            exclude.find( bn ) != exclude.end() || it->second < 2 || it->second * 100 < share * sources ||
+            !FindFiles::exists( hdr ) )
+            continue;
+        
+        if( previous.find( hdr ) != previous.end() )
+            kept++;
+        if( now - FindFiles::getCachedFile( hdr ).getTimeMs() >= stableMs )
+            candidates.push_back( make_pair( it->second, hdr) );
+    }
+    sort( candidates.begin(), candidates.end(), moreIncluded);
+    if( (int)candidates.size() > maxHeaders )
+        candidates.resize( maxHeaders );
+    
+    // the age of a header only counts when a selection is made. the last one stays as long as all of its headers
+    // qualify by the sources, else the clock alone would change the pch and recompile the node
+    bool keep = previous.size() > 0 && kept == previous.size() && (int)previous.size() <= maxHeaders;
+    if( keep )
+    {
+        candidates.clear();
+        set<string>::const_iterator pit;
+        for( pit = previous.begin(); pit != previous.end(); pit++)
+            candidates.push_back( make_pair( includedBy[ fileMan.getIdForFile( *pit ) ], *pit) );
+    }
+    
+    if( verbosity > 0 )
+        cout << "PCH Extension for node " << getNode()->getDir() << ": " << candidates.size() << " of " << includedBy.size()
+             << " included file(s) " << (keep ? "still qualify" : "qualify") << "\n";
+    if( candidates.size() == 0 )
+        return;
+    
+    stringstream content;
+    for( i = 0; i < candidates.size(); i++)
+        content << "#include \"" << updir << candidates[i].second << "\"\n";
+    
+    // rewritten only when the selection changed, it is a dependency of the pch and of every compile
+    if( !keep && old != content.str() )
+    {
+        FindFiles::remove( pch_h );      // so that the next exists check sees the new time
+        mkdir_p( o_outputdir );          // nothing compiled yet after a clean
+        fp = fopen( pch_h.c_str(), "w");
+        if( fp )
+        {
+            fputs( content.str().c_str(), fp);
+            fclose( fp );
+        }
+    }
+    if( !FindFiles::exists( pch_h ) )
+    {
+        cerr << "PCH Extension: error: could not write '" << pch_h << "'.\n";
+        return;
+    }
+    
+    if( verbosity > 0 )
+        cout << "Ext cmd for node " << getNode()->getDir() << ": pch " << pch_gch << " with " << candidates.size() << " header(s)\n";
+    
+    file_id_t hid = fileMan.addFile( pch_h, getNode());
+    file_id_t fid = fileMan.addExtensionCommand( pch_gch, getType(), getNode());
+    fileMan.addDependency( fid, hid);
+    for( i = 0; i < candidates.size(); i++)
+        fileMan.addDependency( fid, fileMan.getIdForFile( candidates[i].second ));
+    
+    addBlockedFileId( hid );
+    
+    getNode()->pegPchScript( fid, pch_h, pch_gch);
+    getNode()->setPch( fid, hid, pch_h);
+}
+
 // -----------------------------------------------------------------------------
 // XML extensions configurable using XML file
 string XmlExtension::getType() const
@@ -527,6 +988,17 @@ ExtensionBase *ExtensionManager::createExtensionDriver( const string &type, Proj
 }
 
 
+ExtensionBase *ExtensionManager::createExtensionDriver( const string &type, BaseNode *node)
+{
+    ProjectXmlNode *xmlNode = dynamic_cast<ProjectXmlNode *>( node );
+    
+    if( xmlNode )
+        return createExtensionDriver( type, xmlNode);
+    else
+        return 0;
+}
+
+
 bool ExtensionManager::parseExtension( SimpleXMLStream *xmls )
 {
     ExtensionEntry *entry = 0;
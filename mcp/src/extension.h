@@ -13,6 +13,7 @@ void setupExtensions();
 
 class ProjectXmlNode;
 class BaseNode;
+class UsageDb;
 
 class ExtensionBase
 {
@@ -41,6 +42,9 @@ public:
 
     void addBlockIncludesFileId( file_id_t id );
     
+    void addBlockedSourceId( file_id_t id )     // the node makes no command for it, but its includes still count
+    { blockedIds.insert( id ); }
+    
     std::set<file_id_t> getBlockedIds() const
     { return blockedIds; }
     
@@ -93,6 +97,64 @@ public:
 };
 
 
+// unity (jumbo) build, <unity files="8"/> or <unity ms="20000"/> in project.xml, exclude="a.cpp b.cpp" keeps
+// sources out. the node's C++ sources, sorted by name, are bundled by count or by their compile times from the
+// usage db, with boundaries at names chosen by hash so they stay put when sources come and go. each bundle is an
+// #include list in the object directory named after its first source. it is written when the commands are made and
+// only when its members change, its compile depends on it and on its sources, so a change to one source rebuilds only
+// its bundle
+class UnityExtension : public ExtensionBase
+{
+public:
+    UnityExtension( ProjectXmlNode *node )
+        : ExtensionBase(node)
+    {}
+    
+    virtual std::string getType() const;
+    virtual ExtensionBase *createExtensionDriver( ProjectXmlNode *node );
+    
+    virtual void createCommands( FileManager &fileMan, const std::map<std::string,std::string> &xmlAttribs);
+
+    virtual std::string getScriptTemplName() const
+    { return "ferret_cpp.sh.templ"; }         // the bundles are compiled as any C++ source
+    
+    virtual std::string getScriptName() const
+    { return "ferret_cpp__#.sh"; }
+    
+private:
+    long long bundleShare( FileManager &fileMan, const UsageDb &usageDb, file_id_t src_id, const std::string &o_outputdir);
+    void dropOldBundles( FileManager &fileMan, const std::vector<File> &all, const std::set<std::string> &bundles,
+                         const std::string &o_outputdir);
+};
+
+
+// precompiled header, <pch/> in project.xml. the headers that at least share="50" percent of the node's C++ sources
+// include directly and that did not change for stable="24" hours, at most headers="8" of them, as known from the
+// include dependencies of the last run. they go into an #include list in the object directory, which is compiled
+// to a .gch that every C++ compile of the node gets with -include. the pch command depends on the chosen headers,
+// so it is rebuilt when one of them or anything they include changes. exclude="a.h b.h" keeps headers out. init runs
+// know no includes yet and compile without it. a selection is kept while all of its headers are still shared enough,
+// the stable age is only looked at when it has to be made again
+class PchExtension : public ExtensionBase
+{
+public:
+    PchExtension( ProjectXmlNode *node )
+        : ExtensionBase(node)
+    {}
+    
+    virtual std::string getType() const;
+    virtual ExtensionBase *createExtensionDriver( ProjectXmlNode *node );
+    
+    virtual void createCommands( FileManager &fileMan, const std::map<std::string,std::string> &xmlAttribs);
+
+    virtual std::string getScriptTemplName() const
+    { return "ferret_pch.sh.templ"; }
+    
+    virtual std::string getScriptName() const
+    { return "ferret_pch__#.sh"; }
+};
+
+
 class ExtensionEntry;
 class XmlExtension : public ExtensionBase  // for XML extensions
 {
@@ -131,7 +193,7 @@ public:
     void addXmlExtension( const ExtensionEntry *entry );
     
     virtual ExtensionBase *createExtensionDriver( const std::string &type, ProjectXmlNode *node);
-    virtual ExtensionBase *createExtensionDriver( const std::string &type, BaseNode *node){ return 0; }    // FIXME missing
+    virtual ExtensionBase *createExtensionDriver( const std::string &type, BaseNode *node);    // only for XML project nodes so far
     
     bool parseExtension( SimpleXMLStream *xmls );
     bool checkExtensionDependencies( const ExtensionEntry *entry );
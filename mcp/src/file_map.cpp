@@ -10,6 +10,7 @@
 #include "engine.h"
 #include "base_node.h"
 #include "glob_utility.h"
+#include "phase_profiler.h"
 
 using namespace std;
 
@@ -30,6 +31,8 @@ static unsigned int hash_s( hash_map_t *hm, const string &s)
     int len = s.length();
     size_t loop;
     unsigned int h;
+    
+    prof_count( PROF_HASH_S );
 
 #define HASH4 h = (h << 5) + h + *key++;
 
@@ -716,6 +719,7 @@ int FileMap::hasFileName( const string &fn )
 
 int FileMap::getIdForFileName( const string &fn )
 {
+    prof_count( PROF_LOOKUP );
     bucket_t *b = hash_map_find_s( this->hashmap_s, fn);
     if( b )
         return b->data->file_id;
@@ -856,7 +860,8 @@ int FileMap::cleanupDeletions()
             }
             else if( th->data->structural_state == data_t::RESULT || th->data->structural_state == data_t::RESULT_DEP_CHANGED )
             {                
-                if( hash_set_get_size( th->data->deps_set ) == 0 )
+                if( hash_set_get_size( th->data->deps_set ) == 0 &&
+                    hash_set_get_size( th->data->downward_weak_set ) == 0 )    // wait nodes only have their producer
                 {
                     cout << "can delete id: " << th->data->file_id << " (unlinked result file)\n";
                     cnt++;
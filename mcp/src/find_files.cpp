@@ -11,6 +11,7 @@
 
 #include "find_files.h"
 #include "glob_utility.h"
+#include "phase_profiler.h"
 
 using namespace std;
 
@@ -85,6 +86,12 @@ long long File::getTimeMs() const
 }
 
 
+long long File::getTimeNs() const
+{
+    return (long long)last_modification.tv_sec * 1000000000 + last_modification.tv_nsec;
+}
+
+
 // -----------------------------------------------------------------------------
 map<string,File> FindFiles::allFiles;
 vector<File> FindFiles::ftwFiles;
@@ -241,6 +248,8 @@ bool FindFiles::exists( const string &path )
     struct stat fst;
     map<string,File>::iterator it = allFiles.find( path );
     
+    prof_count( PROF_EXISTS );
+    
     if( it != allFiles.end() && !it->second.isRemoved() )
         return true;
     else
@@ -248,6 +257,7 @@ bool FindFiles::exists( const string &path )
         if( noexistingFiles.find( path ) != noexistingFiles.end() )
             return false;
         
+        prof_count( PROF_STAT );
         if( stat( path.c_str(), &fst) == 0 )
         {
             if( S_ISREG( fst.st_mode ) )
@@ -276,6 +286,7 @@ File FindFiles::getCachedFile( const string &path )
 {
     map<string,File>::iterator it = allFiles.find( path );
     
+    prof_count( PROF_CACHED_FILE );
     if( it != allFiles.end() && !it->second.isRemoved() )
         return it->second;
     else
@@ -291,6 +302,8 @@ File FindFiles::getUncachedFile( const string &path )
     struct stat fst;
     File f;
     
+    prof_count( PROF_UNCACHED_FILE );
+    prof_count( PROF_STAT );
     if( stat( path.c_str(), &fst) == 0 )
     {
         if( S_ISREG( fst.st_mode ) )
@@ -310,6 +323,9 @@ File FindFiles::getUncachedFile( const string &path )
 bool FindFiles::existsUncached( const string &path )
 {
     struct stat fst;
+    
+    prof_count( PROF_EXISTS_UNCACHED );
+    prof_count( PROF_STAT );
     if( stat( path.c_str(), &fst) == 0 )
     {
         if( S_ISREG( fst.st_mode ) )
@@ -330,6 +346,7 @@ void FindFiles::remove( const string &path )
     
     if( it != allFiles.end() )
         it->second.setRemoved();
+    noexistingFiles.erase( path );     // the caller may write it again
 }
 
 
@@ -389,6 +406,7 @@ vector<File> FindFiles::readDirectory( const string &dir )
             string bn = dp->d_name;
             string fpath = dir + "/" + bn;
             
+            prof_count( PROF_STAT );
             if( stat( fpath.c_str(), &fst) == 0 )
                 dir_files.push_back( File( fpath, dir, bn, &fst) );
             else
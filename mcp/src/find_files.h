@@ -15,25 +15,25 @@
 class File {
 public:
     File()
-        : removed(false)
+        : size(0), removed(false)
     {last_modification.tv_sec = 0; last_modification.tv_nsec = 0;}
     
     File( const char *path, const char *d, const char *bn, const struct stat *fst)
-        : path(path), dir(d), basename(bn), removed(false)
+        : path(path), dir(d), basename(bn), size(fst->st_size), removed(false)
     {
         last_modification.tv_sec = fst->st_mtim.tv_sec;
         last_modification.tv_nsec = fst->st_mtim.tv_nsec;  // see http://man7.org/linux/man-pages/man2/stat.2.html
     }
     
     explicit File( const std::string &path, const std::string &dir, const std::string &bn, struct stat *fst)
-        : path(path), dir(dir), basename(bn), removed(false)
+        : path(path), dir(dir), basename(bn), size(fst->st_size), removed(false)
     {
         last_modification.tv_sec = fst->st_mtim.tv_sec;
         last_modification.tv_nsec = fst->st_mtim.tv_nsec;
     }
     
     explicit File( const std::string &path, struct stat *fst)
-        : path(path), dir(path), removed(false)
+        : path(path), dir(path), size(fst->st_size), removed(false)
     {
         last_modification.tv_sec = fst->st_mtim.tv_sec;
         last_modification.tv_nsec = fst->st_mtim.tv_nsec;
@@ -57,6 +57,10 @@ public:
     std::string woExtension() const;
 
     long long getTimeMs() const;
+    long long getTimeNs() const;
+    
+    long long getSize() const
+    { return size; }
 
     void setRemoved()
     { removed = true; }
@@ -69,6 +73,7 @@ private:
     std::string dir;
     std::string basename;
     struct timespec last_modification;
+    long long size;
     bool removed;
 };
 
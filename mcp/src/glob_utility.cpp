@@ -6,6 +6,9 @@
 
 #include "glob_utility.h"
 #include "find_files.h"
+#include "build_trace.h"
+#include "perf_history.h"
+#include "phase_profiler.h"
 
 using namespace std;
 
@@ -22,42 +25,61 @@ bool show_info;   // --info flag
 
 string tempDir;
 
-static struct timespec lastt;
-
-void init_timer()
+static void print_took( const string &what, long long us)
 {
-    clock_gettime( CLOCK_REALTIME, &lastt);
+    char buf[ 32 ];
+    snprintf( buf, sizeof(buf), "%.3f", us / 1e6);
+    
+    cout << string( PhaseProfiler::getThePhaseProfiler()->getDepth() * 2, ' ') << what << " took " << buf << "s\n";
 }
 
 
-string get_diff()
+void phase_end( bool printTimes, const string &what)
 {
-    struct timespec curr;
-    clock_gettime( CLOCK_REALTIME, &curr);
+    PhaseProfiler *pp = PhaseProfiler::getThePhaseProfiler();
+    PhaseProfiler::Node *n = pp->leaf( what );
+    long long start_us = n->start_us, end_us = pp->getMark();
     
-    double diff = (double)(curr.tv_sec - lastt.tv_sec) +
-                  (double)(curr.tv_nsec - lastt.tv_nsec) * 1.e-9;
-    lastt.tv_sec = curr.tv_sec;
-    lastt.tv_nsec = curr.tv_nsec;
-
-    char buf[10];
-    sprintf( buf, "%.3f", diff);
+    BuildTrace::getTheBuildTrace()->addPhase( what, start_us, end_us);
+    PerfHistory::getThePerfHistory()->addPhase( what, end_us - start_us, pp->getLastCounts());
     
-    return buf;
+    if( printTimes )
+        print_took( what, end_us - start_us);
 }
 
 
-void set_start_time()
+PhaseScope::PhaseScope( bool printTimes, const string &what)
+    : printTimes(printTimes), active(true)
 {
-    long    ms; // milliseconds
-    time_t  s;  // seconds
+    PhaseProfiler::getThePhaseProfiler()->begin( what );
+}
+
+
+void PhaseScope::end()
+{
+    if( !active )
+        return;
+    active = false;
+    
+    PhaseProfiler *pp = PhaseProfiler::getThePhaseProfiler();
+    PhaseProfiler::Node *n = pp->end();
+    long long start_us = n->start_us, end_us = pp->getMark();
     
-    clock_gettime( CLOCK_REALTIME, &lastt);
+    BuildTrace::getTheBuildTrace()->addPhase( n->name, start_us, end_us);
+    PerfHistory::getThePerfHistory()->addPhase( n->name, end_us - start_us, pp->getLastCounts());
+    
+    if( printTimes )
+        print_took( n->name, end_us - start_us);
+}
 
-    s  = lastt.tv_sec;
-    ms = lastt.tv_nsec / 1.0e6; // nanoseconds to milliseconds
 
-    startTimeMs = (long long)s*1000 + (long long)ms;
+void set_start_time()
+{
+    struct timespec now;
+    clock_gettime( CLOCK_REALTIME, &now);
+    
+    startTimeMs = (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+    PhaseProfiler::getThePhaseProfiler()->start();
 }
 
 
@@ -75,6 +97,15 @@ long long get_curr_time_ms()
 }
 
 
+long long get_curr_time_us()
+{
+    struct timespec spec;
+    clock_gettime( CLOCK_REALTIME, &spec);
+    
+    return (long long)spec.tv_sec * 1000000 + spec.tv_nsec / 1000;
+}
+
+
 string join( const string &sep1, const vector<string> &a, bool beforeFirst, const string &sep2)
 {
     size_t i;
@@ -148,6 +179,47 @@ vector<string> split( char where, const string &s)
 }
 
 
+string jsonEscape( const string &s )
+{
+    string r;
+    
+    for( size_t i = 0; i < s.length(); i++)
+    {
+        unsigned char c = s[i];
+        switch( c )
+        {
+            case '"':
+                r.append( "\\\"" );
+                break;
+            case '\\':
+                r.append( "\\\\" );
+                break;
+            case '\n':
+                r.append( "\\n" );
+                break;
+            case '\t':
+                r.append( "\\t" );
+                break;
+            case '\r':
+                r.append( "\\r" );
+                break;
+                
+            default:
+                if( c < 0x20 )
+                {
+                    char buf[8];
+                    snprintf( buf, 8, "\\u%04x", c);
+                    r.append( buf );
+                }
+                else
+                    r += c;
+        }
+    }
+    
+    return r;
+}
+
+
 string cleanPath( const string &in )
 {
     if( in.length() == 0 )
@@ -21,14 +21,29 @@ extern bool show_info;
 
 extern hash_set_t *global_mbd_set;
 
-void init_timer();
-std::string get_diff();  // for --times option
+void phase_end( bool printTimes, const std::string &what);   // prints "<what> took ..." for --times, records phase for --trace
+
+// nested phase, ends with the scope or end(), phase_end() inside records sub phases
+class PhaseScope {
+public:
+    PhaseScope( bool printTimes, const std::string &what);
+    ~PhaseScope()
+    { end(); }
+    
+    void end();
+    
+private:
+    bool printTimes, active;
+};
+
 void set_start_time();
 long long get_curr_time_ms();
+long long get_curr_time_us();
 
 std::string join( const std::string &sep1, const std::vector<std::string> &a, bool beforeFirst, const std::string &sep2 = "");
 std::string joinUniq( const std::string &sep1, const std::vector<std::string> &a, bool beforeFirst);
 std::vector<std::string> split( char where, const std::string &s);
+std::string jsonEscape( const std::string &s );    // contents of a JSON string, without the quotes
 
 std::string cleanPath( const std::string &in );
 std::string stackPath( const std::string &p1, const std::string &p2);
@@ -4,6 +4,7 @@
 #include <iostream>
 
 #include "hash_set.h"
+#include "phase_profiler.h"
 
 using std::cout;
 
@@ -61,6 +62,8 @@ void hash_set_add( hash_set_t *hs, int file_id)
     int b = hash( hs, file_id);
     hash_set_bucket_t *h = &( hs->buckets[b] );
     
+    prof_count( PROF_SET_ADD );
+    
     if( h->file_id == file_id )
         return;  // do nothing, file id already in set
     
@@ -143,6 +146,7 @@ static hash_set_bucket_t *hash_set_find( hash_set_t *hs, int file_id)
 
 int hash_set_has_id( hash_set_t *hs, int file_id)
 {
+    prof_count( PROF_SET_HAS );
     return (hash_set_find( hs, file_id) != 0 ) ? 1 : 0;
 }
 
@@ -32,7 +32,7 @@ IncludeManager *IncludeManager::getTheIncludeManager()
 
 
 IncludeManager::IncludeManager()
-    : fileRemoved(false)
+    : fileRemoved(false), readAllModules(false), modulesChanged(false)
 {
     unsat_set = new_hash_set( 101 );
 }
@@ -54,6 +54,31 @@ void IncludeManager::readUnsatSet( bool initMode )
 }
 
 
+// one line per declaration: <source> P <module> or <source> I <module>. in init mode or without the file all
+// dep files are read once
+void IncludeManager::readModules( bool initMode )
+{
+    modules_fn = stackPath( dbProjDir, "ferret_modules");
+    
+    FILE *fp = initMode ? 0 : fopen( modules_fn.c_str(), "r");
+    if( !fp )
+    {
+        readAllModules = modulesChanged = true;
+        return;
+    }
+    
+    char fn[ 1025 ], t[ 2 ], module[ 256 ];
+    while( fscanf( fp, "%1024s %1s %255s\n", fn, t, module) == 3 )
+    {
+        if( t[0] == 'P' )
+            moduleUnits[ fn ].provides.push_back( module );
+        else
+            moduleUnits[ fn ].imports.push_back( module );
+    }
+    fclose( fp );
+}
+
+
 void IncludeManager::createMissingDepFiles( FileManager &fileDb, Executor &executor, bool printTimes)
 {
     FileMap::Iterator it;
@@ -95,6 +120,9 @@ void IncludeManager::createMissingDepFiles( FileManager &fileDb, Executor &execu
                             if( f.isNewerThan( depFile ) )
                                 do_dep = true;
                         }
+                        
+                        if( !do_dep && readAllModules )
+                            updateModuleUnit( it.getFile(), depfn);
                     }
                     else if( FindFiles::exists( it.getFile() ) )
                     {
@@ -132,6 +160,95 @@ void IncludeManager::createMissingDepFiles( FileManager &fileDb, Executor &execu
             cout << "inc mananger  " << filesWithUpdate.size() << " dep file missing or needs update.\n";
         depEngine.doWork( executor, printTimes);  // create all missing .d files
     }
+    
+    for( size_t i = 0; i < filesWithUpdate.size(); i++)   // known before the commands are made
+        updateModuleUnit( filesWithUpdate[i], depFilesWithUpdate[i]);
+    readAllModules = false;
+}
+
+
+void IncludeManager::updateModuleUnit( const string &fn, const string &depfn)
+{
+    ModuleUnit mu;
+    
+    FILE *fp = fopen( depfn.c_str(), "r");
+    if( fp )
+    {
+        ParseDep pd( fp );
+        pd.parse();
+        fclose( fp );
+        
+        const vector<DepFileEntry> dfe = pd.getDepEntries();
+        for( size_t j = 0; j < dfe.size(); j++)
+            if( dfe[j].target == "module-provides" )
+                mu.provides = dfe[j].depIncludes;
+            else if( dfe[j].target == "module-imports" )
+                mu.imports = dfe[j].depIncludes;
+    }
+    
+    map<string,ModuleUnit>::iterator it = moduleUnits.find( fn );
+    if( mu.provides.size() > 0 || mu.imports.size() > 0 )
+    {
+        if( it == moduleUnits.end() || it->second.provides != mu.provides || it->second.imports != mu.imports )
+        {
+            moduleUnits[ fn ] = mu;
+            modulesChanged = true;
+        }
+    }
+    else if( it != moduleUnits.end() )
+    {
+        moduleUnits.erase( it );
+        modulesChanged = true;
+    }
+}
+
+
+void IncludeManager::writeModules()
+{
+    FILE *fp = fopen( modules_fn.c_str(), "w");
+    if( !fp )
+        return;
+    
+    map<string,ModuleUnit>::const_iterator it;
+    for( it = moduleUnits.begin(); it != moduleUnits.end(); it++)
+    {
+        size_t i;
+        for( i = 0; i < it->second.provides.size(); i++)
+            fprintf( fp, "%s P %s\n", it->first.c_str(), it->second.provides[i].c_str());
+        for( i = 0; i < it->second.imports.size(); i++)
+            fprintf( fp, "%s I %s\n", it->first.c_str(), it->second.imports[i].c_str());
+    }
+    fclose( fp );
+    modulesChanged = false;
+}
+
+
+const ModuleUnit *IncludeManager::getModuleUnit( const string &fn ) const
+{
+    map<string,ModuleUnit>::const_iterator it = moduleUnits.find( fn );
+    return it != moduleUnits.end() ? &it->second : 0;
+}
+
+
+string IncludeManager::getModuleProvider( const string &module )
+{
+    if( moduleProviders.size() == 0 )
+    {
+        map<string,ModuleUnit>::const_iterator it;
+        for( it = moduleUnits.begin(); it != moduleUnits.end(); it++)
+            for( size_t i = 0; i < it->second.provides.size(); i++)
+            {
+                const string &m = it->second.provides[i];
+                if( moduleProviders.find( m ) == moduleProviders.end() )
+                    moduleProviders[ m ] = it->first;
+                else
+                    cerr << "warning: module '" << m << "' is exported by " << moduleProviders[ m ] << " and "
+                         << it->first << ", using the first.\n";
+            }
+    }
+    
+    map<string,string>::const_iterator pit = moduleProviders.find( module );
+    return pit != moduleProviders.end() ? pit->second : "";
 }
 
 
@@ -222,6 +339,9 @@ void IncludeManager::resolve( FileManager &fileDb, bool initMode, bool writeIgnH
         fclose( fp );
     }
 
+    if( modulesChanged )
+        writeModules();
+    
     const unsigned int treshold = 10;
     stringstream fw;
     if( hash_set_get_size( unsat_set ) > 0 )
@@ -281,6 +401,9 @@ int IncludeManager::readDepFile( const string &fn, const string &depfn, const Ba
         {
             const DepFileEntry &df = dfe[j];
             
+            if( df.target == "module-provides" || df.target == "module-imports" )    // see updateModuleUnit
+                continue;
+            
             if( fn != df.target )
                 cerr << "warning: unexpected target file name in dependency file '" << df.target << "', expected '" << fn << "'\n";
             
@@ -406,6 +529,8 @@ void IncludeManager::removeFile( FileManager &fileDb, file_id_t id, const string
         cout << "Removing dep file " << depfn << "\n";
     ::remove( depfn.c_str() );
     hash_set_remove( unsat_set, id);
+    if( moduleUnits.erase( fn ) > 0 )
+        modulesChanged = true;
     
     set<file_id_t>::const_iterator sit = prereqs.begin();
     for( ; sit != prereqs.end(); sit++)
@@ -18,6 +18,13 @@ public:
 };
 
 
+// C++20 module declarations of a source as ferret_inc found them, named like the CMI files (module-partition)
+struct ModuleUnit
+{
+    std::vector<std::string> provides, imports;
+};
+
+
 // The include manager takes care of all dependencies coming from includes
 class IncludeManager
 {
@@ -29,7 +36,10 @@ public:
 
     void setDbProjDir( const std::string &dir )
     { dbProjDir = dir; }
+    std::string getDbProjDir() const
+    { return dbProjDir; }
     void readUnsatSet( bool initMode );
+    void readModules( bool initMode );
     
     void createMissingDepFiles( FileManager &fileDb, Executor &executor, bool printTimes);
     
@@ -42,6 +52,9 @@ public:
     
     void printFinalWords() const;
     
+    const ModuleUnit *getModuleUnit( const std::string &fn ) const;
+    std::string getModuleProvider( const std::string &module );    // source file, "" if no source exports it
+    
 private:
    
     int readDepFile( const std::string &fn, const std::string &depfn, const BaseNode *node);
@@ -50,6 +63,8 @@ private:
                     const std::vector<std::string> &lookingFor);
     
     bool resolveFile( FileManager &fileDb, file_id_t from_id, const Seeker &s, bool writeIgnHdr, int &notFound);
+    void updateModuleUnit( const std::string &fn, const std::string &depfn);
+    void writeModules();
     
 private:
     static IncludeManager *theIncludeManager;
@@ -69,6 +84,11 @@ private:
     std::string unsat_set_fn;
     std::string finalWords;
     std::map<std::string,file_id_t> uniqueBasenames;
+    
+    std::map<std::string,ModuleUnit> moduleUnits;          // source file -> its module declarations
+    std::map<std::string,std::string> moduleProviders;     // module -> source file
+    std::string modules_fn;
+    bool readAllModules, modulesChanged;
 };
 
 #endif
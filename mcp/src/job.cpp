@@ -2,6 +2,13 @@
 #include "job.h"
 
 #include <cassert>
+#include <cstdio>
+#include <sstream>
+#include <iostream>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "glob_utility.h"
 
 using namespace std;
 
@@ -13,6 +20,19 @@ static unsigned int job_idgen()
     return ++job_idc;
 }
 
+// -----------------------------------------------------------------------------
+string JobUsage::toString() const
+{
+    if( !valid )
+        return "";
+    
+    char buf[256];
+    snprintf( buf, 256, "wall %.2fs  user %.2fs  sys %.2fs  max rss %lld kB  blocks in/out %lld/%lld  csw vol/invol %lld/%lld",
+              wall_ms / 1000., utime_ms / 1000., stime_ms / 1000., maxrss_kb, inblock, oublock, nvcsw, nivcsw);
+    
+    return buf;
+}
+
 // -----------------------------------------------------------------------------
 string Job::getStateAsString()
 {
@@ -41,27 +61,132 @@ string Job::getStateAsString()
 }
 
 
+void Job::append( stream_t stream, const char *s, size_t len)
+{
+    if( len == 0 )
+        return;
+    
+    if( chunks.size() > 0 && chunks.back().stream == stream )
+        chunks.back().len += len;
+    else
+        chunks.push_back( Chunk( stream, len) );
+    outputSize += len;
+    
+    if( spillFile.length() == 0 )
+        data.append( s, len);
+    else
+    {
+        if( spillFd < 0 )
+            spillFd = open( spillFile.c_str(), O_WRONLY | O_APPEND);
+        if( spillFd >= 0 && write( spillFd, s, len) != (ssize_t)len )
+            cerr << "warning: could not write job output to '" << spillFile << "'.\n";
+        if( state != QUEUED )     // only a running job keeps its spill file open
+            closeSpill();
+    }
+}
+
+
+void Job::closeSpill()
+{
+    if( spillFd >= 0 )
+        close( spillFd );
+    spillFd = -1;
+}
+
+
+bool Job::hasStream( stream_t stream ) const
+{
+    for( size_t i = 0; i < chunks.size(); i++)
+        if( chunks[i].stream == stream )
+            return true;
+    
+    return false;
+}
+
+
+bool Job::spill( const string &fn )
+{
+    spillFd = open( fn.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if( spillFd < 0 || write( spillFd, data.data(), data.length()) != (ssize_t)data.length() )
+    {
+        cerr << "warning: could not write job output to '" << fn << "', keeping it in memory.\n";
+        closeSpill();
+        return false;
+    }
+    
+    spillFile = fn;
+    string().swap( data );     // really give the memory back
+    if( state != QUEUED )
+        closeSpill();
+    
+    return true;
+}
+
+
+void Job::removeSpill()
+{
+    closeSpill();
+    if( spillFile.length() > 0 )
+        ::remove( spillFile.c_str() );
+}
+
+
+string Job::materialize( bool all, stream_t stream) const
+{
+    string content;
+    
+    if( spillFile.length() == 0 )
+        content = data;
+    else
+    {
+        FILE *fp = fopen( spillFile.c_str(), "r");
+        if( !fp )
+            return "";
+        
+        content.resize( outputSize );
+        size_t n = outputSize > 0 ? fread( &content[0], 1, outputSize, fp) : 0;
+        fclose( fp );
+        content.resize( n );
+    }
+    
+    if( all )
+        return content;
+    
+    string r;
+    size_t pos = 0;
+    for( size_t i = 0; i < chunks.size() && pos < content.length(); i++)
+    {
+        if( chunks[i].stream == stream )
+            r.append( content, pos, chunks[i].len);
+        pos += chunks[i].len;
+    }
+    
+    return r;
+}
+
+
 string Job::getOutput() const
 {
-    return output;
+    return materialize( true, STDOUT);
 }
 
 
 string Job::getStdOut() const
 {
-    return std_output;
+    return hasStream( STDOUT ) ? materialize( false, STDOUT) : "";
 }
 
 
 string Job::getErrOut() const
 {
-    return err_output;
+    return hasStream( STDERR ) ? materialize( false, STDERR) : "";
 }
 
 
 void Job::setError( bool err )
 {
     state =  err ? FAILED : DONE;
+    closeSpill();
 }
 
 
@@ -79,6 +204,7 @@ static size_t jobidx( unsigned int job_id )
 
 
 JobStorer::JobStorer()
+    : residentBytes(0), memLimit(32*1024*1024)
 {
 }
 
@@ -128,31 +254,54 @@ string JobStorer::getFileName( unsigned int job_id ) const
 }
 
 
-void JobStorer::append( unsigned int job_id, const string &s)
+void JobStorer::append( unsigned int job_id, Job::stream_t stream, const string &s)
 {
     size_t i = jobidx( job_id );
     assert( i < jobs.size() );
     
-    jobs[ i ].appendOutput( s );
+    size_t before = jobs[ i ].getResidentSize();
+    jobs[ i ].append( stream, s.data(), s.length());
+    residentBytes += jobs[ i ].getResidentSize() - before;
+    if( before == 0 && jobs[ i ].getResidentSize() > 0 )
+        resident.push_back( i );
+    
+    if( residentBytes > memLimit )
+        spillOldest();
 }
 
 
-void JobStorer::appendStd( unsigned int job_id, const string &s)
+// move output of the oldest jobs to files until half of the memory limit is reached
+void JobStorer::spillOldest()
 {
-    size_t i = jobidx( job_id );
-    assert( i < jobs.size() );
+    string dir = tempDir + "/output";
+    if( !mkdir_p( dir ) )
+        return;
     
-    jobs[ i ].appendStdOut( s );
+    while( resident.size() > 0 && residentBytes > memLimit / 2 )
+    {
+        size_t i = resident.front();
+        size_t rs = jobs[ i ].getResidentSize();
+        
+        stringstream fn;
+        fn << dir << "/job_" << (i + 1) << ".out";
+        if( !jobs[ i ].spill( fn.str() ) )
+            break;
+        
+        resident.pop_front();
+        residentBytes -= rs;
+    }
+}
+
+
+void JobStorer::appendStd( unsigned int job_id, const string &s)
+{
+    append( job_id, Job::STDOUT, s);
 }
 
 
 void JobStorer::appendErr( unsigned int job_id, const string &s)
 {
-    size_t i = jobidx( job_id );
-    assert( i < jobs.size() );
-    
-    if( s.length() > 0  )
-        jobs[ i ].appendErrOut( s );
+    append( job_id, Job::STDERR, s);
 }
 
 
@@ -186,6 +335,16 @@ string JobStorer::getErrOut( unsigned int job_id ) const
 }
 
 
+bool JobStorer::hasErrOut( unsigned int job_id ) const
+{
+    size_t i = jobidx( job_id );
+    if( i < jobs.size() )
+        return jobs[ i ].hasStream( Job::STDERR );
+    else
+        return false;
+}
+
+
 bool JobStorer::hasOutput( unsigned int job_id ) const
 {
     assert( job_id >= 1 && job_id <= jobs.size() );
@@ -232,8 +391,31 @@ int JobStorer::getFileId( unsigned int job_id ) const
 }
 
 
+void JobStorer::setUsage( unsigned int job_id, const JobUsage &u)
+{
+    size_t i = jobidx( job_id );
+    if( i < jobs.size() )
+        jobs[ i ].setUsage( u );
+}
+
+
+JobUsage JobStorer::getUsage( unsigned int job_id ) const
+{
+    size_t i = jobidx( job_id );
+    if( i < jobs.size() )
+        return jobs[ i ].getUsage();
+    else
+        return JobUsage();
+}
+
+
 void JobStorer::clear()
 {
+    for( size_t i = 0; i < jobs.size(); i++)
+        jobs[ i ].removeSpill();
+    
     job_idc = 0;
     jobs.clear();
+    resident.clear();
+    residentBytes = 0;
 }
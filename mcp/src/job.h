@@ -3,19 +3,37 @@
 
 #include <string>
 #include <vector>
+#include <deque>
+
+
+// resources used by a job, as reported by wait4()
+struct JobUsage {
+    JobUsage()
+        : valid(false), wall_ms(0), utime_ms(0), stime_ms(0), maxrss_kb(0), inblock(0), oublock(0), nvcsw(0), nivcsw(0)
+    {}
+    
+    std::string toString() const;
+    
+    bool valid;
+    long long wall_ms, utime_ms, stime_ms;
+    long long maxrss_kb;
+    long long inblock, oublock;     // file system input/output operations
+    long long nvcsw, nivcsw;        // voluntary/involuntary context switches
+};
 
 
 class Job {
 public:
     typedef enum { INVALID=0, QUEUED, DONE, FAILED, SPECIAL} state_t;
+    typedef enum { STDOUT=0, STDERR} stream_t;
     
     Job()
-        : jobid(-1), file_id(-1), state(INVALID)
+        : jobid(-1), file_id(-1), state(INVALID), outputSize(0), spillFd(-1)
     {
     }
     
     Job( const std::string &fn, const std::vector<std::string> &args, int file_id, state_t st)
-        : jobid(-1), fileName(fn), args(args), file_id(file_id), state(st)
+        : jobid(-1), fileName(fn), args(args), file_id(file_id), state(st), outputSize(0), spillFd(-1)
     {
     }
     
@@ -33,23 +51,29 @@ public:
     int getFileId() const
     { return file_id; }
     
-    void appendOutput( const std::string &s )
-    { output += s; };
-    void appendStdOut( const std::string &s )
-    { std_output += s; };
-    void appendErrOut( const std::string &s )
-    { err_output += s; };
+    void append( stream_t stream, const char *s, size_t len);
     
     bool hasOutput() const
-    { return output.length()>0; }
+    { return outputSize>0; }
+    bool hasStream( stream_t stream ) const;
     
-    std::string getOutput() const;
+    std::string getOutput() const;     // both streams in the order they arrived
     std::string getStdOut() const;
     std::string getErrOut() const;
     
+    size_t getResidentSize() const
+    { return data.length(); }
+    bool spill( const std::string &fn );   // move output to file fn, all further output goes there too
+    void removeSpill();
+    
     void setError( bool err );
     bool hasError() const;
     
+    void setUsage( const JobUsage &u )
+    { usage = u; }
+    const JobUsage &getUsage() const
+    { return usage; }
+    
 private:
     unsigned int jobid;
     
@@ -57,8 +81,27 @@ private:
     std::vector<std::string> args;
     int file_id;
     state_t state;
-
-    std::string output, std_output, err_output;
+    
+    struct Chunk {
+        Chunk( stream_t st, size_t l)
+            : stream(st), len(l)
+        {}
+        
+        stream_t stream;
+        size_t len;
+    };
+    
+    std::string materialize( bool all, stream_t stream) const;
+    void closeSpill();
+    
+    // output is stored once, tagged by stream. consecutive output of the same stream is one chunk
+    std::vector<Chunk> chunks;
+    std::string data;        // resident output, empty once spilled
+    std::string spillFile;
+    size_t outputSize;
+    int spillFd;             // open while the job runs, output arrives in many small pieces
+    
+    JobUsage usage;
 };
 
 
@@ -73,30 +116,41 @@ public:
     std::string getStateAsString( unsigned int job_id );
     std::string getFileName( unsigned int job_id ) const;
     
-    void append( unsigned int job_id, const std::string &s);
     void appendStd( unsigned int job_id, const std::string &s);
     void appendErr( unsigned int job_id, const std::string &s);
-    void cursesAppend( unsigned int job_id, const std::string &s);
-    void cursesEnd( unsigned int job_id );
     
     std::string getOutput( unsigned int job_id ) const;
     std::string getStdOut( unsigned int job_id ) const;
     std::string getErrOut( unsigned int job_id ) const;
     
     bool hasOutput( unsigned int job_id ) const;
+    bool hasErrOut( unsigned int job_id ) const;
+    
+    void setMemLimit( size_t bytes )
+    { memLimit = bytes; }
 
     void setError( unsigned int job_id, bool err);
     bool hasError( unsigned int job_id );
     
     int getFileId( unsigned int job_id ) const;
+    
+    void setUsage( unsigned int job_id, const JobUsage &u);
+    JobUsage getUsage( unsigned int job_id ) const;
 
     size_t getSize() const
     { return jobs.size(); }
 
     void clear();
     
+private:
+    void append( unsigned int job_id, Job::stream_t stream, const std::string &s);
+    void spillOldest();
+    
 private:
     std::vector<Job> jobs;
+    size_t residentBytes;    // output of all jobs held in memory
+    size_t memLimit;         // above that, output of the oldest jobs goes to spill files
+    std::deque<size_t> resident;   // jobs holding output in memory, in the order they got it
 };
 
 
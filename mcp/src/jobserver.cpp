@@ -0,0 +1,130 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "jobserver.h"
+#include "glob_utility.h"
+
+using namespace std;
+
+
+JobServer::~JobServer()
+{
+    releaseAll();
+    if( readFd >= 0 )
+        close( readFd );
+}
+
+
+// a file description of our own, so non blocking reads do not change the pipe for make
+bool JobServer::openReadSide( int fd )
+{
+    char path[ 64 ];
+    snprintf( path, sizeof(path), "/proc/self/fd/%d", fd);
+    
+    readFd = open( path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    return readFd >= 0;
+}
+
+
+bool JobServer::attach( const string &makeflags )
+{
+    size_t pos = makeflags.rfind( "--jobserver-auth=" );
+    size_t len = 17;
+    if( pos == string::npos )
+    {
+        pos = makeflags.rfind( "--jobserver-fds=" );      // make before 4.2
+        len = 16;
+    }
+    if( pos == string::npos )
+        return false;
+    
+    string auth = makeflags.substr( pos + len);
+    auth = auth.substr( 0, auth.find( ' ' ));
+    
+    int r, w;
+    if( auth.compare( 0, 5, "fifo:") == 0 )
+    {
+        string fifo = auth.substr( 5 );
+        readFd = open( fifo.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        writeFd = open( fifo.c_str(), O_WRONLY | O_CLOEXEC);
+    }
+    else if( sscanf( auth.c_str(), "%d,%d", &r, &w) == 2 && r >= 0 && fcntl( r, F_GETFD) != -1 && fcntl( w, F_GETFD) != -1 )
+    {
+        writeFd = w;
+        openReadSide( r );
+    }
+    else
+    {
+        cerr << "warning: MAKEFLAGS names a jobserver that is not open here, mark the make rule calling ferret with '+'.\n";
+        return false;
+    }
+    
+    if( readFd < 0 || writeFd < 0 )
+    {
+        cerr << "warning: cannot use the jobserver '" << auth << "' from MAKEFLAGS.\n";
+        if( readFd >= 0 )
+            close( readFd );
+        readFd = writeFd = -1;
+        return false;
+    }
+    
+    if( verbosity > 0 )
+        cout << "Jobserver: using make's (" << auth << ")\n";
+    return true;
+}
+
+
+bool JobServer::create( unsigned int slots )
+{
+    int fds[ 2 ];
+    if( slots < 2 || pipe( fds ) != 0 )
+        return false;
+    
+    string t( slots - 1, '+');
+    if( write( fds[1], t.data(), t.length()) != (ssize_t)t.length() || !openReadSide( fds[0] ) )
+    {
+        close( fds[0] );
+        close( fds[1] );
+        return false;
+    }
+    writeFd = fds[1];
+    
+    char flags[ 100 ];
+    snprintf( flags, sizeof(flags), " -j%u --jobserver-auth=%d,%d", slots, fds[0], fds[1]);     // both ends stay open in the children
+    setenv( "MAKEFLAGS", flags, 1);
+    
+    if( verbosity > 0 )
+        cout << "Jobserver: serving " << slots << " job slots to children (MAKEFLAGS=" << flags << ")\n";
+    return true;
+}
+
+
+bool JobServer::reserve( size_t running )
+{
+    if( readFd < 0 || running <= tokens.size() )     // the first job runs on the implicit token
+        return true;
+    
+    char c;
+    if( read( readFd, &c, 1) != 1 )
+        return false;
+    
+    tokens.push_back( c );
+    return true;
+}
+
+
+void JobServer::releaseSurplus( size_t running )
+{
+    size_t need = running > 0 ? running - 1 : 0;
+    
+    while( tokens.size() > need )
+    {
+        if( write( writeFd, &tokens.back(), 1) != 1 )
+            cerr << "warning: could not return a jobserver token.\n";
+        tokens.pop_back();
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef FERRET_JOBSERVER_H_
+#define FERRET_JOBSERVER_H_
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// GNU make jobserver. as a client ferret uses the one advertised in MAKEFLAGS (--jobserver-auth=R,W or
+// fifo:PATH), as a server (FERRET_JOBSERVER=y) it creates one with FERRET_P - 1 tokens and exports it to its
+// children. either way every local job beyond the first needs a token, so nested makes share one limit
+class JobServer {
+
+public:
+    JobServer()
+        : readFd(-1), writeFd(-1)
+    {}
+    ~JobServer();
+    
+    bool attach( const std::string &makeflags );     // client
+    bool create( unsigned int slots );               // server, sets MAKEFLAGS for the children
+    
+    bool isActive() const
+    { return readFd >= 0; }
+    
+    bool reserve( size_t running );                  // room for job running + 1, never blocks
+    void releaseSurplus( size_t running );           // give back what running jobs do not need
+    void releaseAll()
+    { releaseSurplus( 0 ); }
+
+private:
+    bool openReadSide( int fd );
+
+private:
+    int readFd, writeFd;
+    std::vector<char> tokens;                        // held, given back as they were read
+};
+
+#endif
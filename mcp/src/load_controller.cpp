@@ -0,0 +1,151 @@
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+
+#include "load_controller.h"
+#include "build_trace.h"
+#include "glob_utility.h"
+
+using namespace std;
+
+// percent of avg10 of memory full pressure above which the host thrashes
+static const double mem_full_high = 5.;
+
+
+static double readPsi( const char *fn, const char *kind)
+{
+    FILE *fp = fopen( fn, "r");
+    if( !fp )
+        return -1.;
+    
+    char line[ 256 ], fmt[ 32 ];
+    double v = -1.;
+    snprintf( fmt, sizeof(fmt), "%s avg10=%%lf", kind);
+    while( fgets( line, sizeof(line), fp) )
+        if( sscanf( line, fmt, &v) == 1 )
+            break;
+    fclose( fp );
+    
+    return v;
+}
+
+
+void LoadController::setup( unsigned int minParallel, unsigned int maxParallel, int intervalMs)
+{
+    enabled = true;
+    maxP = maxParallel > 0 ? maxParallel : 1;
+    minP = minParallel > 0 && minParallel <= maxP ? minParallel : 1;
+    current = lowest = maxP;
+    if( intervalMs > 0 )
+        interval_ms = intervalMs;
+    last_ms = get_curr_time_ms();
+    changes = 0;
+    otherLoad = -1.;
+    ncpus = sysconf( _SC_NPROCESSORS_ONLN );
+    if( ncpus < 1 )
+        ncpus = 1;
+    
+    if( verbosity > 0 )
+        cout << "Adaptive parallelism: " << minP << " to " << maxP << " local jobs, sampled every " << interval_ms << " ms\n";
+}
+
+
+void LoadController::sample( Sample &s ) const
+{
+    s.load1 = 0.;
+    s.runnable = -1;
+    FILE *fp = fopen( "/proc/loadavg", "r");
+    if( fp )
+    {
+        if( fscanf( fp, "%lf %*f %*f %d/", &s.load1, &s.runnable) != 2 )
+            s.runnable = -1;
+        fclose( fp );
+    }
+    s.load1 /= ncpus;
+    
+    s.cpuSome = readPsi( "/proc/pressure/cpu", "some");
+    s.memSome = readPsi( "/proc/pressure/memory", "some");
+    s.memFull = readPsi( "/proc/pressure/memory", "full");
+    s.ioFull = readPsi( "/proc/pressure/io", "full");
+}
+
+
+unsigned int LoadController::limit( unsigned int maxParallel, size_t running)
+{
+    if( !enabled )
+        return maxParallel;
+    
+    long long now = get_curr_time_ms();
+    if( now - last_ms < interval_ms )
+        return current;
+    last_ms = now;
+    
+    Sample s;
+    sample( s );
+    
+    // ferret itself is runnable while it reads /proc, each job is about one runnable compiler
+    if( s.runnable >= 0 )
+    {
+        double others = s.runnable - 1. - (double)running;
+        if( others < 0. )
+            others = 0.;
+        otherLoad = otherLoad < 0. ? others : (otherLoad + others) / 2.;
+    }
+    
+    unsigned int from = current;
+    string why;
+    if( s.memFull > mem_full_high )      // memory stalls hurt most, back off fast
+    {
+        current = current / 2 > minP ? current / 2 : minP;
+        why = "memory pressure";
+    }
+    else if( otherLoad >= 1. && current + otherLoad > ncpus + .5 )
+    {
+        if( current > minP )
+            current--;
+        why = "other load";
+    }
+    else if( current < maxP && running >= current && (otherLoad < 1. || current + 1 + otherLoad <= ncpus) )
+    {
+        current++;                            // only while we use all we have, an idle build says nothing
+        why = "idle cpu";
+    }
+    
+    if( current != from )
+        record( from, s, why);
+    
+    return current;
+}
+
+
+void LoadController::record( unsigned int from, const Sample &s, const string &why)
+{
+    changes++;
+    if( current < lowest )
+        lowest = current;
+    
+    if( verbosity > 0 )
+        cout << "Adaptive parallelism: " << from << " -> " << current << " (" << why << ", load/cpu " << s.load1
+             << ", other load " << otherLoad << ", psi cpu " << s.cpuSome << " mem " << s.memSome << "/" << s.memFull << " io " << s.ioFull << ")\n";
+    
+    if( BuildTrace::getTheBuildTrace()->isEnabled() )
+    {
+        stringstream name, args;
+        name << "parallel " << from << " -> " << current;
+        args << "{\"reason\":\"" << why << "\",\"load_per_cpu\":" << s.load1 << ",\"other_load\":" << otherLoad << ",\"psi_cpu_some\":" << s.cpuSome
+             << ",\"psi_mem_some\":" << s.memSome << ",\"psi_mem_full\":" << s.memFull << ",\"psi_io_full\":" << s.ioFull << "}";
+        
+        long long now = get_curr_time_us();
+        BuildTrace::getTheBuildTrace()->addInstant( name.str(), "adaptive", now, args.str());
+        BuildTrace::getTheBuildTrace()->addCounter( "parallel", now, current);
+    }
+}
+
+
+void LoadController::printStats() const
+{
+    if( enabled && changes > 0 )
+        cout << "Adaptive parallelism changed the number of local jobs " << changes << " time(s), lowest " << lowest
+             << ", now " << current << ".\n";
+}
@@ -0,0 +1,49 @@
+#ifndef FERRET_LOAD_CONTROLLER_H_
+#define FERRET_LOAD_CONTROLLER_H_
+
+#include <string>
+
+// adaptive parallelism (FERRET_ADAPTIVE=y). every interval the controller samples /proc/loadavg and the pressure
+// stall information in /proc/pressure/{cpu,memory,io} and sets the number of local jobs between FERRET_P_MIN and
+// FERRET_P. the build's own jobs cause cpu and io pressure too, so these only go to the build trace. it reacts to:
+//  - memory "full" pressure, all tasks stalled on memory: halves the jobs
+//  - other load: runnable tasks that are not the build's jobs, averaged over the samples. with at least one of those
+//    the jobs are lowered while jobs + other load exceed the cpus, and raised again while one more job still fits
+// without other load the jobs go up to FERRET_P as long as the build uses all it has. changes go to the build trace
+class LoadController {
+
+public:
+    LoadController()
+        : enabled(false), minP(1), maxP(1), current(1), interval_ms(2000), last_ms(0), changes(0), lowest(1), otherLoad(-1.)
+    {}
+    
+    void setup( unsigned int minParallel, unsigned int maxParallel, int intervalMs);
+    
+    bool isEnabled() const
+    { return enabled; }
+    
+    unsigned int limit( unsigned int maxParallel, size_t running);   // samples when the interval has passed
+    void printStats() const;
+
+private:
+    struct Sample {
+        double load1;                    // per cpu
+        int runnable;                    // tasks runnable right now, all of the host
+        double cpuSome, memSome, memFull, ioFull;   // avg10 in percent, -1 without PSI
+    };
+    
+    void sample( Sample &s ) const;
+    void record( unsigned int from, const Sample &s, const std::string &why);
+
+private:
+    bool enabled;
+    unsigned int minP, maxP, current;
+    int interval_ms;
+    long long last_ms;
+    int changes;
+    unsigned int lowest;
+    long ncpus;
+    double otherLoad;         // runnable tasks besides the build's jobs, -1 before the first sample
+};
+
+#endif
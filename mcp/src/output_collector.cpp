@@ -1,4 +1,5 @@
 #include <iostream>
+#include <cstdio>
 
 #include "output_collector.h"
 #include "base_node.h"
@@ -47,6 +48,7 @@ OutputCollector *OutputCollector::theOutputCollector = 0;
 
 
 OutputCollector::OutputCollector()
+    : reportOpen( false )
 {
 #ifdef  USE_CURSES
     screen = 0;
@@ -114,12 +116,6 @@ void OutputCollector::cursesUpdate()
 }
 
 
-void OutputCollector::appendJobOut( unsigned int job_id, const string &s)
-{
-    jobStorer.append( job_id, s);
-}
-
-
 void OutputCollector::appendJobStd( unsigned int job_id, const string &s)
 {
     jobStorer.appendStd( job_id, s);
@@ -139,6 +135,12 @@ bool OutputCollector::hasJobOut( unsigned int job_id ) const
 }
 
 
+bool OutputCollector::hasJobErr( unsigned int job_id ) const
+{
+    return jobStorer.hasErrOut( job_id );
+}
+
+
 void OutputCollector::cursesAppend( unsigned int job_id, const string &s)
 {
 #ifdef  USE_CURSES
@@ -230,18 +232,19 @@ string OutputCollector::getJobErrHtml( unsigned int job_id ) const
 }
 
 
-void OutputCollector::text( ofstream &os )
+// the report is written while the build runs and only ever appended to: <name>.html, <name>.txt
+// and <name>.jsonl (one JSON object per job). the html index of errors/warnings is built by the
+// browser from the rows
+void OutputCollector::reportBegin( const string &name )
 {
-    size_t i;
+    reportEnd();
     
-    for( i = 0; i < jobStorer.getSize(); i++)
-        os << jobStorer.getOutput( i+1 );
-}
-
-
-void OutputCollector::html( ofstream &os )
-{
-    os << "<!DOCTYPE HTML>\n"
+    reportHtml.open( (name + ".html").c_str() );
+    reportText.open( (name + ".txt").c_str() );
+    reportJson.open( (name + ".jsonl").c_str() );
+    reportOpen = true;
+    
+    reportHtml << "<!DOCTYPE HTML>\n"
         "<html>\n<head><meta http-equiv=\"Content-Type\" content=\"text/html; charset=UTF-8\" /><title>ferret works for you</title>"
         "<style>\n"
         "tr.stdout {\n"
@@ -255,82 +258,103 @@ void OutputCollector::html( ofstream &os )
         "   border: 3px solid #940000;\n"
         "   font-family:Consolas,Monaco,Lucida Console,Liberation Mono,DejaVu Sans Mono,Bitstream Vera Sans Mono,monospace;\n"
         "}\n"
+        "tr.usage {\n"
+        "   color: gray;\n"
+        "   font-size: small;\n"
+        "}\n"
         "tr.target {\n"
         "   color: sienna;\n"
         "   background-color : #B0B0A5;\n"
         "   border: 3px solid #C40000;\n"
         "   font-family:Consolas,Monaco,Lucida Console,Liberation Mono,DejaVu Sans Mono,Bitstream Vera Sans Mono,monospace;\n"
         "}\n"
-        "</style>"
+        "</style>\n"
+        "<script>\n"
+        "function ferretIndex() {\n"
+        "   var idx = document.getElementById( 'index' );\n"
+        "   var rows = document.querySelectorAll( 'tr.stderr td' );\n"
+        "   idx.innerHTML = '';\n"
+        "   for( var i = 0; i < rows.length; i++ ) {\n"
+        "      var a = document.createElement( 'a' );\n"
+        "      a.href = '#' + rows[i].id;\n"
+        "      a.textContent = (rows[i].getAttribute( 'data-failed' ) == '1' ? 'Errors/warnings of #' : 'Warnings of #') + rows[i].id;\n"
+        "      var tr = idx.insertRow( -1 );\n"
+        "      tr.insertCell( -1 ).appendChild( a );\n"
+        "   }\n"
+        "}\n"
+        "window.addEventListener( 'load', ferretIndex );\n"
+        "</script>\n"
         "</head>\n"
         "<body>\n"
+        "<table id=\"index\">\n</table>\n"
         "<table>\n";
+    reportHtml.flush();
+}
+
+
+void OutputCollector::reportJob( unsigned int job_id )
+{
+    if( !reportOpen )
+        return;
     
-    size_t i;
-    for( i = 0; i < jobStorer.getSize(); i++)
-    {
-        unsigned int job_id = i + 1;
-        
-        if( getJobErr( job_id ).length() > 0 )
-        {
-            os << "<tr><td>\n";
-            os << "<a href=\"#" << getJobFileId( job_id ) << "\">";
-            if( hasJobError( job_id ) )
-                os << "Errors/warnings of #";
-            else
-                os << "Warnings of #";
-            os << getJobFileId( job_id ) << "</a>\n"
-                "</td>\n</tr>\n";
-        }
-    }
+    string so = getJobStd( job_id );
+    string err = hasJobErr( job_id ) ? getJobErr( job_id ) : "";
+    int fid = getJobFileId( job_id );
+    bool failed = hasJobError( job_id );
     
-    os << "</table>\n"
-        "<table>\n";
+    reportHtml << "<!-- job id: " << job_id << " begins -->\n";
+    reportHtml << "<!-- job state is " << jobStorer.getStateAsString( job_id ) << " -->\n";
+    reportHtml << "<!-- file is " << jobStorer.getFileName( job_id ) << " -->\n";
+    
+    if( so.length() > 0 )
+        reportHtml << "<tr class=\"stdout\">\n<td><pre>" << replaceEntities( so ) << "</pre></td>\n</tr>\n";
+    
+    if( err.length() > 0 )
+        reportHtml << "<tr class=\"stderr\">\n<td id=\"" << fid << "\" data-failed=\"" << (failed ? 1 : 0) << "\">\n"
+                   << "<pre>" << replaceEntities( err ) << "</pre></td>\n</tr>\n";
+    
+    string msg = getHtml( job_id );
+    if( msg.length() > 0 )
+        reportHtml << "<tr>\n<td>" << msg << "</td>\n</tr>\n";
+    
+    JobUsage u = getJobUsage( job_id );
+    if( u.valid )
+        reportHtml << "<tr class=\"usage\">\n<td>" << replaceEntities( u.toString() ) << "</td>\n</tr>\n";
+    
+    reportHtml << "<!-- job id: " << job_id << " ends -->\n\n";
+    reportHtml.flush();
+    
+    reportText << getJobOut( job_id );
+    if( u.valid )
+        reportText << "[" << u.toString() << "]\n";
+    reportText.flush();
+    
+    reportJson << "{\"job\":" << job_id << ",\"file_id\":" << fid
+               << ",\"file\":\"" << jsonEscape( jobStorer.getFileName( job_id ) ) << "\""
+               << ",\"state\":\"" << jobStorer.getStateAsString( job_id ) << "\""
+               << ",\"stdout\":\"" << jsonEscape( so ) << "\",\"stderr\":\"" << jsonEscape( err ) << "\"";
+    if( u.valid )
+        reportJson << ",\"wall_ms\":" << u.wall_ms << ",\"utime_ms\":" << u.utime_ms << ",\"stime_ms\":" << u.stime_ms
+                   << ",\"maxrss_kb\":" << u.maxrss_kb << ",\"inblock\":" << u.inblock << ",\"oublock\":" << u.oublock
+                   << ",\"nvcsw\":" << u.nvcsw << ",\"nivcsw\":" << u.nivcsw;
+    reportJson << "}\n";
+    reportJson.flush();
+}
 
-    for( i = 0; i < jobStorer.getSize(); i++)
-    {
-        unsigned int job_id = i + 1;
-
-        os << "<!-- job id: " << job_id << " begins -->\n";
-        os << "<!-- job state is ";
-        os << jobStorer.getStateAsString( job_id );
-        os << " -->\n";
-        
-        os << "<!-- file is ";
-        os << jobStorer.getFileName( job_id );
-        os << " -->\n";
-        
-        string so = getJobStdHtml( job_id );
-        if( getJobStd( job_id ).length() > 0 )
-        {
-            os << "<tr class=\"stdout\">\n<td>";
-            os << so;
-            os << "</td>\n"
-                "</tr>\n";
-        }
-        
-        string err = getJobErrHtml( job_id );
-        if( getJobErr( job_id ).length() > 0 )
-        {
-            os << "<tr class=\"stderr\">\n<td id=\"" << getJobFileId( job_id ) << "\">\n";
-            os << err;
-            os << "</td>\n"
-                "</tr>\n";
-        }
-        
-        string msg = getHtml( job_id );
-        if( msg.length() > 0 )
-        {
-            os << "<tr>\n<td>";
-            os << msg;
-            os << "</td>\n"
-                "</tr>\n";
-        }
-        os << "<!-- job id: " << job_id << " ends -->\n\n";
-    }
 
-    os << "</table>\n\n" << freeHtml
-       << "\n</body>\n</html>\n";
+void OutputCollector::reportEnd()
+{
+    if( !reportOpen )
+        return;
+    
+    reportHtml << "</table>\n\n" << freeHtml
+               << "\n</body>\n</html>\n";
+    freeHtml = "";
+    
+    reportHtml.close();
+    reportText.close();
+    reportJson.close();
+    reportOpen = false;
 }
 
 
@@ -362,22 +386,6 @@ string OutputCollector::getHtml( unsigned int job_id ) const
 }
 
 
-void OutputCollector::resetHtml( std::ofstream &os )
-{
-     os << "<!DOCTYPE HTML>\n"
-         "<html>\n<head><meta http-equiv=\"Content-Type\" content=\"text/html; charset=UTF-8\" /><title>ferret works for you</title>"
-         "<style>\n"
-         "p {\n"
-         "   font-family:DejaVu Sans Mono,Consolas,Lucida Console,Liberation Mono,Bitstream Vera Sans Mono,monospace;\n"
-         "}\n"
-         "</style>\n"
-         "</head>\n"
-         "<body>\n"
-         "<p>Please wait...</p>\n"
-         "</body>\n</html>\n";
-}
-
-
 void OutputCollector::setJobError( unsigned int job_id, bool err)
 {
     jobStorer.setError( job_id, err);
@@ -30,10 +30,12 @@ public:
     void cursesEventHandler();
     void cursesUpdate();
     
-    void appendJobOut( unsigned int job_id, const std::string &s);
     void appendJobStd( unsigned int job_id, const std::string &s);
     void appendJobErr( unsigned int job_id, const std::string &s);
     bool hasJobOut( unsigned int job_id ) const;
+    bool hasJobErr( unsigned int job_id ) const;
+    void setOutputMemLimit( size_t bytes )
+    { jobStorer.setMemLimit( bytes ); }
     
     void cursesAppend( unsigned int job_id, const std::string &s);
     void cursesEnd( unsigned int job_id );
@@ -42,25 +44,31 @@ public:
     void cursesSetTopLine( int y, const std::string &l);
     void cursesTopShowJob( unsigned int job_id );
     
-    std::string getJobOut( unsigned int job_id ) const;
+    std::string getJobOut( unsigned int job_id ) const;    // materializes output, which may have been spilled to disk
     std::string getJobOutHtml( unsigned int job_id  ) const;
     std::string getJobStd( unsigned int job_id  ) const;
     std::string getJobStdHtml( unsigned int job_id ) const;
     std::string getJobErr( unsigned int job_id ) const;
     std::string getJobErrHtml( unsigned int job_id ) const;
     
-    void text( std::ofstream &os );
-    void html( std::ofstream &os );
+    void reportBegin( const std::string &name );     // appends to <name>.html, .txt and .jsonl from now on
+    void reportJob( unsigned int job_id );            // call when job is finished
+    void reportEnd();
+    
     void addHtml( unsigned int job_id, const std::string &s);
     std::string getHtml( unsigned int job_id ) const;
     void addFreeHtml( const std::string &s )
     { freeHtml.append( s ); }
-    void resetHtml( std::ofstream &os );
     
     void setJobError( unsigned int job_id, bool err);
     bool hasJobError( unsigned int job_id );
     int  getJobFileId( unsigned int job_id );
     
+    void setJobUsage( unsigned int job_id, const JobUsage &u)
+    { jobStorer.setUsage( job_id, u); }
+    JobUsage getJobUsage( unsigned int job_id ) const
+    { return jobStorer.getUsage( job_id ); }
+    
     void clear();
     
     void setProjectNodesDir( const std::string &dir );
@@ -77,6 +85,9 @@ private:
     std::map<unsigned int,std::string> jobHtml;
     std::string freeHtml;
     
+    bool reportOpen;
+    std::ofstream reportHtml, reportText, reportJson;
+    
     std::string projectdir;
     
 #ifdef  USE_CURSES
@@ -0,0 +1,368 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <map>
+#include <algorithm>
+
+#include "perf_history.h"
+#include "glob_utility.h"
+#include "phase_profiler.h"
+
+using namespace std;
+
+// ferret_history is plain text, one block per run:
+//   run <start_ms> <parallel> <targets> <failed> <compile mode> <full|incremental>
+//   phase <ms> <name>
+//   count <n> <counter> <name of the phase above>     (only counters != 0)
+//   job <file_id> <dep type> <wall_ms> <maxrss_kb> <file name>
+//   end
+
+PerfHistory *PerfHistory::thePerfHistory = 0;
+
+
+PerfHistory *PerfHistory::getThePerfHistory()
+{
+    if( thePerfHistory == 0 )
+        thePerfHistory = new PerfHistory;
+    
+    return thePerfHistory;
+}
+
+
+void PerfHistory::addPhase( const string &name, long long us, const long long *counts)
+{
+    Phase p;
+    p.name = name;
+    p.ms = us / 1000;
+    if( counts )
+        for( int c = 0; c < PROF_COUNTERS; c++)
+            if( counts[ c ] )
+                p.counts[ PhaseProfiler::counterName( c ) ] = counts[ c ];
+    curr.phases.push_back( p );
+}
+
+
+void PerfHistory::addJob( int file_id, const string &depType, const string &fn, long long wall_ms, long long maxrss_kb)
+{
+    JobRec j;
+    j.file_id = file_id;
+    j.depType = depType;
+    j.fileName = fn;
+    j.wall_ms = wall_ms;
+    j.maxrss_kb = maxrss_kb;
+    curr.jobs.push_back( j );
+}
+
+
+void PerfHistory::setRunInfo( const string &compileMode, int parallel, int targets, int failed, bool full)
+{
+    curr.start_ms = startTimeMs;
+    curr.compileMode = compileMode;
+    curr.kind = full ? "full" : "incremental";
+    curr.parallel = parallel;
+    curr.targets = targets;
+    curr.failed = failed;
+}
+
+
+void PerfHistory::writeRun( FILE *fp, const Run &r)
+{
+    fprintf( fp, "run %lld %d %d %d %s %s\n", r.start_ms, r.parallel, r.targets, r.failed, r.compileMode.c_str(), r.kind.c_str());
+    
+    for( size_t i = 0; i < r.phases.size(); i++)
+    {
+        const Phase &p = r.phases[i];
+        fprintf( fp, "phase %lld %s\n", p.ms, p.name.c_str());
+        for( map<string,long long>::const_iterator it = p.counts.begin(); it != p.counts.end(); it++)
+            fprintf( fp, "count %lld %s %s\n", it->second, it->first.c_str(), p.name.c_str());
+    }
+    
+    for( size_t i = 0; i < r.jobs.size(); i++)
+    {
+        const JobRec &j = r.jobs[i];
+        fprintf( fp, "job %d %s %lld %lld %s\n", j.file_id, j.depType.c_str(), j.wall_ms, j.maxrss_kb, j.fileName.c_str());
+    }
+    
+    fprintf( fp, "end\n");
+}
+
+
+bool PerfHistory::readRuns( const string &fn, vector<Run> &runs)
+{
+    FILE *fp = fopen( fn.c_str(), "r");
+    if( !fp )
+        return false;
+    
+    char line[ 4096 ];
+    bool inRun = false;
+    Run r;
+    
+    while( fgets( line, sizeof(line), fp) )
+    {
+        size_t len = strlen( line );
+        if( len > 0 && line[ len - 1 ] == '\n' )
+            line[ --len ] = 0;
+        
+        if( strncmp( line, "run ", 4) == 0 )
+        {
+            char mode[ 256 ], kind[ 32 ];
+            r = Run();
+            mode[0] = kind[0] = 0;
+            inRun = sscanf( line + 4, "%lld %d %d %d %255s %31s", &r.start_ms, &r.parallel, &r.targets, &r.failed, mode, kind) >= 4;
+            r.compileMode = mode;
+            r.kind = kind;
+        }
+        else if( inRun && strncmp( line, "phase ", 6) == 0 )
+        {
+            Phase p;
+            int n = 0;
+            if( sscanf( line + 6, "%lld %n", &p.ms, &n) >= 1 && n > 0 )
+            {
+                p.name = line + 6 + n;
+                r.phases.push_back( p );
+            }
+        }
+        else if( inRun && strncmp( line, "count ", 6) == 0 )
+        {
+            long long v;
+            char counter[ 64 ];
+            if( r.phases.size() > 0 && sscanf( line + 6, "%lld %63s", &v, counter) == 2 )
+                r.phases.back().counts[ counter ] = v;
+        }
+        else if( inRun && strncmp( line, "job ", 4) == 0 )
+        {
+            JobRec j;
+            char type[ 64 ];
+            int n = 0;
+            if( sscanf( line + 4, "%d %63s %lld %lld %n", &j.file_id, type, &j.wall_ms, &j.maxrss_kb, &n) >= 4 && n > 0 )
+            {
+                j.depType = type;
+                j.fileName = line + 4 + n;
+                r.jobs.push_back( j );
+            }
+        }
+        else if( inRun && strcmp( line, "end") == 0 )
+        {
+            runs.push_back( r );
+            inRun = false;
+        }
+    }
+    
+    fclose( fp );
+    return true;
+}
+
+
+bool PerfHistory::append( const string &dbProjDir )
+{
+    if( maxRuns <= 0 )
+        return true;
+    
+    string fn = stackPath( dbProjDir, "ferret_history");
+    vector<Run> runs;
+    readRuns( fn, runs);
+    
+    FILE *fp;
+    if( (int)runs.size() >= maxRuns )   // drop the oldest runs
+    {
+        fp = fopen( fn.c_str(), "w");
+        if( fp )
+            for( size_t i = runs.size() - (maxRuns - 1); i < runs.size(); i++)
+                writeRun( fp, runs[i]);
+    }
+    else
+        fp = fopen( fn.c_str(), "a");
+    
+    if( !fp )
+    {
+        cerr << "warning: could not write " << fn << "\n";
+        return false;
+    }
+    
+    writeRun( fp, curr);
+    fclose( fp );
+    
+    if( verbosity > 0 )
+        cout << "Perf history: " << curr.phases.size() << " phases, " << curr.jobs.size() << " jobs written to " << fn << "\n";
+    return true;
+}
+
+
+struct Regression {
+    string depType, fileName;
+    long long last_ms, base_ms, last_rss, base_rss;
+    
+    bool operator<( const Regression &o ) const
+    { return (last_ms - base_ms) > (o.last_ms - o.base_ms); }
+};
+
+
+static string fmtTime( long long ms )
+{
+    time_t t = (time_t)(ms / 1000);
+    char buf[ 64 ];
+    strftime( buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime( &t ));
+    return buf;
+}
+
+
+static string fmtDelta( long long last, long long base)
+{
+    ostringstream os;
+    long long d = last - base;
+    os << (d >= 0 ? "+" : "") << d << "ms";
+    if( base > 0 )
+        os << " (" << (d >= 0 ? "+" : "") << (d * 100 / base) << "%)";
+    return os.str();
+}
+
+
+void PerfHistory::report( const string &dbProjDir, int baselineRuns, int top)
+{
+    string fn = stackPath( dbProjDir, "ferret_history");
+    vector<Run> runs;
+    
+    if( !readRuns( fn, runs) || runs.size() == 0 )
+    {
+        cout << "No build history in " << fn << " yet.\n";
+        return;
+    }
+    
+    // only runs of the same compile mode and kind are comparable, an incremental build is no regression of a full one
+    const Run &last = runs.back();
+    vector<const Run *> base;
+    for( size_t r = runs.size() - 1; r > 0 && (int)base.size() < baselineRuns; r--)
+        if( runs[ r - 1 ].compileMode == last.compileMode && runs[ r - 1 ].kind == last.kind )
+            base.insert( base.begin(), &runs[ r - 1 ]);
+    size_t nbase = base.size();
+    
+    cout << "Last run " << fmtTime( last.start_ms ) << ", " << (last.kind.length() > 0 ? last.kind : "unknown")
+         << " build, compile mode " << last.compileMode << ", -p " << last.parallel
+         << ", " << last.targets << " target(s), " << last.jobs.size() << " job(s), " << last.failed << " failed.\n";
+    
+    if( nbase == 0 )
+    {
+        cout << "No earlier runs of the same kind and compile mode to compare with.\n";
+        return;
+    }
+    cout << "Baseline: mean of " << nbase << " previous run(s) since " << fmtTime( base[0]->start_ms ) << ".\n\n";
+    
+    // phases, same name in one run is summed up
+    vector<string> order;
+    map<string,long long> lastPh, basePh;
+    map<string,int> baseCnt;
+    for( size_t i = 0; i < last.phases.size(); i++)
+    {
+        if( lastPh.find( last.phases[i].name ) == lastPh.end() )
+            order.push_back( last.phases[i].name );
+        lastPh[ last.phases[i].name ] += last.phases[i].ms;
+    }
+    for( size_t r = 0; r < nbase; r++)
+    {
+        map<string,long long> sum;
+        for( size_t i = 0; i < base[r]->phases.size(); i++)
+            sum[ base[r]->phases[i].name ] += base[r]->phases[i].ms;
+        for( map<string,long long>::const_iterator it = sum.begin(); it != sum.end(); it++)
+        {
+            basePh[ it->first ] += it->second;
+            baseCnt[ it->first ]++;
+        }
+    }
+    
+    cout << "Phases (last / baseline):\n";
+    for( size_t i = 0; i < order.size(); i++)
+    {
+        const string &n = order[i];
+        cout << "  " << setw(10) << lastPh[ n ] << "ms ";
+        if( baseCnt[ n ] > 0 )
+        {
+            long long b = basePh[ n ] / baseCnt[ n ];
+            cout << setw(10) << b << "ms  " << setw(18) << fmtDelta( lastPh[ n ], b);
+        }
+        else
+            cout << setw(12) << "-" << "  " << setw(18) << "";
+        cout << "  " << n << "\n";
+    }
+    
+    // counters, same as phases
+    map<string,map<string,long long> > lastCnt, baseCntSum;
+    for( size_t i = 0; i < last.phases.size(); i++)
+        for( map<string,long long>::const_iterator it = last.phases[i].counts.begin(); it != last.phases[i].counts.end(); it++)
+            lastCnt[ last.phases[i].name ][ it->first ] += it->second;
+    for( size_t r = 0; r < nbase; r++)
+        for( size_t i = 0; i < base[r]->phases.size(); i++)
+            for( map<string,long long>::const_iterator it = base[r]->phases[i].counts.begin(); it != base[r]->phases[i].counts.end(); it++)
+                baseCntSum[ base[r]->phases[i].name ][ it->first ] += it->second;
+    
+    if( lastCnt.size() > 0 )
+    {
+        cout << "\nCounters (last / baseline):\n";
+        for( size_t i = 0; i < order.size(); i++)
+        {
+            const string &n = order[i];
+            const map<string,long long> &lc = lastCnt[ n ];
+            for( map<string,long long>::const_iterator it = lc.begin(); it != lc.end(); it++)
+            {
+                cout << "  " << setw(12) << it->second << " ";
+                if( baseCnt[ n ] > 0 )
+                {
+                    long long b = baseCntSum[ n ][ it->first ] / baseCnt[ n ];
+                    ostringstream d;
+                    d << (it->second >= b ? "+" : "") << it->second - b;
+                    cout << setw(12) << b << "  " << setw(13) << d.str();
+                }
+                else
+                    cout << setw(12) << "-" << "  " << setw(13) << "";
+                cout << "  " << setw(15) << it->first << "  " << n << "\n";
+            }
+        }
+    }
+    
+    // jobs, keyed by file name since file ids change with --init
+    map<string,long long> baseMs, baseRss;
+    map<string,int> jobCnt;
+    for( size_t r = 0; r < nbase; r++)
+        for( size_t i = 0; i < base[r]->jobs.size(); i++)
+        {
+            const JobRec &j = base[r]->jobs[i];
+            baseMs[ j.fileName ] += j.wall_ms;
+            baseRss[ j.fileName ] += j.maxrss_kb;
+            jobCnt[ j.fileName ]++;
+        }
+    
+    vector<Regression> regs;
+    for( size_t i = 0; i < last.jobs.size(); i++)
+    {
+        const JobRec &j = last.jobs[i];
+        map<string,int>::const_iterator c = jobCnt.find( j.fileName );
+        if( c == jobCnt.end() )
+            continue;
+        
+        Regression g;
+        g.depType = j.depType;
+        g.fileName = j.fileName;
+        g.last_ms = j.wall_ms;
+        g.base_ms = baseMs[ j.fileName ] / c->second;
+        g.last_rss = j.maxrss_kb;
+        g.base_rss = baseRss[ j.fileName ] / c->second;
+        if( g.last_ms > g.base_ms )
+            regs.push_back( g );
+    }
+    
+    sort( regs.begin(), regs.end());
+    
+    cout << "\nTop " << top << " job regressions (last / baseline, peak RSS last / baseline):\n";
+    if( regs.size() == 0 )
+        cout << "  none.\n";
+    for( size_t i = 0; i < regs.size() && (int)i < top; i++)
+    {
+        const Regression &g = regs[i];
+        cout << "  " << setw(10) << g.last_ms << "ms " << setw(10) << g.base_ms << "ms  " << setw(18) << fmtDelta( g.last_ms, g.base_ms)
+             << "  " << setw(8) << g.last_rss << "k / " << setw(8) << g.base_rss << "k  "
+             << setw(4) << g.depType << "  " << g.fileName << "\n";
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef FERRET_PERF_HISTORY_H_
+#define FERRET_PERF_HISTORY_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <map>
+
+// one record per build run in ferret_history (text, appended), see ferret --perf-report
+class PerfHistory {
+    
+public:
+    struct Phase {
+        std::string name;
+        long long ms;
+        std::map<std::string,long long> counts;    // hot path counters, see phase_profiler.h
+    };
+    
+    struct JobRec {
+        int file_id;
+        std::string depType;
+        std::string fileName;
+        long long wall_ms;
+        long long maxrss_kb;
+    };
+    
+    struct Run {
+        Run()
+            : start_ms(0), parallel(0), targets(0), failed(0)
+        {}
+        
+        long long start_ms;
+        int parallel, targets, failed;
+        std::string compileMode;
+        std::string kind;          // "full" if every command was built, else "incremental"
+        std::vector<Phase> phases;
+        std::vector<JobRec> jobs;
+    };
+    
+private:
+    PerfHistory()
+        : maxRuns(30)
+    {}
+    
+public:
+    static PerfHistory *getThePerfHistory();
+    
+    void addPhase( const std::string &name, long long us, const long long *counts = 0);
+    void addJob( int file_id, const std::string &depType, const std::string &fn, long long wall_ms, long long maxrss_kb);
+    void setRunInfo( const std::string &compileMode, int parallel, int targets, int failed, bool full);
+    
+    void setMaxRuns( int n )        // 0 turns history off
+    { maxRuns = n; }
+    
+    bool append( const std::string &dbProjDir );
+    
+    static void report( const std::string &dbProjDir, int baselineRuns, int top);
+    
+private:
+    static bool readRuns( const std::string &fn, std::vector<Run> &runs);
+    static void writeRun( FILE *fp, const Run &r);
+    
+private:
+    static PerfHistory *thePerfHistory;
+    
+    Run curr;
+    int maxRuns;
+};
+
+#endif
@@ -0,0 +1,235 @@
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <unistd.h>
+
+#include "phase_profiler.h"
+#include "glob_utility.h"
+
+using namespace std;
+
+
+__thread long long prof_counters[ PROF_COUNTERS ];
+
+static const char *counterNames[ PROF_COUNTERS ] = { "stat", "exists", "cached_file", "uncached_file", "exists_uncached",
+                                                     "hashed", "name_lookup", "hash_s", "set_add", "set_has", "forks" };
+
+
+PhaseProfiler::Node::Node( const string &name, Node *parent)
+    : name(name), parent(parent), calls(0), start_us(0), us(0)
+{
+    memset( counters, 0, sizeof(counters));
+    memset( begin_counts, 0, sizeof(begin_counts));
+}
+
+
+long long PhaseProfiler::Node::total( int c ) const
+{
+    long long t = counters[ c ];
+    for( size_t i = 0; i < children.size(); i++)
+        t += children[i]->total( c );
+    return t;
+}
+
+
+PhaseProfiler *PhaseProfiler::thePhaseProfiler = 0;
+
+PhaseProfiler *PhaseProfiler::getThePhaseProfiler()
+{
+    if( thePhaseProfiler == 0 )
+        thePhaseProfiler = new PhaseProfiler;
+    
+    return thePhaseProfiler;
+}
+
+
+PhaseProfiler::PhaseProfiler()
+    : root( "ferret", 0), current(&root), depth(0)
+{
+    root.calls = 1;
+    root.start_us = mark_us = now_us();
+    memset( seen, 0, sizeof(seen));
+    memset( last_counts, 0, sizeof(last_counts));
+}
+
+
+const char *PhaseProfiler::counterName( int c )
+{
+    return counterNames[ c ];
+}
+
+
+long long PhaseProfiler::now_us()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_REALTIME, &ts);
+    
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+void PhaseProfiler::start()
+{
+    root.start_us = mark_us = now_us();
+    memcpy( seen, prof_counters, sizeof(seen));
+}
+
+
+PhaseProfiler::Node *PhaseProfiler::child( Node *parent, const string &name)
+{
+    for( size_t i = 0; i < parent->children.size(); i++)
+        if( parent->children[i]->name == name )
+            return parent->children[i];
+    
+    Node *n = new Node( name, parent);
+    parent->children.push_back( n );
+    return n;
+}
+
+
+void PhaseProfiler::claim( long long *to )       // counts since the last mark
+{
+    for( int c = 0; c < PROF_COUNTERS; c++)
+    {
+        long long now = prof_counters[ c ];
+        to[ c ] += now - seen[ c ];
+        seen[ c ] = now;
+    }
+}
+
+
+void PhaseProfiler::begin( const string &name )
+{
+    claim( current->counters );       // counts nobody claimed stay with the parent itself
+    
+    Node *n = child( current, name);
+    n->calls++;
+    n->start_us = mark_us = now_us();
+    memcpy( n->begin_counts, prof_counters, sizeof(n->begin_counts));
+    
+    current = n;
+    depth++;
+}
+
+
+PhaseProfiler::Node *PhaseProfiler::end()
+{
+    Node *n = current;
+    if( n == &root )
+        return n;
+    
+    claim( n->counters );
+    mark_us = now_us();
+    n->us += mark_us - n->start_us;
+    for( int c = 0; c < PROF_COUNTERS; c++)
+        last_counts[ c ] = prof_counters[ c ] - n->begin_counts[ c ];
+    
+    current = n->parent;
+    depth--;
+    return n;
+}
+
+
+PhaseProfiler::Node *PhaseProfiler::leaf( const string &name )
+{
+    Node *n = child( current, name);
+    long long now = now_us();
+    
+    n->calls++;
+    n->start_us = mark_us;
+    n->us += now - mark_us;
+    
+    memset( last_counts, 0, sizeof(last_counts));
+    claim( last_counts );
+    for( int c = 0; c < PROF_COUNTERS; c++)
+        n->counters[ c ] += last_counts[ c ];
+    
+    mark_us = now;
+    return n;
+}
+
+
+void PhaseProfiler::setJsonFile( const string &fn )
+{
+    char cwd[1025];
+    
+    if( fn.length() > 0 && fn[0] != '/' && getcwd( cwd, 1024) )   // we change directory later on
+        jsonFile = string( cwd ) + "/" + fn;
+    else
+        jsonFile = fn;
+}
+
+
+void PhaseProfiler::printNode( ostream &os, const Node *n, int level) const
+{
+    char buf[ 32 ];
+    snprintf( buf, sizeof(buf), "%9.3fs", n->us / 1e6);
+    
+    os << buf << "  " << string( level * 2, ' ') << n->name;
+    if( n->calls > 1 )
+        os << " (" << n->calls << "x)";
+    
+    for( int c = 0; c < PROF_COUNTERS; c++)
+    {
+        long long t = n->total( c );
+        if( t )
+            os << "  " << counterNames[ c ] << "=" << t;
+    }
+    os << "\n";
+    
+    for( size_t i = 0; i < n->children.size(); i++)
+        printNode( os, n->children[i], level + 1);
+}
+
+
+void PhaseProfiler::jsonNode( ostream &os, const Node *n, int level) const
+{
+    string ind( level * 2, ' ');
+    
+    os << ind << "{\"name\": \"" << jsonEscape( n->name ) << "\", \"calls\": " << n->calls << ", \"us\": " << n->us
+       << ", \"counters\": {";
+    for( int c = 0; c < PROF_COUNTERS; c++)
+        os << (c ? ", " : "") << "\"" << counterNames[ c ] << "\": " << n->total( c );
+    os << "}";
+    
+    if( n->children.size() )
+    {
+        os << ", \"children\": [\n";
+        for( size_t i = 0; i < n->children.size(); i++)
+        {
+            jsonNode( os, n->children[i], level + 1);
+            os << (i + 1 < n->children.size() ? ",\n" : "\n");
+        }
+        os << ind << "]";
+    }
+    os << "}";
+}
+
+
+void PhaseProfiler::finish( bool printTree )
+{
+    while( current != &root )
+        end();
+    claim( root.counters );
+    root.us = now_us() - root.start_us;
+    
+    if( printTree )
+    {
+        cout << "\nphases (counters include sub phases):\n";
+        printNode( cout, &root, 0);
+    }
+    
+    if( jsonFile.length() )
+    {
+        ofstream os( jsonFile.c_str() );
+        if( !os )
+        {
+            cerr << "error: could not write " << jsonFile << "\n";
+            return;
+        }
+        jsonNode( os, &root, 0);
+        os << "\n";
+    }
+}
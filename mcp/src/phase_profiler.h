@@ -0,0 +1,101 @@
+#ifndef FERRET_PHASE_PROFILER_H_
+#define FERRET_PHASE_PROFILER_H_
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+// counters attributed to the phase running when they are hit, always compiled in
+typedef enum {
+    PROF_STAT = 0,         // stat() calls
+    PROF_EXISTS,           // FindFiles::exists()
+    PROF_CACHED_FILE,      // FindFiles::getCachedFile()
+    PROF_UNCACHED_FILE,    // FindFiles::getUncachedFile()
+    PROF_EXISTS_UNCACHED,  // FindFiles::existsUncached()
+    PROF_HASHED,           // files hashed to compare contents
+    PROF_LOOKUP,           // FileMap::getIdForFileName()
+    PROF_HASH_S,           // file name hashes computed, hash_s() in file_map.cpp
+    PROF_SET_ADD,          // hash_set_add()
+    PROF_SET_HAS,          // hash_set_has_id()
+    PROF_FORK,             // processes started
+    PROF_COUNTERS
+} prof_counter_t;
+
+// one array per thread. a helper thread hands its counts to the main thread when it is joined, see prof_merge()
+extern __thread long long prof_counters[ PROF_COUNTERS ];
+
+// tree of nested phases for --times, see PhaseScope and phase_end() in glob_utility.h
+class PhaseProfiler {
+    
+public:
+    struct Node {
+        Node( const std::string &name, Node *parent);
+        
+        std::string name;
+        Node *parent;
+        std::vector<Node *> children;
+        int calls;
+        long long start_us, us;
+        long long counters[ PROF_COUNTERS ];     // not counting children
+        long long begin_counts[ PROF_COUNTERS ]; // prof_counters at begin()
+        
+        long long total( int c ) const;
+    };
+    
+private:
+    PhaseProfiler();
+    
+public:
+    static PhaseProfiler *getThePhaseProfiler();
+    
+    static const char *counterName( int c );
+    static long long now_us();
+    
+    void start();                                   // at ferret's start, resets everything
+    void begin( const std::string &name );          // nested phase
+    Node *end();
+    Node *leaf( const std::string &name );          // ends a phase which began at the last mark
+    
+    int getDepth() const
+    { return depth; }
+    
+    long long getMark() const      // end of the last phase
+    { return mark_us; }
+    
+    const long long *getLastCounts() const   // counters of the phase just ended by leaf() or end()
+    { return last_counts; }
+    
+    void setJsonFile( const std::string &fn );
+    void finish( bool printTree );
+    
+private:
+    Node *child( Node *parent, const std::string &name);
+    void claim( long long *to );
+    void printNode( std::ostream &os, const Node *n, int level) const;
+    void jsonNode( std::ostream &os, const Node *n, int level) const;
+    
+private:
+    static PhaseProfiler *thePhaseProfiler;
+    
+    Node root;
+    Node *current;
+    int depth;
+    long long mark_us;
+    long long seen[ PROF_COUNTERS ];          // prof_counters already attributed to a node
+    long long last_counts[ PROF_COUNTERS ];
+    std::string jsonFile;
+};
+
+
+inline void prof_count( prof_counter_t c, long long n = 1)
+{
+    prof_counters[ c ] += n;
+}
+
+inline void prof_merge( const long long *counts )
+{
+    for( int c = 0; c < PROF_COUNTERS; c++)
+        prof_counters[ c ] += counts[ c ];
+}
+
+#endif
@@ -1,6 +1,7 @@
 #include <cstdio>
 #include <iostream>
 #include <sstream>
+#include <cstdlib>
 
 #include "platform_spec.h"
 #include "simple_xml_stream.h"
@@ -294,6 +295,8 @@ bool PlatformSpec::read( const string &fn )
                     
                 if( attr.hasAttribute( "value" ) )
                     currCm = CompileMode( attr.value( "value" ) );
+                if( attr.hasAttribute( "timetrace" ) )
+                    currCm.setTimeTrace( attr.value( "timetrace" ) == "true" );
             }
             else if( xmls->path() == "/platform/compile_mode/cppflags" )
             {
@@ -373,6 +376,14 @@ bool PlatformSpec::read( const string &fn )
                     addTool( currTool );
                 }
             }
+            else if( xmls->path() == "/platform/pool" )
+            {
+                SimpleXMLAttributes attr = xmls->attributes();
+                
+                if( attr.hasAttribute( "name" ) && attr.hasAttribute( "size" ) )
+                    pools.push_back( PoolSpec( attr.value( "name" ), atoi( attr.value( "size" ).c_str() ),
+                                               attr.hasAttribute( "types" ) ? attr.value( "types" ) : "") );
+            }
             else if( xmls->path() == "/platform/compiler" )
             {
                 SimpleXMLAttributes attr = xmls->attributes();
@@ -78,18 +78,23 @@ class CompileMode
 {
 public:
     CompileMode()
-        : mode( "INVALID" )
+        : mode( "INVALID" ), timeTrace(false)
     {
     }
     
     CompileMode( const std::string &mode )
-        : mode(mode)
+        : mode(mode), timeTrace(false)
     {
     }
 
     std::string getMode() const
     { return mode; }
     
+    void setTimeTrace( bool tt )   // clang's -ftime-trace for C and C++ objects, see TimeTraceReport
+    { timeTrace = tt; }
+    bool hasTimeTrace() const
+    { return timeTrace; }
+    
     void addCppFlag( const std::string &flag );
     void addCFlag( const std::string &flag );
     void addLFlag( const std::string &flag );
@@ -102,6 +107,7 @@ public:
     
 private:
     std::string mode;
+    bool timeTrace;
 
     std::vector<std::string> cppflags;         // c++ compiler flags for compile mode
     std::vector<std::string> cflags;           // c compiler flags for compile mode
@@ -146,6 +152,31 @@ private:
 };
 
 
+// concurrency pool, at most size jobs of the listed dependency types ("L", "Cpp", an extension's type) at a time
+class PoolSpec
+{
+public:
+    PoolSpec( const std::string &name, int size, const std::string &types)
+        : name(name), size(size), types(types)
+    {
+    }
+    
+    std::string getName() const
+    { return name; }
+    
+    int getSize() const
+    { return size; }
+    
+    std::string getTypes() const   // separated by blanks, empty for just the type named like the pool
+    { return types; }
+    
+private:
+    std::string name;
+    int size;
+    std::string types;
+};
+
+
 class Executor;
 
 class PlatformSpec
@@ -166,6 +197,9 @@ public:
     bool hasCompileTrait( const std::string &type );
     CompileTrait getCompileTrait( const std::string &type );
     ToolSpec getTool( const std::string &name );
+    
+    const std::vector<PoolSpec> &getPools() const
+    { return pools; }
 
     std::string getCompilerVersion() const;
     std::string getCppCompiler() const;
@@ -208,6 +242,7 @@ private:
     std::vector<CompileMode>  compileModes;     // compile_mode tag, DEBUG, RELEASE...
     std::vector<CompileTrait> compileTraits;    // compile_trait tag, library
     std::vector<ToolSpec>     tools;            // tool tag
+    std::vector<PoolSpec>     pools;            // pool tag
 
     std::string buildDir;
 };
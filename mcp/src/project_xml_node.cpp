@@ -342,6 +342,8 @@ vector<string> ProjectXmlNode::traverseXmlStructureForChildren( int level )
                 
                 libsMap[ t ] = dep->getLibDir();
                 searchLibDirs.push_back( dep->getLibDir() );
+                if( dep->getType() != "library" )
+                    staticLibs.insert( t );
             }
         }
     }
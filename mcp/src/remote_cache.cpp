@@ -0,0 +1,317 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "remote_cache.h"
+#include "sha256.h"
+#include "glob_utility.h"
+
+using namespace std;
+
+
+bool RemoteCache::setup( const string &url, bool up)
+{
+    upload = up;
+    
+    if( url.compare( 0, 7, "http://") != 0 )
+    {
+        cerr << "warning: remote cache '" << url << "' is not an http:// URL, remote cache is off.\n";
+        return false;
+    }
+    
+    string rest = url.substr( 7 );
+    size_t slash = rest.find( '/' );
+    string hostPort = rest.substr( 0, slash);
+    prefix = slash == string::npos ? "" : rest.substr( slash );
+    while( prefix.length() > 0 && prefix[ prefix.length() - 1 ] == '/' )
+        prefix.erase( prefix.length() - 1 );
+    
+    size_t colon = hostPort.find( ':' );
+    host = hostPort.substr( 0, colon);
+    if( colon != string::npos )
+        port = atoi( hostPort.c_str() + colon + 1 );
+    
+    enabled = host.length() > 0 && port > 0;
+    if( enabled && verbosity > 0 )
+        cout << "Remote cache at " << host << ":" << port << prefix << (upload ? ", uploading" : "") << "\n";
+    return enabled;
+}
+
+
+void RemoteCache::failed( const string &what )
+{
+    errors++;
+    cerr << "warning: remote cache: " << what << "\n";
+    
+    if( enabled )     // a slow or broken server would stall every job, one miss is cheaper
+    {
+        cerr << "warning: remote cache turned off for this build.\n";
+        enabled = false;
+    }
+}
+
+
+// connect() with a timeout, the OS default is minutes when the host does not answer
+static bool connectWithin( int fd, const struct sockaddr *addr, socklen_t len, int timeout_ms)
+{
+    int flags = fcntl( fd, F_GETFL, 0);
+    if( flags < 0 || fcntl( fd, F_SETFL, flags | O_NONBLOCK) < 0 )
+        return false;
+    
+    int r = connect( fd, addr, len);
+    if( r != 0 && errno == EINPROGRESS )
+    {
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLOUT;
+        
+        int err = 0;
+        socklen_t errLen = sizeof(err);
+        if( poll( &pfd, 1, timeout_ms) == 1 && getsockopt( fd, SOL_SOCKET, SO_ERROR, &err, &errLen) == 0 && err == 0 )
+            r = 0;
+    }
+    
+    return r == 0 && fcntl( fd, F_SETFL, flags) == 0;
+}
+
+
+// one request per connection, returns the HTTP status or -1
+int RemoteCache::request( const string &method, const string &path, const string &body, string &reply)
+{
+    struct addrinfo hints, *res;
+    char portStr[ 16 ];
+    
+    memset( &hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf( portStr, sizeof(portStr), "%d", port);
+    
+    if( getaddrinfo( host.c_str(), portStr, &hints, &res) != 0 )
+        return -1;
+    
+    int fd = -1;
+    for( struct addrinfo *ai = res; ai != 0 && fd < 0; ai = ai->ai_next)
+    {
+        fd = socket( ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if( fd < 0 )
+            continue;
+        
+        struct timeval tv;
+        tv.tv_sec = 10;
+        tv.tv_usec = 0;
+        setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        
+        if( !connectWithin( fd, ai->ai_addr, ai->ai_addrlen, 1000) )
+        {
+            close( fd );
+            fd = -1;
+        }
+    }
+    freeaddrinfo( res );
+    
+    if( fd < 0 )
+        return -1;
+    
+    char head[ 512 ];
+    snprintf( head, sizeof(head), " HTTP/1.1\r\nHost: %s:%d\r\nContent-Length: %lu\r\nConnection: close\r\n\r\n",
+              host.c_str(), port, (unsigned long)body.length());
+    string req = method + " " + prefix + path + head + body;
+    
+    size_t sent = 0;
+    while( sent < req.length() )
+    {
+        ssize_t n = send( fd, req.data() + sent, req.length() - sent, MSG_NOSIGNAL);
+        if( n <= 0 )
+        {
+            close( fd );
+            return -1;
+        }
+        sent += n;
+    }
+    
+    string in;
+    char buf[ 65536 ];
+    ssize_t n;
+    while( (n = recv( fd, buf, sizeof(buf), 0)) > 0 )
+        in.append( buf, n);
+    close( fd );
+    
+    size_t hdrEnd = in.find( "\r\n\r\n" );
+    int status;
+    if( n < 0 || hdrEnd == string::npos || sscanf( in.c_str(), "HTTP/%*s %d", &status) != 1 )
+        return -1;
+    
+    string headers = in.substr( 0, hdrEnd);
+    for( size_t i = 0; i < headers.length(); i++)
+        headers[i] = tolower( headers[i] );
+    reply = in.substr( hdrEnd + 4 );
+    
+    if( headers.find( "transfer-encoding: chunked" ) != string::npos )
+    {
+        string plain;
+        size_t pos = 0;
+        unsigned long len;
+        while( sscanf( reply.c_str() + pos, "%lx", &len) == 1 && len > 0 )
+        {
+            size_t data = reply.find( "\r\n", pos);
+            if( data == string::npos || data + 2 + len > reply.length() )
+                return -1;
+            plain.append( reply, data + 2, len);
+            pos = data + 2 + len + 2;
+        }
+        reply = plain;
+    }
+    else
+    {
+        size_t cl = headers.find( "content-length:" );
+        if( cl != string::npos )
+        {
+            size_t len = strtoul( headers.c_str() + cl + 15, 0, 10);
+            if( reply.length() < len )
+                return -1;
+            reply.resize( len );
+        }
+    }
+    
+    return status;
+}
+
+
+bool RemoteCache::get( const string &path, string &body)
+{
+    int status = request( "GET", path, "", body);
+    
+    if( status == 200 )
+        return true;
+    if( status < 0 || status >= 500 )
+        failed( "GET " + path + " failed" );
+    return false;
+}
+
+
+bool RemoteCache::put( const string &path, const string &body)
+{
+    string reply;
+    int status = request( "PUT", path, body, reply);
+    
+    if( status >= 200 && status < 300 )
+        return true;
+    
+    char buf[ 16 ];
+    snprintf( buf, sizeof(buf), "%d", status);
+    failed( "PUT " + path + " failed, status " + buf );
+    return false;
+}
+
+
+bool RemoteCache::lookup( const string &key, const string &out_fn, string &log)
+{
+    string manifest, blob;
+    char outDigest[ 65 ], logDigest[ 65 ];
+    long long outSize, logSize;
+    unsigned int mode;
+    
+    if( !enabled || !get( "/ac/" + key, manifest) )
+    {
+        misses++;
+        return false;
+    }
+    
+    const char *out = strstr( manifest.c_str(), "\nout ");
+    const char *lg = strstr( manifest.c_str(), "\nlog ");
+    if( manifest.compare( 0, 12, "ferret-ac 1\n") != 0 || !out || !lg ||
+        sscanf( out, "\nout %64s %lld %o", outDigest, &outSize, &mode) != 3 ||
+        sscanf( lg, "\nlog %64s %lld", logDigest, &logSize) != 2 )
+    {
+        failed( "malformed entry /ac/" + key );
+        misses++;
+        return false;
+    }
+    
+    log = "";
+    if( !get( string( "/cas/" ) + outDigest, blob) || (logSize > 0 && !get( string( "/cas/" ) + logDigest, log)) )
+    {
+        misses++;
+        return false;
+    }
+    
+    if( (long long)blob.length() != outSize || Sha256::hex( blob ) != outDigest ||
+        (long long)log.length() != logSize || Sha256::hex( log ) != logDigest )
+    {
+        failed( "content of /ac/" + key + " does not match its digests" );
+        log = "";
+        misses++;
+        return false;
+    }
+    
+    ::unlink( out_fn.c_str() );
+    int fd = open( out_fn.c_str(), O_WRONLY | O_CREAT | O_TRUNC, mode & 0777);
+    bool ok = fd >= 0 && write( fd, blob.data(), blob.length()) == (ssize_t)blob.length();
+    if( fd >= 0 && close( fd ) != 0 )
+        ok = false;
+    
+    if( !ok )
+    {
+        cerr << "warning: could not write " << out_fn << " from remote cache.\n";
+        ::unlink( out_fn.c_str() );
+        misses++;
+        return false;
+    }
+    
+    hits++;
+    return true;
+}
+
+
+bool RemoteCache::store( const string &key, const string &out_fn, const string &log)
+{
+    if( !enabled || !upload )
+        return false;
+    
+    struct stat st;
+    FILE *fp = fopen( out_fn.c_str(), "r");
+    if( !fp || fstat( fileno( fp ), &st) != 0 )
+    {
+        if( fp )
+            fclose( fp );
+        return false;
+    }
+    
+    string blob;
+    char buf[ 65536 ];
+    size_t n;
+    while( (n = fread( buf, 1, sizeof(buf), fp)) > 0 )
+        blob.append( buf, n);
+    fclose( fp );
+    
+    string outDigest = Sha256::hex( blob ), logDigest = Sha256::hex( log );
+    char manifest[ 256 ];
+    snprintf( manifest, sizeof(manifest), "ferret-ac 1\nout %s %lu %o\nlog %s %lu\n", outDigest.c_str(), (unsigned long)blob.length(),
+              (unsigned int)(st.st_mode & 0777), logDigest.c_str(), (unsigned long)log.length());
+    
+    if( !put( "/cas/" + outDigest, blob) || (log.length() > 0 && !put( "/cas/" + logDigest, log)) ||
+        !put( "/ac/" + key, manifest) )      // /ac last, so nobody sees an entry without its blobs
+        return false;
+    
+    uploads++;
+    return true;
+}
+
+
+void RemoteCache::printStats() const
+{
+    if( hits > 0 || uploads > 0 || errors > 0 || verbosity > 0 )
+        cout << "Remote cache: " << hits << " hit(s), " << misses << " miss(es), " << uploads << " uploaded"
+             << (errors ? ", errors" : "") << ".\n";
+}
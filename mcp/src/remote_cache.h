@@ -0,0 +1,46 @@
+#ifndef FERRET_REMOTE_CACHE_H_
+#define FERRET_REMOTE_CACHE_H_
+
+#include <string>
+
+// shared build cache over plain HTTP/1.1, FERRET_REMOTE_CACHE=http://host:port[/prefix] in the build properties.
+// layout as bazel-remote: GET/PUT <prefix>/ac/<key> and <prefix>/cas/<sha256 of content>. an /ac entry is a
+// small text manifest naming the /cas blobs of the output and of the job's output text:
+//   ferret-ac 1
+//   out <sha256> <size> <mode>
+//   log <sha256> <size>
+// every fetched blob is checked against its size and digest. connecting has a 1s timeout and the first
+// failure turns the remote cache off for the rest of the build.
+// see cache_server/ for a directory backed server
+class RemoteCache {
+
+public:
+    RemoteCache()
+        : enabled(false), upload(false), port(80), hits(0), misses(0), uploads(0), errors(0)
+    {}
+    
+    bool setup( const std::string &url, bool upload);
+    
+    bool isEnabled() const
+    { return enabled; }
+    
+    // on a hit the output is written to out_fn
+    bool lookup( const std::string &key, const std::string &out_fn, std::string &log);
+    bool store( const std::string &key, const std::string &out_fn, const std::string &log);
+    
+    void printStats() const;
+
+private:
+    int request( const std::string &method, const std::string &path, const std::string &body, std::string &reply);
+    bool get( const std::string &path, std::string &body);
+    bool put( const std::string &path, const std::string &body);
+    void failed( const std::string &what );
+
+private:
+    bool enabled, upload;
+    std::string host, prefix;
+    int port;
+    int hits, misses, uploads, errors;
+};
+
+#endif
@@ -0,0 +1,640 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "remote_executor.h"
+#include "engine.h"
+#include "sha256.h"
+#include "glob_utility.h"
+#include "output_collector.h"
+
+using namespace std;
+
+
+static bool nextLine( const string &s, size_t &pos, string &line)
+{
+    size_t nl = s.find( '\n', pos);
+    if( nl == string::npos )
+        return false;
+    
+    line = s.substr( pos, nl - pos);
+    pos = nl + 1;
+    return true;
+}
+
+
+// "<tag> <len>\n<bytes>"
+static bool nextBlob( const string &s, size_t &pos, const string &tag, string &data)
+{
+    string line;
+    unsigned long len;
+    
+    if( !nextLine( s, pos, line) || line.compare( 0, tag.length() + 1, tag + " ") != 0 ||
+        sscanf( line.c_str() + tag.length(), "%lu", &len) != 1 || pos + len > s.length() )
+        return false;
+    
+    data = s.substr( pos, len);
+    pos += len;
+    return true;
+}
+
+
+static bool readWhole( const string &fn, string &content)
+{
+    FILE *fp = fopen( fn.c_str(), "r");
+    if( !fp )
+        return false;
+    
+    char buf[ 65536 ];
+    size_t n;
+    while( (n = fread( buf, 1, sizeof(buf), fp)) > 0 )
+        content.append( buf, n);
+    
+    bool ok = !ferror( fp );
+    fclose( fp );
+    return ok;
+}
+
+
+static bool writeOutput( const string &fn, const string &data, unsigned int mode)
+{
+    string tmp = fn + ".ferret_remote";
+    
+    int fd = open( tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, mode & 0777);
+    if( fd < 0 )
+        return false;
+    
+    bool ok = write( fd, data.data(), data.length()) == (ssize_t)data.length();
+    if( close( fd ) != 0 || !ok || rename( tmp.c_str(), fn.c_str()) != 0 )
+    {
+        ::unlink( tmp.c_str() );
+        return false;
+    }
+    return true;
+}
+
+
+bool RemoteExecutor::setTokenFile( const string &fn )
+{
+    string content;
+    if( !readWhole( fn, content) )
+    {
+        cerr << "warning: could not read the worker token from '" << fn << "'.\n";
+        return false;
+    }
+    
+    token = content.substr( 0, content.find_first_of( "\r\n" ));
+    return token.length() > 0;
+}
+
+
+bool RemoteExecutor::addWorkers( const string &spec )
+{
+    string s = spec;
+    replace( s.begin(), s.end(), ',', ' ');
+    
+    stringstream ss( s );
+    string item;
+    while( ss >> item )
+    {
+        int slots = 8;
+        size_t slash = item.find( '/' );
+        if( slash != string::npos )
+        {
+            slots = atoi( item.c_str() + slash + 1 );
+            item = item.substr( 0, slash);
+        }
+        
+        size_t colon = item.rfind( ':' );
+        struct addrinfo hints, *res;
+        memset( &hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        
+        if( colon == string::npos || slots < 1 ||
+            getaddrinfo( item.substr( 0, colon).c_str(), item.c_str() + colon + 1, &hints, &res) != 0 )
+        {
+            cerr << "warning: cannot use worker '" << item << "', expected host:port[/slots].\n";
+            continue;
+        }
+        
+        Worker w;
+        w.name = item;
+        memcpy( &w.addr, res->ai_addr, res->ai_addrlen);
+        w.addrLen = res->ai_addrlen;
+        w.slots = slots;
+        w.busy = 0;
+        w.up = true;
+        freeaddrinfo( res );
+        
+        workers.push_back( w );
+        remoteSlots += slots;
+    }
+    
+    if( workers.size() > 0 && verbosity > 0 )
+        cout << "Remote execution on " << workers.size() << " worker(s), " << remoteSlots << " slot(s)\n";
+    return workers.size() > 0;
+}
+
+
+void RemoteExecutor::processCommands( EngineBase &engine )
+{
+    remoteJobs = localFallbacks = 0;
+    
+    Executor::processCommands( engine );
+    
+    if( !curses && workers.size() > 0 )
+    {
+        cout << remoteJobs << " job(s) ran on worker hosts";
+        if( localFallbacks > 0 )
+            cout << ", " << localFallbacks << " moved back here from workers";
+        cout << ".\n";
+    }
+}
+
+
+bool RemoteExecutor::hasRoom()
+{
+    return localQueue.empty() && (pickWorker() >= 0 || localRoom());
+}
+
+
+static string programOf( const ExecutorCommand &cmd )
+{
+    return cmd.getCmdType() == "EXSH" ? "/bin/sh" : cmd.getFileName();
+}
+
+
+bool RemoteExecutor::divert( ExecutorCommand &cmd )
+{
+    if( cmd.isRemotable() && (cmd.getCmdType() == "EXSH" || cmd.getCmdType() == "EXEC") )
+    {
+        int w = pickWorker();
+        if( w >= 0 && workers[ w ].refused.count( programOf( cmd ) ) == 0 && startRemote( cmd, w) )
+            return true;
+    }
+    
+    if( cmd.getCmdType() == "BARRIER" || localRoom() )
+        return false;
+    
+    localQueue.push_back( cmd );     // got it because a worker had room, but it has to run here
+    return true;
+}
+
+
+size_t RemoteExecutor::inFlight() const
+{
+    return pidToCmdMap.size() + jobs.size() + localQueue.size();
+}
+
+
+void RemoteExecutor::progress( EngineBase &engine )
+{
+    bool local = localChildren() > 0;
+    
+    if( local )
+        checkStates( engine );       // sleeps a little itself
+    pollRemote( local ? 0 : 10, engine);
+    startQueued();
+    
+    if( barrierMode && jobs.empty() && localQueue.empty() && pidToCmdMap.size() == 1 &&
+        pidToCmdMap.begin()->second.getCmdType() == "BARRIER" )
+    {
+        pidToCmdMap.clear();
+        barrierMode = false;
+    }
+}
+
+
+void RemoteExecutor::cleanUpAfterSignal( int signum, EngineBase &engine)
+{
+    Executor::cleanUpAfterSignal( signum, engine);
+    
+    if( jobs.size() > 0 )
+        cout << "Dropping " << jobs.size() << " remote job(s)...\n";      // outputs are only written when a job is complete
+    
+    list<RemoteJob>::iterator it;
+    for( it = jobs.begin(); it != jobs.end(); it++)
+        close( it->fd );
+    jobs.clear();
+    localQueue.clear();
+}
+
+
+int RemoteExecutor::pickWorker() const
+{
+    int best = -1;
+    double bestLoad = 1.;
+    
+    for( size_t i = 0; i < workers.size(); i++)
+    {
+        const Worker &w = workers[i];
+        double load = (double)w.busy / w.slots;
+        
+        if( w.up && w.busy < w.slots && (best < 0 || load < bestLoad) )
+        {
+            best = i;
+            bestLoad = load;
+        }
+    }
+    
+    return best;
+}
+
+
+bool RemoteExecutor::digestOf( const string &fn, string &hex, long long &size)
+{
+    struct stat st;
+    if( stat( fn.c_str(), &st) != 0 )
+        return false;
+    
+    long long mtime_ns = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    map<string,Digest>::const_iterator it = digests.find( fn );
+    
+    if( it == digests.end() || it->second.size != st.st_size || it->second.mtime_ns != mtime_ns )
+    {
+        Digest d;
+        d.size = st.st_size;
+        d.mtime_ns = mtime_ns;
+        if( !Sha256::hexFile( fn, d.hex) )
+            return false;
+        digests[ fn ] = d;
+        it = digests.find( fn );
+    }
+    
+    hex = it->second.hex;
+    size = it->second.size;
+    return true;
+}
+
+
+bool RemoteExecutor::startRemote( ExecutorCommand &cmd, int w)
+{
+    vector<string> argv, in = cmd.getRemoteInputs(), args = cmd.getArgs();
+    
+    if( cmd.getCmdType() == "EXSH" )
+    {
+        argv.push_back( programOf( cmd ) );
+        in.push_back( cmd.getFileName() );     // the script itself
+    }
+    argv.push_back( cmd.getFileName() );
+    argv.insert( argv.end(), args.begin(), args.end());
+    
+    stringstream req;
+    req << "ferret-job 1\n";
+    if( token.length() > 0 )
+        req << "token " << token << "\n";
+    for( size_t i = 0; i < argv.size(); i++)
+        req << "arg " << argv[i].length() << "\n" << argv[i] << "\n";
+    
+    map<string,string> blobs;
+    for( size_t i = 0; i < in.size(); i++)
+    {
+        const string &fn = in[i];
+        string hex;
+        long long size;
+        
+        if( fn.length() > 0 && fn[0] == '/' )
+            continue;                   // system headers, expected on the worker like the compiler itself
+        if( fn.compare( 0, 3, "../") == 0 || fn.find( "/../" ) != string::npos || !digestOf( fn, hex, size) )
+            return false;
+        
+        req << "in " << hex << " " << size << " " << fn << "\n";
+        blobs[ hex ] = fn;
+    }
+    
+    const vector<string> &outs = cmd.getRemoteOutputs();
+    for( size_t i = 0; i < outs.size(); i++)
+        req << "out " << outs[i] << "\n";
+    req << "end\n";
+    
+    Worker &wk = workers[ w ];
+    int fd = socket( wk.addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if( fd < 0 )
+        return false;
+    
+    if( connect( fd, (struct sockaddr *)&wk.addr, wk.addrLen) != 0 && errno != EINPROGRESS )
+    {
+        cerr << "warning: worker " << wk.name << ": " << strerror( errno ) << ", not using it for the rest of the build.\n";
+        wk.up = false;
+        close( fd );
+        return false;
+    }
+    
+    OutputCollector *oc = OutputCollector::getTheOutputCollector();
+    if( cmd.getEchoOutput().length() > 0 )
+    {
+        oc->appendJobStd( cmd.getJobId(), cmd.getEchoOutput());
+        if( curses )
+            oc->cursesAppend( cmd.getJobId(), cmd.getEchoOutput());
+        cmd.setEchoOutput( "" );        // in case it falls back to a local run
+    }
+    
+    RemoteJob j;
+    j.cmd = cmd;
+    j.cmd.pid = 0;
+    j.cmd.slot = acquireSlot();
+    j.cmd.start_us = get_curr_time_us();
+    j.worker = w;
+    j.fd = fd;
+    j.phase = CONNECTING;
+    j.out = req.str();
+    j.outPos = 0;
+    j.blobs = blobs;
+    
+    wk.busy++;
+    jobs.push_back( j );
+    
+    if( curses )
+        oc->cursesTopShowJob( cmd.getJobId() );
+    if( verbosity > 1 )
+        cout << "remote exec    job " << cmd.getJobId() << " " << cmd.getTargetName() << " on " << wk.name << "\n";
+    return true;
+}
+
+
+bool RemoteExecutor::sendSome( RemoteJob &j )
+{
+    while( j.outPos < j.out.length() )
+    {
+        ssize_t n = send( j.fd, j.out.data() + j.outPos, j.out.length() - j.outPos, MSG_NOSIGNAL);
+        if( n < 0 )
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        j.outPos += n;
+    }
+    
+    j.out.clear();
+    j.outPos = 0;
+    j.phase = j.phase == SEND_REQUEST ? WAIT_NEED : WAIT_RESULT;
+    return true;
+}
+
+
+bool RemoteExecutor::receiveSome( RemoteJob &j, bool &eof)
+{
+    char buf[ 65536 ];
+    ssize_t n;
+    
+    while( (n = recv( j.fd, buf, sizeof(buf), 0)) > 0 )
+        j.in.append( buf, n);
+    
+    if( n == 0 )
+        eof = true;
+    else if( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+        return false;
+    return true;
+}
+
+
+// the worker listed the inputs it does not have yet
+bool RemoteExecutor::blobsNeeded( RemoteJob &j )
+{
+    if( j.in.length() < 6 || j.in.compare( j.in.length() - 6, 6, "ready\n") != 0 )
+        return true;                    // not complete yet
+    
+    size_t pos = 0;
+    string line;
+    while( nextLine( j.in, pos, line) && line != "ready" )
+    {
+        map<string,string>::const_iterator it;
+        string content;
+        
+        if( line.compare( 0, 5, "need ") != 0 || (it = j.blobs.find( line.substr( 5 ) )) == j.blobs.end() ||
+            !readWhole( it->second, content) )
+            return false;
+        
+        char head[ 100 ];
+        snprintf( head, sizeof(head), "blob %s %lu\n", it->first.c_str(), (unsigned long)content.length());
+        j.out += head;
+        j.out += content;
+    }
+    
+    j.in.clear();
+    j.outPos = 0;
+    j.phase = j.out.length() > 0 ? SEND_BLOBS : WAIT_RESULT;
+    return true;
+}
+
+
+bool RemoteExecutor::finishRemote( RemoteJob &j, EngineBase &engine)
+{
+    size_t pos = 0;
+    string line, stdOut, stdErr;
+    int code;
+    
+    if( !nextLine( j.in, pos, line) || sscanf( line.c_str(), "exit %d", &code) != 1 ||
+        !nextBlob( j.in, pos, "stdout", stdOut) || !nextBlob( j.in, pos, "stderr", stdErr) )
+        return false;
+    
+    const vector<string> &outs = j.cmd.getRemoteOutputs();
+    vector<string> outFns, outData;
+    vector<unsigned int> outModes;
+    bool ended = false;
+    
+    while( !ended && nextLine( j.in, pos, line) )
+    {
+        unsigned long size;
+        unsigned int mode;
+        int n = 0;
+        
+        if( line == "end" )
+            ended = true;
+        else if( sscanf( line.c_str(), "out %lu %o %n", &size, &mode, &n) == 2 && n > 0 && pos + size <= j.in.length() &&
+                 find( outs.begin(), outs.end(), line.substr( n )) != outs.end() )
+        {
+            outFns.push_back( line.substr( n ) );
+            outData.push_back( j.in.substr( pos, size) );
+            outModes.push_back( mode );
+            pos += size;
+        }
+        else
+            return false;
+    }
+    
+    if( !ended )
+        return false;
+    
+    workers[ j.worker ].busy--;
+    remoteJobs++;
+    
+    for( size_t i = 0; i < outFns.size(); i++)
+        if( !writeOutput( outFns[i], outData[i], outModes[i]) )
+        {
+            stdErr += "error: could not write " + outFns[i] + " received from worker " + workers[ j.worker ].name + "\n";
+            if( code == 0 )
+                code = 1;
+        }
+    
+    OutputCollector *oc = OutputCollector::getTheOutputCollector();
+    unsigned int job_id = j.cmd.getJobId();
+    
+    if( stdOut.length() > 0 )
+    {
+        oc->appendJobStd( job_id, stdOut);
+        if( curses )
+            oc->cursesAppend( job_id, stdOut);
+    }
+    if( stdErr.length() > 0 )
+    {
+        oc->appendJobErr( job_id, stdErr);
+        if( curses )
+        {
+            oc->cursesAppend( job_id, stdErr);
+            oc->cursesSetStderr( job_id );
+        }
+    }
+    
+    if( curses )
+        oc->cursesEnd( job_id );
+    else if( oc->hasJobOut( job_id ) )
+    {
+        cout << "-----------------------------------\n";
+        cout << oc->getJobOut( job_id );
+    }
+    
+    int status = W_EXITCODE( code & 0xff, 0);
+    curr_time = get_curr_time_ms();
+    checkExitState( j.cmd, status, engine);
+    releaseSlot( j.cmd, status);
+    oc->reportJob( job_id );
+    return true;
+}
+
+
+void RemoteExecutor::workerFailed( RemoteJob &j, const string &why)
+{
+    Worker &wk = workers[ j.worker ];
+    
+    wk.busy--;
+    if( wk.up )
+        cerr << "warning: worker " << wk.name << ": " << why << ", not using it for the rest of the build.\n";
+    wk.up = false;
+    
+    runHere( j );
+}
+
+
+// the job alone goes back to the local queue, the worker stays in use
+void RemoteExecutor::runHere( RemoteJob &j )
+{
+    if( j.cmd.slot >= 0 && j.cmd.slot < (int)slotBusy.size() )
+        slotBusy[ j.cmd.slot ] = false;
+    j.cmd.slot = -1;
+    
+    localQueue.push_back( j.cmd );
+    localFallbacks++;
+}
+
+
+void RemoteExecutor::pollRemote( int timeout_ms, EngineBase &engine)
+{
+    if( jobs.empty() )
+        return;
+    
+    vector<struct pollfd> fds;
+    vector<list<RemoteJob>::iterator> its;
+    list<RemoteJob>::iterator it;
+    
+    for( it = jobs.begin(); it != jobs.end(); it++)
+    {
+        struct pollfd p;
+        p.fd = it->fd;
+        p.events = (it->phase == CONNECTING || it->phase == SEND_REQUEST || it->phase == SEND_BLOBS) ? POLLOUT : POLLIN;
+        p.revents = 0;
+        
+        fds.push_back( p );
+        its.push_back( it );
+    }
+    
+    if( poll( &fds[0], fds.size(), timeout_ms) <= 0 )
+        return;
+    
+    for( size_t i = 0; i < fds.size(); i++)
+    {
+        if( fds[i].revents == 0 )
+            continue;
+        
+        RemoteJob &j = *its[i];
+        string why;
+        bool complete = false;
+        
+        if( j.phase == CONNECTING )
+        {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt( j.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            
+            if( err != 0 )
+                why = strerror( err );
+            else
+                j.phase = SEND_REQUEST;
+        }
+        
+        if( why.length() == 0 && (j.phase == SEND_REQUEST || j.phase == SEND_BLOBS) )
+        {
+            if( !sendSome( j ) )
+                why = strerror( errno );
+        }
+        else if( why.length() == 0 )
+        {
+            bool eof = false;
+            
+            if( !receiveSome( j, eof) )
+                why = strerror( errno );
+            else if( j.phase == WAIT_NEED && j.in.compare( 0, 7, "denied ") == 0 && j.in.find( '\n' ) != string::npos )
+                why = j.in.substr( 0, j.in.find( '\n' ));       // wrong token
+            else if( j.phase == WAIT_NEED && j.in.compare( 0, 8, "refused ") == 0 && j.in.find( '\n' ) != string::npos )
+            {
+                Worker &wk = workers[ j.worker ];           // a program it does not run, only this job moves
+                if( wk.refused.insert( programOf( j.cmd ) ).second && verbosity > 0 )
+                    cout << "worker " << wk.name << ": " << j.in.substr( 0, j.in.find( '\n' )) << ", running such jobs here\n";
+                wk.busy--;
+                runHere( j );
+                complete = true;
+            }
+            else if( j.phase == WAIT_NEED && !blobsNeeded( j ) )
+                why = "bad reply";
+            else if( j.phase == WAIT_RESULT && eof )
+            {
+                complete = finishRemote( j, engine);
+                if( !complete )
+                    why = "bad result";
+            }
+            else if( eof )
+                why = "connection closed";
+        }
+        
+        if( why.length() > 0 )
+            workerFailed( j, why);
+        
+        if( why.length() > 0 || complete )
+        {
+            close( j.fd );
+            jobs.erase( its[i] );
+        }
+    }
+}
+
+
+void RemoteExecutor::startQueued()
+{
+    while( !localQueue.empty() && localRoom() && !isInterruptedBySignal() )
+    {
+        ExecutorCommand cmd = localQueue.front();
+        localQueue.pop_front();
+        
+        if( !startLocal( cmd ) )
+            errors++;
+    }
+}
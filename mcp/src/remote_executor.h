@@ -0,0 +1,93 @@
+#ifndef FERRET_REMOTE_EXECUTOR_H_
+#define FERRET_REMOTE_EXECUTOR_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <list>
+#include <set>
+#include <sys/socket.h>
+
+#include "executor.h"
+
+// runs compile jobs on ferret_worker hosts, FERRET_REMOTE_WORKERS="host:port[/slots] ..." in the build properties.
+// commands the engine did not mark remotable (links, extensions, dependency jobs) and the jobs of a worker that
+// went away run locally as with Executor. one TCP connection per job, paths relative to the project root:
+//   client: ferret-job 1\n  [token <token>\n]  arg <len>\n<bytes>\n ...  in <sha256> <size> <path>\n ...  out <path>\n ...  end\n
+//   worker: need <sha256>\n ...  ready\n      or  denied <reason>\n  or  refused <reason>\n
+//   client: blob <sha256> <size>\n<bytes> ...
+//   worker: exit <code>\n  stdout <len>\n<bytes>  stderr <len>\n<bytes>  out <size> <mode> <path>\n<bytes> ...  end\n
+// the worker keeps the blobs it got, so headers are shipped once per worker. a worker started with -t <file> only
+// takes jobs that send the token in that file, FERRET_REMOTE_TOKEN=<file> in the build properties, else it denies
+// them and is not used again. compiles go as the program call, scripts as /bin/sh <script>. a program the worker
+// does not run (see its -a) is refused, that job and later ones with the same program run here
+class RemoteExecutor : public Executor {
+public:
+    RemoteExecutor( unsigned int maxParallel, bool curses)
+        : Executor( maxParallel, curses), remoteSlots(0), remoteJobs(0), localFallbacks(0)
+    {}
+    
+    bool addWorkers( const std::string &spec );
+    bool setTokenFile( const std::string &fn );
+    
+    virtual unsigned int getMaxParallel() const
+    { return maxParallel + remoteSlots; }
+    
+    virtual void processCommands( EngineBase &engine );
+
+protected:
+    virtual bool hasRoom();
+    virtual bool divert( ExecutorCommand &cmd );
+    virtual size_t inFlight() const;
+    virtual void progress( EngineBase &engine );
+    virtual void cleanUpAfterSignal( int signum, EngineBase &engine);
+
+private:
+    typedef enum { CONNECTING, SEND_REQUEST, WAIT_NEED, SEND_BLOBS, WAIT_RESULT } phase_t;
+    
+    struct Worker {
+        std::string name;
+        struct sockaddr_storage addr;
+        socklen_t addrLen;
+        int slots, busy;
+        bool up;
+        std::set<std::string> refused;      // programs it does not run
+    };
+    
+    struct RemoteJob {
+        ExecutorCommand cmd;
+        int worker, fd;
+        phase_t phase;
+        std::string out, in;
+        size_t outPos;
+        std::map<std::string,std::string> blobs;     // digest -> input file
+    };
+    
+    struct Digest {
+        long long size, mtime_ns;
+        std::string hex;
+    };
+    
+    int  pickWorker() const;
+    bool startRemote( ExecutorCommand &cmd, int w);
+    bool digestOf( const std::string &fn, std::string &hex, long long &size);
+    void pollRemote( int timeout_ms, EngineBase &engine);
+    bool sendSome( RemoteJob &j );
+    bool receiveSome( RemoteJob &j, bool &eof);
+    bool blobsNeeded( RemoteJob &j );
+    bool finishRemote( RemoteJob &j, EngineBase &engine);
+    void workerFailed( RemoteJob &j, const std::string &why);
+    void runHere( RemoteJob &j );
+    void startQueued();
+
+private:
+    std::vector<Worker> workers;
+    int remoteSlots;
+    std::list<RemoteJob> jobs;
+    std::list<ExecutorCommand> localQueue;         // diverted to run here, waiting for a local slot
+    std::map<std::string,Digest> digests;
+    std::string token;
+    int remoteJobs, localFallbacks;
+};
+
+#endif
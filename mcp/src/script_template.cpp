@@ -3,18 +3,31 @@
 #include <iostream>
 #include <cassert>
 #include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+#include <pthread.h>
 
 #include "script_template.h"
 #include "glob_utility.h"
 #include "find_files.h"
+#include "phase_profiler.h"
 
 using namespace std;
 
 
-static map<string,string> fileMap;
-
+// a template is read and split into literal text and $F_ keys only once per run
 class ScriptTemplate
 {
+    struct Segment
+    {
+        Segment( bool k, const string &t)
+            : isKey(k), text(t)
+        {}
+        
+        bool isKey;
+        std::string text;   // key name without '$' if isKey
+    };
+    
 public:
     ScriptTemplate( const string &fn )
         : fn(fn)
@@ -22,27 +35,48 @@ public:
 
     bool readTemplate();
 
-    void replace( const map<string,string> &replMap);
+    string replace( const map<string,string> &replMap ) const;
 
-    string write( const string &scriptfn, int file_id, const string &compile_mode);
-
-private:
-    bool hasNextChar() const
-    { return pos < templContent.length(); }
+    static bool compileExec( const string &content, ExecRecipe &recipe);
     
-    char consume();
-    
-    char getc() const
-    { return templContent[pos]; }
+private:
+    void precompile( const string &templContent );
     
 private:
     string fn;
-    string templContent;  // we slurp the file in
-    string newContent;
-    size_t pos;
+    vector<Segment> segments;
 };
 
 
+static pthread_mutex_t templ_mutex = PTHREAD_MUTEX_INITIALIZER;
+static map<string,ScriptTemplate *> templMap;      // template name -> precompiled template, guarded by templ_mutex
+
+static ScriptTemplate *getTemplate( const string &fn )
+{
+    ScriptTemplate *st = 0;
+    
+    pthread_mutex_lock( &templ_mutex );
+    
+    map<string,ScriptTemplate *>::iterator it = templMap.find( fn );
+    if( it == templMap.end() )
+    {
+        st = new ScriptTemplate( fn );
+        if( !st->readTemplate() )
+        {
+            delete st;
+            st = 0;
+        }
+        templMap[ fn ] = st;        // remember failures as well, error message is shown once
+    }
+    else
+        st = it->second;
+    
+    pthread_mutex_unlock( &templ_mutex );
+    
+    return st;
+}
+
+
 static string findTemplate( const string &fn )
 {
     vector<string> tries;
@@ -72,42 +106,33 @@ static string findTemplate( const string &fn )
 
 bool ScriptTemplate::readTemplate()
 {
-    map<string,string>::iterator it = fileMap.find( fn );
+    stringstream ss;
     
-    if( it == fileMap.end() )
+    string templfn = findTemplate( fn );
+    if( templfn == "" )
     {
-        stringstream ss;
-
-        string templfn = findTemplate( fn );
-        if( templfn == "" )
-        {
-            cerr << "error: did not find script template '" << fn << "'.\n";
-            return false;
-        }
-
-        if( verbosity > 0 )
-            cout << "Will be using '" << templfn << "' for script template " << fn << "\n";
-        
-        FILE *in_fp = fopen( templfn.c_str(), "r");
-        
-        if( !in_fp )
-        {
-            cerr << "error: could not open script template '" << templfn << "'.\n";
-            return false;
-        }
-        
-        int c;
-        while( (c = fgetc( in_fp )) > 0 )
-            ss << (char)c;                          // slurp it in, they aren't big
+        cerr << "error: did not find script template '" << fn << "'.\n";
+        return false;
+    }
     
-        templContent = ss.str();
-        fclose( in_fp );
-        
-        fileMap[ fn ] = templContent;
+    if( verbosity > 0 )
+        cout << "Will be using '" << templfn << "' for script template " << fn << "\n";
+    
+    FILE *in_fp = fopen( templfn.c_str(), "r");
+    
+    if( !in_fp )
+    {
+        cerr << "error: could not open script template '" << templfn << "'.\n";
+        return false;
     }
-    else
-        templContent = it->second;
     
+    int c;
+    while( (c = fgetc( in_fp )) > 0 )
+        ss << (char)c;                          // slurp it in, they aren't big
+    
+    fclose( in_fp );
+    
+    precompile( ss.str() );
     
     return true;
 }
@@ -126,63 +151,115 @@ static bool is_allowed( char c )
 }
 
 
-void ScriptTemplate::replace( const map<string,string> &replMap )
+void ScriptTemplate::precompile( const string &templContent )
 {
-    newContent = "";
-    stringstream out;
-    string key;
-    map<string, string>::const_iterator it;
-
-    pos = 0;
+    string literal;
+    size_t pos = 0, len = templContent.length();
     
-    do
+    segments.clear();
+    
+    while( pos < len )
     {
-        if( getc() == '$' )
+        if( templContent[pos] == '$' )
         {
-            consume();           // consume '$'
-            key = "";
+            pos++;           // consume '$'
+            string key;
             
-            while( hasNextChar() && !is_white(getc()) && is_allowed(getc()) )
-                key += consume();           // consume the key
+            while( pos < len && !is_white(templContent[pos]) && is_allowed(templContent[pos]) )
+                key += templContent[pos++];           // consume the key
             
             if( key.length() > 2 )          // must start with F_
             {
-                it = replMap.find( key );
-                if( it != replMap.end() )
-                    out << it->second;      // insert the value at the position of key
-                else
-                    out << '$' << key;   // ignore
+                if( literal.length() > 0 )
+                    segments.push_back( Segment( false, literal) );
+                literal = "";
+                segments.push_back( Segment( true, key) );
             }
             else
-                out << '$' << key;     // ignore
+                literal += "$" + key;       // ignore
         }
         else
-            out << consume();
+            literal += templContent[pos++];
     }
-    while( hasNextChar() );
+    
+    if( literal.length() > 0 )
+        segments.push_back( Segment( false, literal) );
+}
+
 
-    newContent = out.str();
+string ScriptTemplate::replace( const map<string,string> &replMap ) const
+{
+    string out;
+    map<string, string>::const_iterator it;
+    
+    for( size_t i = 0; i < segments.size(); i++)
+    {
+        const Segment &seg = segments[i];
+        
+        if( !seg.isKey )
+            out.append( seg.text );
+        else
+        {
+            it = replMap.find( seg.text );
+            if( it != replMap.end() )
+                out.append( it->second );      // insert the value at the position of key
+            else
+                out.append( "$" + seg.text );  // ignore
+        }
+    }
+    
+    return out;
+}
+
+
+// -----------------------------------------------------------------------------
+
+// true if fn holds exactly content, avoids touching scripts that have not changed since the last run
+static bool same_on_disk( const string &fn, const string &content)
+{
+    struct stat fst;
+    prof_count( PROF_STAT );
+    if( stat( fn.c_str(), &fst) != 0 || (size_t)fst.st_size != content.length() )
+        return false;
+    
+    FILE *in_fp = fopen( fn.c_str(), "r");
+    if( !in_fp )
+        return false;
+    
+    vector<char> buf( content.length() + 1 );
+    size_t n = fread( &buf[0], 1, buf.size(), in_fp);
+    fclose( in_fp );
+    
+    return n == content.length() && (n == 0 || memcmp( &buf[0], content.data(), n) == 0);
 }
 
 
-string ScriptTemplate::write( const string &scriptfn, int file_id, const string &compile_mode)
+static string script_file_name( const string &scriptfn, int file_id, const string &compile_mode)
 {
     string fn;
-    size_t i;
     stringstream idss;
 
     if( file_id > 0 )
         idss << file_id;
     idss << "__" << compile_mode;
     
-    for( i = 0; i < scriptfn.length(); i++)
+    for( size_t i = 0; i < scriptfn.length(); i++)
         if( scriptfn[ i ] == '#' )
             fn.append( idss.str() );
         else
             fn += scriptfn[ i ];
 
-    fn = tempScriptDir + "/" + fn;
+    return tempScriptDir + "/" + fn;
+}
+
 
+static string write_script( const string &scriptfn, int file_id, const string &compile_mode, const string &content)
+{
+    string fn = script_file_name( scriptfn, file_id, compile_mode);
+    
+    if( same_on_disk( fn, content) )
+        return fn;
+    
     FILE *out_fp = fopen( fn.c_str(), "w");
     
     if( !out_fp )
@@ -190,20 +267,145 @@ string ScriptTemplate::write( const string &scriptfn, int file_id, const string
         cerr << "error: could not write script '" << fn << "'.\n";
         return "";
     }
-
-    for( i = 0; i < newContent.length(); i++)
-        fputc( newContent[i], out_fp);
     
+    fwrite( content.data(), 1, content.length(), out_fp);
     fclose( out_fp );
 
     return fn;
 }
 
 
-char ScriptTemplate::consume()
+// -----------------------------------------------------------------------------
+// direct exec: scripts that do nothing but echo and call one program do not need /bin/sh
+
+static bool is_shell_meta( char c )
+{
+    return c=='|' || c=='&' || c==';' || c=='<' || c=='>' || c=='(' || c==')' || c=='$' || c=='`' || c=='\\' ||
+        c=='"' || c=='\'' || c=='*' || c=='?' || c=='[' || c==']' || c=='{' || c=='}' || c=='#' || c=='~';
+}
+
+
+static bool is_shell_builtin( const string &w )
+{
+    static const char *builtins[] = { "cd", "export", "set", "unset", "eval", "exec", ".", "source", "if", "for", "while",
+                                      "until", "case", "test", "read", "shift", "umask", "ulimit", "alias", "wait", "return",
+                                      "true", "false", ":", "!", 0 };
+    for( int i = 0; builtins[i] != 0; i++)
+        if( w == builtins[i] )
+            return true;
+    
+    return w.find( '=' ) != string::npos;   // variable assignment
+}
+
+
+static vector<string> split_words( const string &line )
+{
+    vector<string> words;
+    size_t i = 0, len = line.length();
+    
+    while( i < len )
+    {
+        while( i < len && (line[i] == ' ' || line[i] == '\t' || line[i] == '\r') )
+            i++;
+        
+        string w;
+        while( i < len && line[i] != ' ' && line[i] != '\t' && line[i] != '\r' )
+            w += line[i++];
+        
+        if( w.length() > 0 )
+            words.push_back( w );
+    }
+    
+    return words;
+}
+
+
+static bool plain_words( const vector<string> &words, size_t from)
+{
+    for( size_t i = from; i < words.size(); i++)
+        for( size_t k = 0; k < words[i].length(); k++)
+            if( is_shell_meta( words[i][k] ) )
+                return false;
+    
+    return true;
+}
+
+
+// echo "text" or echo word ...
+static bool echo_text( const string &line, const vector<string> &words, string &text)
+{
+    if( words.size() > 1 && words[1][0] == '-' )
+        return false;              // echo options differ between shells
+    
+    size_t b = line.find( '"' );
+    if( b == string::npos )
+    {
+        if( !plain_words( words, 1) )
+            return false;
+        
+        vector<string> rest( words.begin() + 1, words.end());
+        text = join( " ", rest, false);
+        return true;
+    }
+    
+    size_t e = line.find( '"', b + 1);
+    if( e == string::npos || words[1][0] != '"' || split_words( line.substr( e + 1 ) ).size() > 0 )
+        return false;
+    
+    text = line.substr( b + 1, e - b - 1);
+    for( size_t i = 0; i < text.length(); i++)
+        if( text[i] == '$' || text[i] == '`' || text[i] == '\\' )
+            return false;
+    
+    return true;
+}
+
+
+// the script qualifies if it consists of comments, trap and echo lines, exactly one call
+// of a program and optionally exit <n> at the end. everything else needs a shell.
+bool ScriptTemplate::compileExec( const string &content, ExecRecipe &recipe)
 {
-    assert( pos < templContent.length() );
-    return templContent[pos++];
+    vector<string> lines = split( '\n', content);
+    bool hasCall = false, hasExit = false;
+    
+    recipe = ExecRecipe();
+    
+    for( size_t i = 0; i < lines.size(); i++)
+    {
+        vector<string> words = split_words( lines[i] );
+        
+        if( words.size() == 0 || words[0][0] == '#' )
+            continue;
+        
+        if( hasExit )
+            return false;
+        
+        if( words[0] == "trap" )
+            continue;                   // child gets the signal from the terminal anyway
+        else if( words[0] == "echo" )
+        {
+            string text;
+            if( hasCall || !echo_text( lines[i], words, text) )
+                return false;
+            recipe.echo += text + "\n";
+        }
+        else if( words[0] == "exit" )
+        {
+            if( !hasCall || words.size() != 2 || words[1].find_first_not_of( "0123456789" ) != string::npos )
+                return false;
+            recipe.exitCode = atoi( words[1].c_str() );
+            hasExit = true;
+        }
+        else
+        {
+            if( hasCall || is_shell_builtin( words[0] ) || !plain_words( words, 0) )
+                return false;
+            recipe.argv = words;
+            hasCall = true;
+        }
+    }
+    
+    return hasCall;
 }
 
 
@@ -228,16 +430,40 @@ void ScriptInstance::addReplacement( const string &k, const string &v)
 
 string ScriptInstance::write( const string &target_fn, const string &compile_mode)
 {    
-    ScriptTemplate st( templ_name );
-    if( !st.readTemplate() )
+    ScriptTemplate *st = getTemplate( templ_name );
+    if( !st )
     {
         cerr << "error: command for file " << target_fn << " (" << file_id << "): error while reading script template.\n";
         return "";
     }
     
-    st.replace( replacements );
+    return write_script( stencil, file_id, compile_mode, st->replace( replacements ));  // returns file name of the written script
+}
+
+
+bool ScriptInstance::compileExec( const string &target_fn, ExecRecipe &recipe)
+{
+    ScriptTemplate *st = getTemplate( templ_name );
+    if( !st )
+    {
+        cerr << "error: command for file " << target_fn << " (" << file_id << "): error while reading script template.\n";
+        return false;
+    }
     
-    return st.write( stencil, file_id, compile_mode);  // returns file name of the written script
+    return ScriptTemplate::compileExec( st->replace( replacements ), recipe);
+}
+
+
+string ScriptInstance::getCommand( const string &target_fn )
+{
+    ScriptTemplate *st = getTemplate( templ_name );
+    if( !st )
+    {
+        cerr << "error: command for file " << target_fn << " (" << file_id << "): error while reading script template.\n";
+        return "";
+    }
+    
+    return st->replace( replacements );
 }
 
 
@@ -291,7 +517,7 @@ void ScriptManager::addReplacement( file_id_t file_id, const string &k, const st
 }
 
 
-string ScriptManager::write( file_id_t file_id, const string &target_fn)
+string ScriptManager::writeNow( file_id_t file_id, const string &target_fn)
 {
     map<file_id_t,ScriptInstance>::iterator it = instances.find( file_id );
     
@@ -303,3 +529,167 @@ string ScriptManager::write( file_id_t file_id, const string &target_fn)
         return "";
     }
 }
+
+
+string ScriptManager::getCommand( file_id_t file_id, const string &target_fn)
+{
+    map<file_id_t,ScriptInstance>::iterator it = instances.find( file_id );
+    
+    if( it != instances.end() )
+        return it->second.getCommand( target_fn );
+    else
+        return "";
+}
+
+
+string ScriptManager::write( file_id_t file_id, const string &target_fn)
+{
+    if( pregenRunning )
+    {
+        pthread_mutex_lock( &pregenMutex );
+        
+        map<file_id_t,pregen_state_t>::iterator it = pregenStates.find( file_id );
+        if( it != pregenStates.end() )
+        {
+            while( it->second == PG_RUNNING )
+                pthread_cond_wait( &pregenCond, &pregenMutex);
+            
+            if( it->second == PG_DONE )
+            {
+                string script = pregenScripts[ file_id ];
+                pregenScripts.erase( file_id );
+                pregenStates.erase( it );
+                pthread_mutex_unlock( &pregenMutex );
+                
+                return script;
+            }
+            
+            it->second = PG_TAKEN;    // still queued, worker will skip it
+        }
+        
+        pthread_mutex_unlock( &pregenMutex );
+    }
+    
+    return writeNow( file_id, target_fn);
+}
+
+
+// -----------------------------------------------------------------------------
+static long long pregen_counts[ PROF_COUNTERS ];     // the thread's prof_counters, merged in stopPregen()
+
+extern "C" {
+static void *pregen_worker( void *arg )
+{
+    ((ScriptManager *)arg)->pregenLoop();
+    memcpy( pregen_counts, prof_counters, sizeof(pregen_counts));
+    return 0;
+}
+}
+
+
+void ScriptManager::startPregen()
+{
+    if( !pregenEnabled || pregenRunning )
+        return;
+    
+    pthread_mutex_init( &pregenMutex, 0);
+    pthread_cond_init( &pregenCond, 0);
+    pregenStop = false;
+    
+    if( pthread_create( &pregenThread, 0, pregen_worker, this) != 0 )
+    {
+        cerr << "warning: could not start script generation thread, generating on demand.\n";
+        return;
+    }
+    
+    pregenRunning = true;
+}
+
+
+void ScriptManager::stopPregen()
+{
+    if( !pregenRunning )
+        return;
+    
+    pthread_mutex_lock( &pregenMutex );
+    pregenStop = true;
+    pthread_cond_broadcast( &pregenCond );
+    pthread_mutex_unlock( &pregenMutex );
+    
+    pthread_join( pregenThread, 0);
+    pregenRunning = false;
+    prof_merge( pregen_counts );
+    
+    pregenQueue.clear();
+    pregenStates.clear();
+    pregenScripts.clear();
+    pthread_cond_destroy( &pregenCond );
+    pthread_mutex_destroy( &pregenMutex );
+}
+
+
+void ScriptManager::pregen( file_id_t file_id, const string &target_fn)
+{
+    if( !pregenRunning )
+        return;
+    
+    pthread_mutex_lock( &pregenMutex );
+    
+    if( pregenStates.find( file_id ) == pregenStates.end() )
+    {
+        pregenStates[ file_id ] = PG_QUEUED;
+        pregenQueue.push_back( make_pair( file_id, target_fn) );
+        pthread_cond_broadcast( &pregenCond );
+    }
+    
+    pthread_mutex_unlock( &pregenMutex );
+}
+
+
+void ScriptManager::pregenLoop()
+{
+    pthread_mutex_lock( &pregenMutex );
+    
+    while( !pregenStop )
+    {
+        if( pregenQueue.size() == 0 )
+        {
+            pthread_cond_wait( &pregenCond, &pregenMutex);
+            continue;
+        }
+        
+        pair<file_id_t,string> job = pregenQueue.front();
+        pregenQueue.pop_front();
+        
+        map<file_id_t,pregen_state_t>::iterator it = pregenStates.find( job.first );
+        if( it == pregenStates.end() || it->second != PG_QUEUED )
+        {
+            if( it != pregenStates.end() && it->second == PG_TAKEN )
+                pregenStates.erase( it );
+            continue;
+        }
+        
+        it->second = PG_RUNNING;
+        pthread_mutex_unlock( &pregenMutex );
+        
+        string script = writeNow( job.first, job.second);    // instances are not changed while the engine runs
+        
+        pthread_mutex_lock( &pregenMutex );
+        pregenStates[ job.first ] = PG_DONE;
+        pregenScripts[ job.first ] = script;
+        pthread_cond_broadcast( &pregenCond );
+    }
+    
+    pthread_mutex_unlock( &pregenMutex );
+}
+
+
+bool ScriptManager::compileExec( file_id_t file_id, const string &target_fn, ExecRecipe &recipe)
+{
+    map<file_id_t,ScriptInstance>::iterator it = instances.find( file_id );
+    
+    if( it != instances.end() )
+        return it->second.compileExec( target_fn, recipe);
+    else
+        return false;   // write() reports it
+}
@@ -2,11 +2,26 @@
 #define FERRET_SCRIPT_TEMPLATE_H_
 
 #include <string>
+#include <vector>
 #include <map>
+#include <deque>
+#include <pthread.h>
 
 #include "glob_utility.h"
 
 
+// a script reduced to a direct call of one program, see ScriptManager::compileExec()
+struct ExecRecipe {
+    ExecRecipe()
+        : exitCode(-1)
+    {}
+    
+    std::string echo;                // what the script would have printed before the call
+    std::vector<std::string> argv;   // argv[0] is the program, searched in PATH
+    int exitCode;                    // exit code forced by the script after the call, -1 if none
+};
+
+
 class ScriptInstance {
 public:
     ScriptInstance()
@@ -21,6 +36,8 @@ public:
     void addReplacement( const std::string &k, const std::string &v);
 
     std::string write( const std::string &target_fn, const std::string &compile_mode);  // returns file name of the written script
+    bool compileExec( const std::string &target_fn, ExecRecipe &recipe);
+    std::string getCommand( const std::string &target_fn );     // script text with all replacements done
     
 private:
     file_id_t file_id;
@@ -39,24 +56,53 @@ public:
     static ScriptManager *getTheScriptManager();
     
     ScriptManager()
-        : compile_mode( "UNSET" )
+        : compile_mode( "UNSET" ), directExec( false ), pregenEnabled( false ), pregenRunning( false )
     {}
 
     void setCompileMode( const std::string &cm )
     { compile_mode = cm; }
     
+    void setDirectExec( bool d )
+    { directExec = d; }
+    bool hasDirectExec() const
+    { return directExec; }
+    
     void setTemplateFileName( file_id_t file_id, const std::string &fn, const std::string &st);
 
     void addReplacements( file_id_t file_id, const std::map<std::string,std::string> &repl);    
     void addReplacement( file_id_t file_id, const std::string &k, const std::string &v);
     
-    std::string write( file_id_t file_id, const std::string &target_fn);
+    std::string write( file_id_t file_id, const std::string &target_fn);  // takes pre-generated script if there is one
+    bool compileExec( file_id_t file_id, const std::string &target_fn, ExecRecipe &recipe);  // false if script needs /bin/sh
+    std::string getCommand( file_id_t file_id, const std::string &target_fn);     // for the action cache key
+    
+    // generate scripts ahead of dispatch on a worker thread
+    void setPregen( bool p )
+    { pregenEnabled = p; }
+    void startPregen();
+    void stopPregen();
+    void pregen( file_id_t file_id, const std::string &target_fn);   // queue for generation, in order of calls
+    
+    void pregenLoop();   // worker thread only
+    
+private:
+    std::string writeNow( file_id_t file_id, const std::string &target_fn);
     
 private:
     static ScriptManager *theScriptManager;
 
     std::map<file_id_t,ScriptInstance> instances;
     std::string compile_mode;
+    bool directExec;
+    
+    typedef enum { PG_QUEUED, PG_RUNNING, PG_DONE, PG_TAKEN} pregen_state_t;
+    bool pregenEnabled, pregenRunning, pregenStop;
+    pthread_t pregenThread;
+    pthread_mutex_t pregenMutex;
+    pthread_cond_t pregenCond;
+    std::deque<std::pair<file_id_t,std::string> > pregenQueue;
+    std::map<file_id_t,pregen_state_t> pregenStates;
+    std::map<file_id_t,std::string> pregenScripts;    // file names of the scripts that are done
 };
 
 #endif
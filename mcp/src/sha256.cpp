@@ -0,0 +1,138 @@
+#include <cstdio>
+#include <cstring>
+
+#include "sha256.h"
+
+using namespace std;
+
+
+static const unsigned int k256[ 64 ] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+
+static inline unsigned int ror( unsigned int x, int n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+
+Sha256::Sha256()
+    : bufLen(0), total(0)
+{
+    h[0] = 0x6a09e667; h[1] = 0xbb67ae85; h[2] = 0x3c6ef372; h[3] = 0xa54ff53a;
+    h[4] = 0x510e527f; h[5] = 0x9b05688c; h[6] = 0x1f83d9ab; h[7] = 0x5be0cd19;
+}
+
+
+void Sha256::block( const unsigned char *p )
+{
+    unsigned int w[ 64 ];
+    int i;
+    
+    for( i = 0; i < 16; i++)
+        w[i] = (unsigned int)p[4*i] << 24 | (unsigned int)p[4*i+1] << 16 | (unsigned int)p[4*i+2] << 8 | p[4*i+3];
+    for( ; i < 64; i++)
+    {
+        unsigned int s0 = ror( w[i-15], 7) ^ ror( w[i-15], 18) ^ (w[i-15] >> 3);
+        unsigned int s1 = ror( w[i-2], 17) ^ ror( w[i-2], 19) ^ (w[i-2] >> 10);
+        w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+    
+    unsigned int a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+    for( i = 0; i < 64; i++)
+    {
+        unsigned int t1 = hh + (ror( e, 6) ^ ror( e, 11) ^ ror( e, 25)) + ((e & f) ^ (~e & g)) + k256[i] + w[i];
+        unsigned int t2 = (ror( a, 2) ^ ror( a, 13) ^ ror( a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        hh = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+    h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+}
+
+
+void Sha256::update( const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    total += len;
+    
+    if( bufLen > 0 )
+    {
+        size_t n = 64 - bufLen < len ? 64 - bufLen : len;
+        memcpy( buf + bufLen, p, n);
+        bufLen += n;
+        p += n;
+        len -= n;
+        
+        if( bufLen < 64 )
+            return;
+        block( buf );
+        bufLen = 0;
+    }
+    
+    for( ; len >= 64; p += 64, len -= 64)
+        block( p );
+    
+    memcpy( buf, p, len);
+    bufLen = len;
+}
+
+
+string Sha256::hexDigest()
+{
+    unsigned long long bits = total * 8;
+    unsigned char pad[ 72 ];
+    size_t padLen = (bufLen < 56 ? 56 : 120) - bufLen;
+    
+    memset( pad, 0, sizeof(pad));
+    pad[0] = 0x80;
+    update( pad, padLen);
+    
+    unsigned char len[ 8 ];
+    for( int i = 0; i < 8; i++)
+        len[i] = (unsigned char)(bits >> (56 - 8 * i));
+    update( len, 8);
+    
+    char out[ 65 ];
+    for( int i = 0; i < 8; i++)
+        snprintf( out + 8 * i, 9, "%08x", h[i]);
+    
+    return out;
+}
+
+
+string Sha256::hex( const string &data )
+{
+    Sha256 s;
+    s.update( data.data(), data.length());
+    return s.hexDigest();
+}
+
+
+bool Sha256::hexFile( const string &fn, string &digest)
+{
+    FILE *fp = fopen( fn.c_str(), "r");
+    if( !fp )
+        return false;
+    
+    Sha256 s;
+    char b[ 65536 ];
+    size_t n;
+    while( (n = fread( b, 1, sizeof(b), fp)) > 0 )
+        s.update( b, n);
+    
+    bool ok = !ferror( fp );
+    fclose( fp );
+    
+    digest = s.hexDigest();
+    return ok;
+}
@@ -0,0 +1,29 @@
+#ifndef FERRET_SHA256_H_
+#define FERRET_SHA256_H_
+
+#include <string>
+#include <cstddef>
+
+// SHA-256 as needed for the content digests of the remote cache (/cas/<digest>), FIPS 180-4
+class Sha256 {
+
+public:
+    Sha256();
+    
+    void update( const void *data, size_t len);
+    std::string hexDigest();        // finishes, object must not be updated afterwards
+    
+    static std::string hex( const std::string &data );
+    static bool hexFile( const std::string &fn, std::string &digest);
+
+private:
+    void block( const unsigned char *p );
+
+private:
+    unsigned int h[ 8 ];
+    unsigned char buf[ 64 ];
+    size_t bufLen;
+    unsigned long long total;
+};
+
+#endif
@@ -0,0 +1,339 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <fstream>
+#include <algorithm>
+#include <set>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "time_trace.h"
+#include "file_manager.h"
+#include "glob_utility.h"
+
+using namespace std;
+
+
+// --- minimal scanning of the chrome trace event format clang writes
+
+static size_t skipString( const string &s, size_t p)     // p at opening quote, returns position after closing quote
+{
+    for( p++; p < s.length(); p++)
+    {
+        if( s[p] == '\\' )
+            p++;
+        else if( s[p] == '"' )
+            return p + 1;
+    }
+    return s.length();
+}
+
+
+static size_t findValue( const string &ev, const string &key)
+{
+    string k = "\"" + key + "\"";
+    size_t p = ev.find( k );
+    if( p == string::npos )
+        return string::npos;
+    
+    p += k.length();
+    while( p < ev.length() && (ev[p] == ' ' || ev[p] == '\t' || ev[p] == '\n' || ev[p] == '\r' || ev[p] == ':') )
+        p++;
+    return p < ev.length() ? p : string::npos;
+}
+
+
+static string stringValue( const string &ev, const string &key)
+{
+    size_t p = findValue( ev, key);
+    string v;
+    
+    if( p == string::npos || ev[p] != '"' )
+        return v;
+    
+    for( p++; p < ev.length() && ev[p] != '"'; p++)
+    {
+        if( ev[p] == '\\' && p + 1 < ev.length() )
+        {
+            p++;
+            if( ev[p] == 'n' )
+                v += '\n';
+            else if( ev[p] == 't' )
+                v += '\t';
+            else
+                v += ev[p];            // \" \\ \/, \u sequences are kept as they are
+        }
+        else
+            v += ev[p];
+    }
+    
+    return v;
+}
+
+
+static long long numberValue( const string &ev, const string &key)
+{
+    size_t p = findValue( ev, key);
+    if( p == string::npos )
+        return 0;
+    return atoll( ev.c_str() + p );
+}
+
+
+bool TimeTraceReport::readTraceFile( const string &fn )
+{
+    ifstream is( fn.c_str() );
+    if( !is )
+        return false;
+    
+    stringstream ss;
+    ss << is.rdbuf();
+    const string s = ss.str();
+    
+    size_t p = s.find( "\"traceEvents\"" );
+    if( p == string::npos )
+        return false;
+    p = s.find( '[', p);
+    if( p == string::npos )
+        return false;
+    
+    char cwd[ 2048 ];
+    string cwdPrefix;
+    if( getcwd( cwd, sizeof(cwd)) )
+        cwdPrefix = string( cwd ) + "/";
+    
+    set<string> seenHeaders, seenInst;
+    
+    for( p++; p < s.length(); )
+    {
+        char c = s[p];
+        if( c == ']' )
+            break;
+        if( c != '{' )
+        {
+            p++;
+            continue;
+        }
+        
+        // find end of this event object
+        size_t q = p;
+        int depth = 0;
+        while( q < s.length() )
+        {
+            if( s[q] == '"' )
+            {
+                q = skipString( s, q);
+                continue;
+            }
+            if( s[q] == '{' )
+                depth++;
+            else if( s[q] == '}' && --depth == 0 )
+                break;
+            q++;
+        }
+        
+        const string ev = s.substr( p, q - p + 1);
+        p = q + 1;
+        
+        string name = stringValue( ev, "name");
+        long long dur = numberValue( ev, "dur");
+        
+        if( name == "Source" )
+        {
+            string h = stringValue( ev, "detail");
+            if( cwdPrefix.length() && h.compare( 0, cwdPrefix.length(), cwdPrefix) == 0 )
+                h = h.substr( cwdPrefix.length() );
+            h = cleanPath( h );
+            
+            Stat &st = headers[ h ];
+            st.total_us += dur;
+            if( dur > st.max_us )
+                st.max_us = dur;
+            if( seenHeaders.insert( h ).second )
+                st.tus++;
+        }
+        else if( name == "InstantiateClass" || name == "InstantiateFunction" )
+        {
+            string d = stringValue( ev, "detail");
+            
+            Stat &st = instantiations[ d ];
+            st.total_us += dur;
+            if( dur > st.max_us )
+                st.max_us = dur;
+            if( seenInst.insert( d ).second )
+                st.tus++;
+        }
+        else if( name == "Frontend" )
+            frontend_us += dur;
+        else if( name == "Backend" )
+            backend_us += dur;
+    }
+    
+    traces++;
+    return true;
+}
+
+
+void TimeTraceReport::collect( FileManager &fileMan )
+{
+    FileMap::Iterator it;
+    
+    while( fileMan.hasNext( it ) )
+    {
+        if( it.getStructuralState() == data_t::GONE )
+            continue;
+        
+        string cmd = it.getCmd();
+        if( cmd != "Cpp" && cmd != "C" )
+            continue;
+        
+        string bext, ext;
+        breakFileName( it.getFile(), bext, ext);     // clang puts foo.json next to foo.o
+        string jfn = bext + ".json";
+        
+        // clang writes the trace after the object. an older one is left from a compile without -ftime-trace
+        struct stat ost, jst;
+        if( stat( it.getFile().c_str(), &ost) != 0 || stat( jfn.c_str(), &jst) != 0 ||
+            jst.st_mtim.tv_sec < ost.st_mtim.tv_sec ||
+            (jst.st_mtim.tv_sec == ost.st_mtim.tv_sec && jst.st_mtim.tv_nsec < ost.st_mtim.tv_nsec) )
+            continue;
+        
+        if( !readTraceFile( jfn ) )
+            cerr << "warning: could not read time trace " << jfn << "\n";
+    }
+}
+
+
+int TimeTraceReport::countIncludingObjects( FileManager &fileMan, const string &header)
+{
+    if( !fileMan.hasFileName( header ) )
+        return -1;
+    
+    set<file_id_t> visited;
+    vector<file_id_t> stack;
+    int cnt = 0;
+    
+    stack.push_back( fileMan.getIdForFile( header ) );
+    while( stack.size() )
+    {
+        file_id_t id = stack.back();
+        stack.pop_back();
+        if( !visited.insert( id ).second )
+            continue;
+        
+        string cmd = fileMan.getCmdForId( id );
+        if( cmd == "Cpp" || cmd == "C" )
+        {
+            cnt++;
+            continue;        // nothing above an object includes the header
+        }
+        
+        set<file_id_t> up = fileMan.prerequisiteFor( id );
+        stack.insert( stack.end(), up.begin(), up.end());
+    }
+    
+    return cnt;
+}
+
+
+static bool byTotal( const pair<string,long long> &a, const pair<string,long long> &b)
+{
+    return a.second > b.second;
+}
+
+
+vector<pair<string,TimeTraceReport::Stat> > TimeTraceReport::topOf( const map<string,Stat> &m, size_t top) const
+{
+    vector<pair<string,long long> > v;
+    map<string,Stat>::const_iterator it;
+    for( it = m.begin(); it != m.end(); it++)
+        v.push_back( make_pair( it->first, it->second.total_us) );
+    
+    sort( v.begin(), v.end(), byTotal);
+    
+    vector<pair<string,Stat> > r;
+    for( size_t i = 0; i < v.size() && i < top; i++)
+        r.push_back( make_pair( v[i].first, m.find( v[i].first )->second) );
+    return r;
+}
+
+
+bool TimeTraceReport::write( FileManager &fileMan, const string &fn, int top)
+{
+    if( traces == 0 )
+    {
+        cout << "No -ftime-trace output found next to the objects.\n";
+        return false;
+    }
+    
+    stringstream os;      // the report goes to fn only when complete, a reader never sees half of it
+    
+    vector<pair<string,Stat> > th = topOf( headers, top);
+    for( size_t i = 0; i < th.size(); i++)
+        th[i].second.graph_tus = countIncludingObjects( fileMan, th[i].first);
+    
+    os << traces << " time trace(s), frontend " << frontend_us / 1000 << "ms, backend " << backend_us / 1000 << "ms\n\n";
+    
+    os << "Most expensive headers by total parse time (inclusive)\n"
+       << "   total ms     avg ms     max ms  TUs traced  TUs in db  header\n";
+    for( size_t i = 0; i < th.size(); i++)
+    {
+        const Stat &st = th[i].second;
+        os << setw(11) << st.total_us / 1000 << setw(11) << st.total_us / 1000 / st.tus << setw(11) << st.max_us / 1000
+           << setw(12) << st.tus << setw(11);
+        if( st.graph_tus >= 0 )
+            os << st.graph_tus;
+        else
+            os << "-";                // system header or not in files db
+        os << "  " << th[i].first << "\n";
+    }
+    
+    // by number of including translation units, using the include graph of the files db where it knows the header
+    vector<pair<string,long long> > v;
+    map<string,Stat>::const_iterator it;
+    for( it = headers.begin(); it != headers.end(); it++)
+        v.push_back( make_pair( it->first, (long long)it->second.tus) );
+    sort( v.begin(), v.end(), byTotal);
+    if( v.size() > (size_t)top )
+        v.resize( top );
+    for( size_t i = 0; i < v.size(); i++)
+    {
+        int g = countIncludingObjects( fileMan, v[i].first);
+        if( g > v[i].second )
+            v[i].second = g;
+    }
+    sort( v.begin(), v.end(), byTotal);
+    
+    os << "\nMost included headers (TUs in files db if known, else TUs traced)\n"
+       << "       TUs   total ms  header\n";
+    for( size_t i = 0; i < v.size(); i++)
+        os << setw(10) << v[i].second << setw(11) << headers[ v[i].first ].total_us / 1000 << "  " << v[i].first << "\n";
+    
+    vector<pair<string,Stat> > ti = topOf( instantiations, top);
+    os << "\nMost expensive template instantiations\n"
+       << "   total ms     max ms  TUs  instantiation\n";
+    for( size_t i = 0; i < ti.size(); i++)
+    {
+        const Stat &st = ti[i].second;
+        os << setw(11) << st.total_us / 1000 << setw(11) << st.max_us / 1000 << setw(5) << st.tus << "  " << ti[i].first << "\n";
+    }
+    
+    string tmp = fn + ".tmp";
+    ofstream of( tmp.c_str() );
+    of << os.str();
+    of.close();
+    if( !of || rename( tmp.c_str(), fn.c_str()) != 0 )
+    {
+        cerr << "error: could not write " << fn << "\n";
+        ::remove( tmp.c_str() );
+        return false;
+    }
+    
+    cout << "Time trace report of " << traces << " translation unit(s) written to " << fn << "\n";
+    for( size_t i = 0; i < th.size() && i < 5; i++)
+        cout << "  " << setw(8) << th[i].second.total_us / 1000 << "ms  " << th[i].first << "\n";
+    
+    return true;
+}
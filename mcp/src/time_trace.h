@@ -0,0 +1,45 @@
+#ifndef FERRET_TIME_TRACE_H_
+#define FERRET_TIME_TRACE_H_
+
+#include <string>
+#include <vector>
+#include <map>
+
+class FileManager;
+
+// aggregates clang's -ftime-trace output (<obj>.json next to each object) over all C/C++ objects,
+// enabled with attribute timetrace="true" of compile_mode in platform XML
+class TimeTraceReport
+{
+    struct Stat {
+        Stat()
+            : total_us(0), max_us(0), tus(0), graph_tus(-1)
+        {}
+        
+        long long total_us, max_us;
+        int tus;           // number of translation units with a trace mentioning it
+        int graph_tus;     // number of translation units including it according to files db, -1 if unknown
+    };
+    
+public:
+    TimeTraceReport()
+        : traces(0), frontend_us(0), backend_us(0)
+    {}
+    
+    void collect( FileManager &fileMan );
+    bool write( FileManager &fileMan, const std::string &fn, int top);
+    
+private:
+    bool readTraceFile( const std::string &fn );
+    int countIncludingObjects( FileManager &fileMan, const std::string &header);
+    
+    std::vector<std::pair<std::string,Stat> > topOf( const std::map<std::string,Stat> &m, size_t top) const;
+    
+private:
+    int traces;
+    long long frontend_us, backend_us;
+    std::map<std::string,Stat> headers;
+    std::map<std::string,Stat> instantiations;
+};
+
+#endif
@@ -0,0 +1,133 @@
+#include <cstdio>
+#include <iostream>
+
+#include "usage_db.h"
+#include "glob_utility.h"
+
+using namespace std;
+
+
+static const unsigned char typeind_id = 0x01;
+static const unsigned char typeind_usage = 0x07;
+static const int usage_fields = 8;
+
+
+void UsageDb::read( const string &dbProjDir )
+{
+    fileName = stackPath( dbProjDir, "ferret_usage");
+    usages.clear();
+    changed = false;
+    
+    FILE *fp = fopen( fileName.c_str(), "r");
+    if( !fp )
+        return;
+    
+    bool err = false;
+    while( !feof( fp ) && !err )
+    {
+        unsigned char typeind;
+        int file_id;
+        long long v[ usage_fields ];
+        
+        if( fread( &typeind, sizeof(unsigned char), 1, fp) == 0 )
+            break;
+        
+        if( typeind != typeind_id || fread( &file_id, sizeof(int), 1, fp) != 1 )
+            err = true;
+        else if( fread( &typeind, sizeof(unsigned char), 1, fp) != 1 || typeind != typeind_usage )
+            err = true;
+        else if( fread( v, sizeof(long long), usage_fields, fp) != (size_t)usage_fields )
+            err = true;
+        
+        if( !err )
+        {
+            JobUsage u;
+            u.valid = true;
+            u.wall_ms = v[0];
+            u.utime_ms = v[1];
+            u.stime_ms = v[2];
+            u.maxrss_kb = v[3];
+            u.inblock = v[4];
+            u.oublock = v[5];
+            u.nvcsw = v[6];
+            u.nivcsw = v[7];
+            usages[ file_id ] = u;
+        }
+    }
+    
+    if( verbosity )
+        cout << "Usage read " << usages.size() << " entries\n";
+    if( err )
+        cerr << "warning: ferret_usage corrupt.\n";
+    fclose( fp );
+}
+
+
+void UsageDb::write()
+{
+    if( !changed || fileName.length() == 0 )
+        return;
+    
+    FILE *fp = fopen( fileName.c_str(), "w");
+    if( !fp )
+        return;
+    
+    map<int,JobUsage>::const_iterator it;
+    for( it = usages.begin(); it != usages.end(); it++)
+    {
+        const JobUsage &u = it->second;
+        long long v[ usage_fields ] = { u.wall_ms, u.utime_ms, u.stime_ms, u.maxrss_kb, u.inblock, u.oublock, u.nvcsw, u.nivcsw };
+        
+        fwrite( &typeind_id, sizeof(unsigned char), 1, fp);
+        fwrite( &(it->first), sizeof(int), 1, fp);
+        fwrite( &typeind_usage, sizeof(unsigned char), 1, fp);
+        fwrite( v, sizeof(long long), usage_fields, fp);
+    }
+    
+    if( verbosity )
+        cout << "Usage wrote " << usages.size() << " entries\n";
+    
+    fclose( fp );
+    changed = false;
+}
+
+
+bool UsageDb::get( int file_id, JobUsage &u) const
+{
+    map<int,JobUsage>::const_iterator it = usages.find( file_id );
+    if( it == usages.end() )
+        return false;
+    
+    u = it->second;
+    return true;
+}
+
+
+void UsageDb::set( int file_id, const JobUsage &u)
+{
+    if( !u.valid )
+        return;
+    
+    usages[ file_id ] = u;
+    changed = true;
+}
+
+
+void UsageDb::prune( const vector<int> &file_ids )
+{
+    map<int,JobUsage> kept;
+    for( size_t i = 0; i < file_ids.size(); i++)
+    {
+        map<int,JobUsage>::const_iterator it = usages.find( file_ids[i] );
+        if( it != usages.end() )
+            kept.insert( *it );
+    }
+    
+    if( kept.size() != usages.size() )
+    {
+        if( verbosity > 1 )
+            cout << "Usage pruned " << usages.size() - kept.size() << " entries\n";
+        usages.swap( kept );
+        changed = true;
+    }
+}
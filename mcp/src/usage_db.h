@@ -0,0 +1,34 @@
+#ifndef FERRET_USAGE_DB_H_
+#define FERRET_USAGE_DB_H_
+
+#include <string>
+#include <map>
+#include <vector>
+
+#include "job.h"
+
+// resource usage of the last job per file id, persisted in ferret_usage
+class UsageDb {
+    
+public:
+    UsageDb()
+        : changed(false)
+    {}
+    
+    void read( const std::string &dbProjDir );
+    void write();
+    
+    bool get( int file_id, JobUsage &u) const;
+    void set( int file_id, const JobUsage &u);
+    void prune( const std::vector<int> &file_ids );     // keeps only these, the others left the files db
+    
+    size_t getSize() const
+    { return usages.size(); }
+    
+private:
+    std::string fileName;
+    std::map<int,JobUsage> usages;
+    bool changed;
+};
+
+#endif
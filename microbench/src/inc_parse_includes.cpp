@@ -0,0 +1,2 @@
+// compiles ParseIncludes from inc/src into the benchmark, ferret_inc itself has no library to link against
+#include "parse_includes.cpp"
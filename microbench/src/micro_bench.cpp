@@ -0,0 +1,350 @@
+// microbenchmarks for ferret's hand written data structures and parsers
+// ferret_microbench [-s <scale>] [name...]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <sstream>
+
+#include "hash_set.h"
+#include "file_map.h"
+#include "parse_dep.h"
+#include "simple_xml_stream.h"
+#include "parse_includes.h"
+
+using namespace std;
+
+
+static int scale = 1;
+
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static void report( const string &name, long long ops, long long bytes, double secs)
+{
+    if( secs <= 0 )
+        secs = 1e-9;
+    
+    printf( "%-32s %10lld ops %9.3fs %14.0f ops/s", name.c_str(), ops, secs, ops / secs);
+    if( bytes > 0 )
+        printf( " %10.1f MB/s", bytes / secs / (1024. * 1024.));
+    printf( "\n");
+    fflush( stdout );
+}
+
+
+static FILE *tempWith( const string &content )
+{
+    FILE *fp = tmpfile();
+    if( !fp )
+    {
+        perror( "tmpfile" );
+        exit( 1 );
+    }
+    fwrite( content.data(), 1, content.length(), fp);
+    return fp;
+}
+
+
+static unsigned int rnd_state = 12345;
+static unsigned int rnd()           // deterministic, same numbers every run
+{
+    rnd_state = rnd_state * 1103515245 + 12345;
+    return (rnd_state >> 8) & 0xffffff;
+}
+
+
+static string fileName( int i )
+{
+    stringstream ss;
+    ss << "module_" << (i % 97) << "/sub_" << (i % 13) << "/src/some_file_name_" << i << ((i & 3) ? ".h" : ".cpp");
+    return ss.str();
+}
+
+
+// --- hash_set
+
+static void benchHashSet()
+{
+    const int n = 200000 * scale;          // file ids are dense, a big tree has some 100000 files
+    double t;
+    
+    hash_set_t *hs = new_hash_set( 10007 );
+    t = now();
+    for( int i = 0; i < n; i++)
+        hash_set_add( hs, (int)(rnd() % 400000));
+    report( "hash_set_add", n, 0, now() - t);
+    
+    int found = 0;
+    t = now();
+    for( int i = 0; i < n; i++)
+        found += hash_set_has_id( hs, (int)(rnd() % 400000));
+    report( "hash_set_has_id", n, 0, now() - t);
+    
+    // many small sets, like the dependency sets of FileMap
+    const int sets = 20000 * scale;
+    vector<hash_set_t *> small;
+    t = now();
+    for( int i = 0; i < sets; i++)
+    {
+        hash_set_t *s = new_hash_set( 17 );
+        for( int k = 0; k < 20; k++)
+            hash_set_add( s, (int)(rnd() % 50000));
+        small.push_back( s );
+    }
+    report( "hash_set small sets (20 adds)", sets, 0, now() - t);
+    
+    hash_set_t *u = new_hash_set( 977 );
+    t = now();
+    for( int i = 0; i < sets; i++)
+        hash_set_union( u, small[i]);
+    report( "hash_set_union", sets, 0, now() - t);
+    
+    // like all_targets minus done_set in the engine
+    const int rounds = 10;
+    hash_set_t *half = new_hash_set( 977 );
+    for( int i = 0; i < 50000; i += 2)
+        hash_set_add( half, i);
+    long long elems = 0;
+    t = now();
+    for( int r = 0; r < rounds; r++)
+    {
+        hash_set_t *c = new_hash_set( 977 );
+        hash_set_union( c, u);
+        hash_set_minus( c, half);
+        elems += hash_set_get_size( u );
+        delete_hash_set( c );
+    }
+    report( "hash_set_union+minus (elements)", elems, 0, now() - t);
+    
+    for( int i = 0; i < sets; i++)
+        delete_hash_set( small[i] );
+    delete_hash_set( half );
+    delete_hash_set( u );
+    delete_hash_set( hs );
+    
+    if( found < 0 )
+        printf( "never\n");
+}
+
+
+// --- FileMap
+
+static void benchFileMap()
+{
+    const int n = 100000 * scale;
+    vector<string> names;
+    for( int i = 0; i < n; i++)
+        names.push_back( fileName( i ) );
+    
+    FileMap fm( 10007 );
+    double t = now();
+    for( int i = 0; i < n; i++)
+        fm.add( i, names[i], 0);
+    report( "FileMap::add", n, 0, now() - t);
+    
+    long long sum = 0;
+    t = now();
+    for( int i = 0; i < n; i++)
+        sum += fm.getIdForFileName( names[ rnd() % n ] );
+    report( "FileMap::getIdForFileName", n, 0, now() - t);
+    
+    t = now();
+    for( int i = 0; i < n; i++)
+        sum += fm.getFileNameForId( rnd() % n ).length();
+    report( "FileMap::getFileNameForId", n, 0, now() - t);
+    
+    const int deps = 8 * n;
+    fm.setDbReadMode( true );
+    t = now();
+    for( int i = 0; i < deps; i++)
+        fm.addDependency( rnd() % n, rnd() % n);
+    report( "FileMap::addDependency", deps, 0, now() - t);
+    fm.setDbReadMode( false );
+    
+    t = now();
+    for( int i = 0; i < n; i++)
+        sum += hash_set_get_size( fm.getDependencies( rnd() % n ) );
+    report( "FileMap::getDependencies", n, 0, now() - t);
+    
+    if( sum == -1 )
+        printf( "never\n");
+}
+
+
+// --- ParseDep
+
+static void benchParseDep()
+{
+    string content;
+    const int entries = 2000;
+    for( int i = 0; i < entries; i++)
+    {
+        content += fileName( i * 4 ) + ":";
+        int incs = 5 + rnd() % 40;
+        int col = 0;
+        for( int k = 0; k < incs; k++)
+        {
+            string f = fileName( rnd() % 100000 );
+            if( col + f.length() > 80 )
+            {
+                content += " \\\n";
+                col = 0;
+            }
+            content += " " + f;
+            col += f.length() + 1;
+        }
+        content += "\n";
+    }
+    
+    FILE *fp = tempWith( content );
+    const int rounds = 5 * scale;
+    long long n = 0;
+    double t = now();
+    for( int r = 0; r < rounds; r++)
+    {
+        rewind( fp );
+        ParseDep pd( fp );
+        pd.parse();
+        n += pd.getDepEntries().size();
+    }
+    report( "ParseDep::parse", n, (long long)content.length() * rounds, now() - t);
+    fclose( fp );
+}
+
+
+// --- SimpleXMLStream
+
+static void benchSimpleXMLStream()
+{
+    string content = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<platform>\n";
+    for( int i = 0; i < 5000; i++)
+    {
+        stringstream ss;
+        ss << "  <!-- node " << i << " -->\n"
+           << "  <compile_mode value=\"MODE_" << i << "\">\n"
+           << "    <cppflags value=\" -g -O2 -DRELEASE -DNODE_" << i << " \"/>\n"
+           << "    <cflags value=\" -g \"/>\n"
+           << "  </compile_mode>\n"
+           << "  <sub name=\"" << fileName( i ) << "\" />\n";
+        content += ss.str();
+    }
+    content += "</platform>\n";
+    
+    FILE *fp = tempWith( content );
+    const int rounds = 5 * scale;
+    long long n = 0;
+    double t = now();
+    for( int r = 0; r < rounds; r++)
+    {
+        rewind( fp );
+        SimpleXMLStream xmls( fp );
+        while( !xmls.atEnd() && !xmls.hasError() )
+        {
+            if( xmls.readNext() == SimpleXMLStream::START_ELEMENT )
+                n += xmls.attributes().size() + 1;
+        }
+    }
+    report( "SimpleXMLStream::readNext", n, (long long)content.length() * rounds, now() - t);
+    fclose( fp );
+}
+
+
+// --- ParseIncludes
+
+static void benchParseIncludes()
+{
+    string content;
+    for( int i = 0; i < 20000; i++)
+    {
+        stringstream ss;
+        if( i % 10 == 0 )
+            ss << "#include \"" << fileName( i ) << "\"\n";
+        else if( i % 10 == 1 )
+            ss << "#include <vector>\n";
+        else if( i % 10 == 2 )
+            ss << "/* block comment with #include \"not_this.h\" inside\n   over two lines */\n";
+        else if( i % 10 == 3 )
+            ss << "// line comment " << i << "\n";
+        else if( i % 10 == 4 )
+            ss << "    const char *s = \"string with \\\"quotes\\\" and #include <x>\";\n";
+        else
+            ss << "    int value_" << i << " = compute( a, b + " << i << ", c);\n";
+        content += ss.str();
+    }
+    
+    FILE *fp = tempWith( content );
+    
+    const int rounds = 5 * scale;
+    double t = now();
+    for( int r = 0; r < rounds; r++)
+    {
+        rewind( fp );
+        ParseIncludes p( fp );
+        p.parse();
+    }
+    double d = now() - t;
+    report( "ParseIncludes::parse", rounds, (long long)content.length() * rounds, d);
+    fclose( fp );
+}
+
+
+struct Bench {
+    const char *name;
+    void (*fn)();
+};
+
+static const Bench benches[] = {
+    { "hash_set", benchHashSet },
+    { "file_map", benchFileMap },
+    { "parse_dep", benchParseDep },
+    { "simple_xml_stream", benchSimpleXMLStream },
+    { "parse_includes", benchParseIncludes },
+    { 0, 0 }
+};
+
+
+int main( int argc, char **argv)
+{
+    vector<string> only;
+    
+    for( int i = 1; i < argc; i++)
+    {
+        if( strcmp( argv[i], "-s") == 0 && i + 1 < argc )
+        {
+            scale = atoi( argv[++i] );
+            if( scale < 1 )
+                scale = 1;
+        }
+        else if( argv[i][0] == '-' )
+        {
+            cerr << "usage: ferret_microbench [-s <scale>] [hash_set|file_map|parse_dep|simple_xml_stream|parse_includes ...]\n";
+            return 2;
+        }
+        else
+            only.push_back( argv[i] );
+    }
+    
+    for( int b = 0; benches[b].name; b++)
+    {
+        bool run = only.size() == 0;
+        for( size_t i = 0; i < only.size(); i++)
+            if( only[i] == benches[b].name )
+                run = true;
+        
+        if( run )
+            benches[b].fn();
+    }
+    
+    return 0;
+}
@@ -0,0 +1,7 @@
+export module greet;
+export import :text;
+
+export const char *greeting()
+{
+    return text();
+}
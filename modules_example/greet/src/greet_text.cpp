@@ -0,0 +1,6 @@
+export module greet:text;
+
+export const char *text()
+{
+    return "Hello, world!";
+}
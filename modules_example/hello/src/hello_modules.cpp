@@ -0,0 +1,9 @@
+#include <cstdio>
+
+import greet;
+
+int main()
+{
+    printf( "%s\n", greeting());
+    return 0;
+}
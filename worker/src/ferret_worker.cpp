@@ -0,0 +1,454 @@
+// worker daemon for ferret's remote execution (FERRET_REMOTE_WORKERS), protocol see mcp/src/remote_executor.h
+// ferret_worker -d <dir> [-p <port>] [-b <bind address>] [-j <jobs>] [-t <token file>] [-a <program>] ...
+// inputs are kept in <dir>/cas by digest, each job runs in a scratch directory below <dir>/tmp that holds
+// its inputs at their project relative paths. the compiler and system headers must be installed here as
+// on the build host.
+// a job runs any program its client names. so the worker binds to 127.0.0.1 by default and needs a token
+// (first line of the -t file, the same file as FERRET_REMOTE_TOKEN of the clients) for any other address.
+// -a limits the programs to the ones given, by path or base name. compiles come as the compiler call, other
+// jobs as /bin/sh <script>. a shell runs anything, so it is refused unless given with -a itself
+// the token goes over the network in plain text, it keeps out strangers but not someone who can listen
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <set>
+#include <iostream>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "sha256.h"
+
+using namespace std;
+
+static string dir, token;
+static set<string> allowed;     // programs jobs may run, empty: all but a shell
+
+struct Input {
+    string digest, path;
+    unsigned long size;
+};
+
+
+static bool isDigest( const string &s )
+{
+    if( s.length() != 64 )
+        return false;
+    
+    for( size_t i = 0; i < s.length(); i++)
+        if( !((s[i] >= '0' && s[i] <= '9') || (s[i] >= 'a' && s[i] <= 'f')) )
+            return false;
+    return true;
+}
+
+
+// project relative and staying inside the scratch directory
+static bool isSafePath( const string &p )
+{
+    return p.length() > 0 && p[0] != '/' && p.compare( 0, 3, "../") != 0 && p.find( "/../" ) == string::npos && p != "..";
+}
+
+
+static string casPath( const string &digest )
+{
+    return dir + "/cas/" + digest.substr( 0, 2) + "/" + digest;
+}
+
+
+static void mkdirParents( const string &fn )
+{
+    for( size_t p = fn.find( '/', 1); p != string::npos; p = fn.find( '/', p + 1))
+        mkdir( fn.substr( 0, p).c_str(), 0755);
+}
+
+
+static bool sendAll( int fd, const string &data )
+{
+    size_t sent = 0;
+    while( sent < data.length() )
+    {
+        ssize_t n = send( fd, data.data() + sent, data.length() - sent, MSG_NOSIGNAL);
+        if( n <= 0 )
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+
+static bool readLine( FILE *in, string &line)
+{
+    char buf[ 8192 ];
+    if( !fgets( buf, sizeof(buf), in) )
+        return false;
+    
+    line = buf;
+    if( line.length() == 0 || line[ line.length() - 1 ] != '\n' )
+        return false;
+    line.erase( line.length() - 1 );
+    return true;
+}
+
+
+static bool readBytes( FILE *in, unsigned long len, string &data)
+{
+    data.resize( len );
+    return len == 0 || fread( &data[0], 1, len, in) == len;
+}
+
+
+static bool readFile( const string &fn, string &content)
+{
+    FILE *fp = fopen( fn.c_str(), "r");
+    if( !fp )
+        return false;
+    
+    char buf[ 65536 ];
+    size_t n;
+    while( (n = fread( buf, 1, sizeof(buf), fp)) > 0 )
+        content.append( buf, n);
+    
+    bool ok = !ferror( fp );
+    fclose( fp );
+    return ok;
+}
+
+
+static bool writeFile( const string &fn, const string &content)
+{
+    char suffix[ 32 ];
+    snprintf( suffix, sizeof(suffix), ".tmp%d", (int)getpid());
+    string tmp = fn + suffix;
+    
+    int fd = open( tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if( fd < 0 )
+        return false;
+    
+    bool ok = write( fd, content.data(), content.length()) == (ssize_t)content.length();
+    if( close( fd ) != 0 || !ok || rename( tmp.c_str(), fn.c_str()) != 0 )
+    {
+        unlink( tmp.c_str() );
+        return false;
+    }
+    return true;
+}
+
+
+static int removeEntry( const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+    remove( path );
+    return 0;
+}
+
+
+static int runJob( const vector<string> &argv, const string &scratch, const string &outFn, const string &errFn)
+{
+    pid_t pid = fork();
+    if( pid < 0 )
+        return 127;
+    
+    if( pid == 0 )
+    {
+        int out = open( outFn.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        int err = open( errFn.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if( out < 0 || err < 0 || chdir( scratch.c_str() ) != 0 )
+            _exit( 127 );
+        dup2( out, STDOUT_FILENO);
+        dup2( err, STDERR_FILENO);
+        close( out );
+        close( err );
+        
+        vector<char *> args;
+        for( size_t i = 0; i < argv.size(); i++)
+            args.push_back( strdup( argv[i].c_str() ) );
+        args.push_back( 0 );
+        
+        execvp( args[0], &args[0]);
+        perror( "exec" );
+        _exit( 127 );
+    }
+    
+    int status;
+    while( waitpid( pid, &status, 0) < 0 )
+    {
+        if( errno != EINTR )
+            return 127;
+    }
+    
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+
+// compares all of it, the time taken must not tell how much of a guess was right
+static bool sameToken( const string &a, const string &b)
+{
+    unsigned char diff = a.length() != b.length();
+    for( size_t i = 0; i < a.length(); i++)
+        diff |= a[i] ^ b[ i % (b.length() > 0 ? b.length() : 1) ];
+    return diff == 0;
+}
+
+
+// by path or base name. a shell runs whatever script the client ships along, it has to be listed itself
+static bool isAllowed( const string &prog )
+{
+    size_t slash = prog.rfind( '/' );
+    string bn = slash == string::npos ? prog : prog.substr( slash + 1 );
+    
+    if( allowed.count( prog ) > 0 || allowed.count( bn ) > 0 )
+        return true;
+    return allowed.size() == 0 && bn != "sh" && bn != "bash" && bn != "dash";
+}
+
+
+static void serve( int fd )
+{
+    FILE *in = fdopen( fd, "r");
+    string line, data;
+    vector<string> argv, outs;
+    vector<Input> inputs;
+    
+    if( !in || !readLine( in, line) || line != "ferret-job 1" )
+        return;
+    
+    if( token.length() > 0 && (!readLine( in, line) || line.compare( 0, 6, "token ") != 0 || !sameToken( line.substr( 6 ), token)) )
+    {
+        sendAll( fd, "denied wrong token\n");
+        return;
+    }
+    
+    while( readLine( in, line) && line != "end" )
+    {
+        unsigned long len;
+        char digest[ 65 ];
+        int n = 0;
+        
+        if( sscanf( line.c_str(), "arg %lu", &len) == 1 && readBytes( in, len + 1, data) )
+            argv.push_back( data.substr( 0, len) );
+        else if( sscanf( line.c_str(), "in %64s %lu %n", digest, &len, &n) == 2 && n > 0 &&
+                 isDigest( digest ) && isSafePath( line.substr( n ) ) )
+        {
+            Input i;
+            i.digest = digest;
+            i.size = len;
+            i.path = line.substr( n );
+            inputs.push_back( i );
+        }
+        else if( line.compare( 0, 4, "out ") == 0 && isSafePath( line.substr( 4 ) ) )
+            outs.push_back( line.substr( 4 ) );
+        else
+            return;
+    }
+    
+    if( line != "end" || argv.size() == 0 )
+        return;
+    
+    if( !isAllowed( argv[0] ) )
+    {
+        sendAll( fd, "refused " + argv[0] + " is not allowed here\n");
+        return;
+    }
+    
+    // ask for what is missing, then take the blobs
+    set<string> missing;
+    string reply;
+    for( size_t i = 0; i < inputs.size(); i++)
+        if( access( casPath( inputs[i].digest ).c_str(), R_OK) != 0 && missing.insert( inputs[i].digest ).second )
+            reply += "need " + inputs[i].digest + "\n";
+    reply += "ready\n";
+    if( !sendAll( fd, reply) )
+        return;
+    
+    for( size_t i = 0; i < missing.size(); i++)
+    {
+        char digest[ 65 ];
+        unsigned long len;
+        
+        if( !readLine( in, line) || sscanf( line.c_str(), "blob %64s %lu", digest, &len) != 2 || missing.count( digest ) == 0 ||
+            !readBytes( in, len, data) || Sha256::hex( data ) != digest )
+            return;
+        
+        string fn = casPath( digest );
+        mkdirParents( fn );
+        if( !writeFile( fn, data) )
+            return;
+    }
+    
+    // scratch directory with the inputs at their places
+    char name[ 64 ];
+    snprintf( name, sizeof(name), "/tmp/job%d", (int)getpid());
+    string scratch = dir + name;
+    mkdir( scratch.c_str(), 0755);
+    
+    bool ok = true;
+    for( size_t i = 0; i < inputs.size() && ok; i++)
+    {
+        string fn = scratch + "/" + inputs[i].path;
+        mkdirParents( fn );
+        if( link( casPath( inputs[i].digest ).c_str(), fn.c_str()) != 0 )
+        {
+            string content;
+            ok = readFile( casPath( inputs[i].digest ), content) && writeFile( fn, content);
+        }
+    }
+    for( size_t i = 0; i < outs.size(); i++)
+        mkdirParents( scratch + "/" + outs[i] );
+    
+    int code = ok ? runJob( argv, scratch, scratch + ".out", scratch + ".err") : 127;
+    
+    string stdOut, stdErr;
+    readFile( scratch + ".out", stdOut);
+    readFile( scratch + ".err", stdErr);
+    if( !ok )
+        stdErr += "ferret_worker: could not set up the job's inputs\n";
+    
+    char head[ 128 ];
+    snprintf( head, sizeof(head), "exit %d\nstdout %lu\n", code, (unsigned long)stdOut.length());
+    reply = head + stdOut;
+    snprintf( head, sizeof(head), "stderr %lu\n", (unsigned long)stdErr.length());
+    reply += head + stdErr;
+    
+    for( size_t i = 0; i < outs.size(); i++)
+    {
+        string fn = scratch + "/" + outs[i], content;
+        struct stat st;
+        
+        if( stat( fn.c_str(), &st) == 0 && readFile( fn, content) )
+        {
+            snprintf( head, sizeof(head), "out %lu %o ", (unsigned long)content.length(), (unsigned int)(st.st_mode & 0777));
+            reply += head + outs[i] + "\n" + content;
+        }
+    }
+    reply += "end\n";
+    sendAll( fd, reply);
+    
+    nftw( scratch.c_str(), removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+    unlink( (scratch + ".out").c_str() );
+    unlink( (scratch + ".err").c_str() );
+}
+
+
+int main( int argc, char **argv)
+{
+    string port = "8700", bindAddr = "127.0.0.1";
+    int maxJobs = sysconf( _SC_NPROCESSORS_ONLN );
+    
+    for( int i = 1; i < argc; i++)
+    {
+        if( strcmp( argv[i], "-d") == 0 && i + 1 < argc )
+            dir = argv[++i];
+        else if( strcmp( argv[i], "-p") == 0 && i + 1 < argc )
+            port = argv[++i];
+        else if( strcmp( argv[i], "-b") == 0 && i + 1 < argc )
+            bindAddr = argv[++i];
+        else if( strcmp( argv[i], "-j") == 0 && i + 1 < argc )
+            maxJobs = atoi( argv[++i] );
+        else if( strcmp( argv[i], "-t") == 0 && i + 1 < argc )
+        {
+            if( !readFile( argv[++i], token) )
+            {
+                cerr << "error: cannot read token file " << argv[i] << "\n";
+                return 1;
+            }
+            token = token.substr( 0, token.find_first_of( "\r\n" ));
+        }
+        else if( strcmp( argv[i], "-a") == 0 && i + 1 < argc )
+            allowed.insert( argv[++i] );
+        else
+        {
+            dir = "";
+            break;
+        }
+    }
+    
+    if( dir == "" || maxJobs < 1 )
+    {
+        cerr << "usage: ferret_worker -d <dir> [-p <port>] [-b <bind address>] [-j <jobs>] [-t <token file>] [-a <program>] ...\n";
+        return 2;
+    }
+    
+    mkdir( dir.c_str(), 0755);
+    mkdir( (dir + "/cas").c_str(), 0755);
+    mkdir( (dir + "/tmp").c_str(), 0755);
+    signal( SIGPIPE, SIG_IGN);
+    
+    struct addrinfo hints, *res;
+    memset( &hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    
+    if( getaddrinfo( bindAddr.c_str(), port.c_str(), &hints, &res) != 0 )
+    {
+        cerr << "error: cannot resolve " << bindAddr << "\n";
+        return 1;
+    }
+    
+    bool loopback = res->ai_family == AF_INET ?
+        (ntohl( ((struct sockaddr_in *)res->ai_addr)->sin_addr.s_addr ) >> 24) == 127 :
+        res->ai_family == AF_INET6 && IN6_IS_ADDR_LOOPBACK( &((struct sockaddr_in6 *)res->ai_addr)->sin6_addr );
+    if( !loopback )
+    {
+        if( token.length() == 0 )
+        {
+            cerr << "error: " << bindAddr << " is not a loopback address. anyone who reaches it could run any program\n"
+                 << "here as " << (getenv( "USER" ) ? getenv( "USER" ) : "this user") << ", give a token file with -t.\n";
+            return 1;
+        }
+        cerr << "**********************************************************************\n"
+             << "WARNING: listening on " << bindAddr << ", not only on this host. jobs run programs as this\n"
+             << "user for anyone who has the token" << (allowed.size() == 0 ? ", any program but a shell (see -a)" : "")
+             << ". the token is sent in plain text,\n"
+             << "use this only on a network you trust.\n"
+             << "**********************************************************************\n";
+    }
+    
+    int lfd = socket( res->ai_family, res->ai_socktype, res->ai_protocol);
+    int on = 1;
+    setsockopt( lfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if( lfd < 0 || bind( lfd, res->ai_addr, res->ai_addrlen) != 0 || listen( lfd, 512) != 0 )
+    {
+        perror( "ferret_worker" );
+        return 1;
+    }
+    freeaddrinfo( res );
+    
+    cout << "worker in " << dir << " on " << bindAddr << ":" << port << ", " << maxJobs << " job(s)" << endl;
+    
+    int running = 0;
+    for(;;)
+    {
+        while( running > 0 && waitpid( -1, 0, running >= maxJobs ? 0 : WNOHANG) > 0 )    // more connections wait in the backlog
+            running--;
+        
+        int fd = accept( lfd, 0, 0);
+        if( fd < 0 )
+            continue;
+        
+        pid_t pid = fork();
+        if( pid == 0 )
+        {
+            close( lfd );
+            serve( fd );
+            _exit( 0 );
+        }
+        
+        if( pid > 0 )
+            running++;
+        close( fd );
+    }
+    
+    return 0;
+}